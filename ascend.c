@@ -6,21 +6,26 @@
 
 #include <ctype.h>
 #include <errno.h>
-#include <fcntl.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
 #include <sys/ioctl.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <termios.h>
+#include <signal.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "ascend.h"
+
 /*** defines ***/
-#define ASCEND_VERSION "4.0.156 -stable"
-#define ASCEND_TAB_STOP 8
 #define ASCEND_QUIT_TIMES 2
+#define ASCEND_MEM_BUDGET_MB 512
+#define ASCEND_HEX_WIDTH 16 // bytes per line of a hex view
+#define ASCEND_DIFF_CONTEXT 3 // unchanged lines shown around a hunk
 
 #define CTRL_KEY(k) ((k)&0x1f)
 
@@ -35,96 +40,154 @@ enum editorKey
     HOME_KEY,
     END_KEY,
     PAGE_UP,
-    PAGE_DOWN
+    PAGE_DOWN,
+    SHIFT_ARROW_LEFT,
+    SHIFT_ARROW_RIGHT,
+    SHIFT_ARROW_UP,
+    SHIFT_ARROW_DOWN,
+    SHIFT_HOME,
+    SHIFT_END,
+    SHIFT_TAB,
+    PASTE_START,    // bracketed paste: the pasted text follows
+    FOLLOW_UPDATE,  // not a key: a followed file has new data
+    SAVE_UPDATE,    // not a key: a background save made progress or ended
+    TERMINAL_RESIZE // not a key: the window size changed
 };
 
-enum editorHighlight
+/*** data ***/
+
+// what a text line of the terminal showed after the last frame, so the
+// next frame only has to send the lines that changed
+struct editorScreenLine
 {
-    HL_NORMAL = 0,
-    HL_COMMENT,
-    HL_MLCOMMENT,
-    HL_KEYWORD1,
-    HL_KEYWORD2,
-    HL_STRING,
-    HL_NUMBER,
-    HL_MATCH
+    char *b;
+    int len; // -1 when unknown
 };
 
-#define HL_HIGHLIGHT_NUMBERS (1 << 0)
-#define HL_HIGHLIGHT_STRINGS (1 << 1)
+// scroll position of a buffer that isn't on screen
+struct editorView
+{
+    int rowoffset;
+    int coloffset;
+    long long lineoffset;
+};
 
-/*** data ***/
+// keyboard macro, recorded with ctrl-b and replayed with ctrl-e. while it
+// replays, keys come from here instead of the terminal
+struct editorMacro
+{
+    int *keys;
+    int len;
+    int cap;
+    int pos; // next key to replay
+    int recording;
+    int replaying;
+    int failed; // a search in the macro found nothing
+};
 
-struct editorSyntax
+// a line of the diff view: a hunk header (line is the hunk), a line of
+// the saved file the hunk removed, or a row of the buffer it added or
+// that is shown around it as context
+struct editorDiffLine
 {
-    char *filetype;
-    char **filematch;
-    char **keywords;
-    char *singleline_comment_start;
-    char *multiline_comment_start;
-    char *multiline_comment_end;
-    int flags;
+    char kind; // '@', '-', '+' or ' '
+    int line;
 };
 
-typedef struct erow
+// the current buffer against its file on disk, opened with ctrl-d
+struct editorDiffView
 {
-    int index;
-    int size;
-    int rowsize;
-    char *chars;
-    char *render;
-    unsigned char *highlight;
-    int highlight_open_comment;
-} erow;
+    struct editorDiff diff;
+    struct editorDiffLine *line;
+    int len;
+    int top;    // first line on screen
+    int cursor; // line under the cursor
+};
 
+// terminal front end state; the buffers themselves live in libascend and
+// the current one is reached through E.ctx
 struct editorConfig
 {
-    int cx, cy;
+    editorContext *ctx;
+    editorBufferList *buffers;
+    struct editorView *views; // parallel to buffers->bufs
     int rx;
     int rowoffset;
     int coloffset;
     int screenrows;
     int screencols;
-    int numrows;
-    erow *row;
-    int dirty;
-    char *filename; // status bar only
     char statusmsg[80];
     time_t statusmsg_time;
-    struct editorSyntax *syntax;
     struct termios orig_termios;
-};
 
-struct editorConfig E;
+    // performance HUD, toggled with ctrl-t. values describe the previous
+    // frame since the current one is still being built when they're drawn
+    int hud;
+    long long hud_frame_ns;
+    int hud_frame_bytes;
+    long long hud_syntax_ns;
 
-/***  filetypes  ***/
+    // when the current keystroke came back from editorReadKey, for tracing
+    long long trace_key_ns;
 
-char *C_Highlight_Extensions[] = {".c", ".h", ".cpp", NULL};
-char *C_Highlight_Keywords[] = {
-    "switch", "if", "while", "for", "break", "continue", "return", "else",
-    "struct", "union", "typedef", "static", "enum", "class", "case",
+    long long progress_ns; // last load progress repaint
 
-    "int|", "long|", "double|", "float|", "char|", "unsigned|", "signed|",
-    "void|", NULL};
+    // selection from the anchor to the cursor, made with shift+movement
+    int sel_active;
+    int sel_cy;
+    int sel_cx;
 
-struct editorSyntax HLDB[] = {
-    {
-        "c",
-        C_Highlight_Extensions,
-        C_Highlight_Keywords,
-        "//",
-        "/*",
-        "*/",
-        HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS,
-    },
+    // cut/copy/paste buffer, shared by all buffers
+    char *clipboard;
+    size_t clipboard_len;
+
+    // soft wrap, toggled with ctrl-w. rows are cut at the screen width and
+    // the view scrolls by screen lines: lineoffset is the first one shown.
+    // hex views scroll by lineoffset too, counting lines of ASCEND_HEX_WIDTH
+    // bytes
+    int wrap;
+    long long lineoffset;
+
+    // terminal contents as of the last frame, and the row (or screen line
+    // when wrapping or in hex) that was at the top
+    struct editorScreenLine *screen;
+    long long screen_top;
+
+    // front end allocations that the memory report counts
+    size_t out_peak; // largest frame output buffer so far
+
+    // memory report written on SIGUSR1
+    char *mem_dump_path;
+
+    struct editorMacro macro;
+
+    struct editorDiffView *diff; // NULL unless the diff view is open
+
+    // the bracket matching the one under the cursor, found once per frame:
+    // its row (-1 for none) and render offset
+    int bracket_row;
+    int bracket_offset;
 };
 
-#define HLDB_ENTRIES (sizeof(HLDB) / sizeof(HLDB[0]))
+struct editorConfig E;
+
+// set by the SIGUSR1 handler, the report itself is written from the main loop
+volatile sig_atomic_t mem_dump_requested = 0;
+
+// set by the SIGWINCH handler, picked up by editorReadKey
+volatile sig_atomic_t resize_requested = 0;
 
 /***  prototype functions  ***/
 void editorSetStatusMsg(const char *fmt, ...);
 void editorRefreshScreen();
+void editorMemoryDumpIfRequested();
 char *editorPrompt(char *prompt, void (*callback)(char *, int));
+void editorMoveCursor(int key);
+void editorProcessKeypress();
+int editorNextKey();
+void editorMacroRecord(int key);
+int editorSaving();
+void editorSaveUpdate(int wait);
 
 /*** terminal ***/
 
@@ -139,6 +202,7 @@ void errhandl(const char *s)
 
 void disableRawMode()
 {
+    write(STDOUT_FILENO, "\x1b[?2004l", 8);
     if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &E.orig_termios) == -1)
         errhandl("tcsetattr");
 }
@@ -159,16 +223,70 @@ void enableRawMode()
 
     if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw) == -1)
         errhandl("tcsetattr");
+
+    // have the terminal mark pastes so they're inserted in one piece
+    write(STDOUT_FILENO, "\x1b[?2004h", 8);
+}
+
+// waits for a key while also watching followed files and background
+// saves. returns 0 when a followed file changed or a save ended (or a
+// second passed, to catch missed rotations, or a tenth of one while a
+// save is running, to show its progress) before any input arrived.
+int editorWaitForInput()
+{
+    struct pollfd fds[2 * E.buffers->numbufs + 1];
+    int nfds = 0;
+    int saving = 0;
+
+    fds[nfds].fd = STDIN_FILENO;
+    fds[nfds++].events = POLLIN;
+    for (int cnt = 0; cnt < E.buffers->numbufs; cnt++)
+    {
+        editorContext *ctx = E.buffers->bufs[cnt];
+        if (ctx->follow)
+        {
+            fds[nfds].fd = ctx->follow->inotify_fd;
+            fds[nfds++].events = POLLIN;
+        }
+        if (ctx->save)
+        {
+            fds[nfds].fd = ctx->save->fd;
+            fds[nfds++].events = POLLIN;
+            saving = 1;
+        }
+    }
+
+    if (nfds == 1)
+        return 1;
+
+    int ready;
+    while ((ready = poll(fds, nfds, saving ? 100 : 1000)) == -1)
+    {
+        if (errno != EINTR)
+            errhandl("poll");
+        editorMemoryDumpIfRequested();
+    }
+
+    return fds[0].revents & POLLIN;
 }
 
 int editorReadKey()
 {
     int nread;
     char c;
+
+    if (!editorWaitForInput())
+        return editorSaving()
+                   ? SAVE_UPDATE
+                   : FOLLOW_UPDATE;
+
     while ((nread = read(STDIN_FILENO, &c, 1)) != 1)
     {
-        if (nread == -1 && errno != EAGAIN)
+        if (nread == -1 && errno != EAGAIN && errno != EINTR)
             errhandl("read");
+        editorMemoryDumpIfRequested();
+        if (resize_requested)
+            return TERMINAL_RESIZE;
     }
 
     if (c == '\x1b')
@@ -186,6 +304,36 @@ int editorReadKey()
             {
                 if (read(STDIN_FILENO, &seq[2], 1) != 1)
                     return '\x1b';
+                if (seq[1] == '1' && seq[2] == ';')
+                {
+                    // modified keys: ESC [ 1 ; <modifier> <key>
+                    char mod[2];
+                    if (read(STDIN_FILENO, mod, 2) != 2 || mod[0] != '2')
+                        return '\x1b';
+                    switch (mod[1])
+                    {
+                    case 'A':
+                        return SHIFT_ARROW_UP;
+                    case 'B':
+                        return SHIFT_ARROW_DOWN;
+                    case 'C':
+                        return SHIFT_ARROW_RIGHT;
+                    case 'D':
+                        return SHIFT_ARROW_LEFT;
+                    case 'H':
+                        return SHIFT_HOME;
+                    case 'F':
+                        return SHIFT_END;
+                    }
+                    return '\x1b';
+                }
+                if (seq[1] == '2' && seq[2] == '0')
+                {
+                    char tail[2];
+                    if (read(STDIN_FILENO, tail, 2) == 2 && tail[0] == '0' && tail[1] == '~')
+                        return PASTE_START;
+                    return '\x1b';
+                }
                 if (seq[2] == '~')
                 {
                     switch (seq[1])
@@ -223,6 +371,8 @@ int editorReadKey()
                     return HOME_KEY;
                 case 'F':
                     return END_KEY;
+                case 'Z':
+                    return SHIFT_TAB;
                 }
             }
         }
@@ -239,7 +389,7 @@ int editorReadKey()
         return '\x1b';
     }
     else
-        return c;
+        return (unsigned char)c;
 }
 
 int getCursorPosition(int *rows, int *cols)
@@ -288,178 +438,47 @@ int getWindowSize(int *rows, int *cols)
     }
 }
 
-/***  syntax highlighting  ***/
-
-int isSeparator(int c)
+// a cache of terminal lines for the current window size. nothing on the
+// terminal is known yet, so the next frame sends every line.
+void editorAllocScreen()
 {
+    E.screen = malloc(sizeof(struct editorScreenLine) * E.screenrows);
+    if (E.screen == NULL)
+        errhandl("editorAllocScreen");
+    for (int cnt = 0; cnt < E.screenrows; cnt++)
+    {
+        E.screen[cnt].b = NULL;
+        E.screen[cnt].len = -1;
+    }
+}
 
-    return isspace(c) ||
-           c == '\0' ||
-           strchr(",.()+-/*=~%<>[];", c) != NULL;
+void editorResizeSignal(int sig)
+{
+    (void)sig;
+    resize_requested = 1;
 }
 
-void editorUpdateSyntax(erow *row)
+// picks up a new window size. editorScroll hands the new width to the
+// wrap index on the next frame.
+void editorResize()
 {
-    row->highlight = realloc(row->highlight, row->rowsize);
-    memset(row->highlight, HL_NORMAL, row->rowsize);
+    int rows, cols;
 
-    if (E.syntax == NULL)
+    resize_requested = 0;
+    if (getWindowSize(&rows, &cols) == -1 || rows < 3)
         return;
 
-    char **keywords = E.syntax->keywords;
-
-    char *scs = E.syntax->singleline_comment_start;
-    char *mcs = E.syntax->multiline_comment_start;
-    char *mce = E.syntax->multiline_comment_end;
-
-    int scs_len = scs
-                      ? strlen(scs)
-                      : 0;
-
-    int mcs_len = mcs
-                      ? strlen(mcs)
-                      : 0;
-
-    int mce_len = mce
-                      ? strlen(mce)
-                      : 0;
-
-    int prev_separator = 1;
-    int in_string = 0;
-    int in_comment = (row->index > 0 && E.row[row->index - 1].highlight_open_comment);
-
-    int cnt = 0;
-    while (cnt < row->rowsize)
-    {
-        char c = row->render[cnt];
-        unsigned char prev_highlight = (cnt > 0)
-                                           ? row->highlight[cnt - 1]
-                                           : HL_NORMAL;
-
-        if (scs_len && !in_string && !in_comment)
-        {
-            if (!strncmp(&row->render[cnt], scs, scs_len))
-            {
-                memset(&row->highlight[cnt], HL_COMMENT, row->rowsize - cnt);
-                break;
-            }
-        }
-
-        if (mcs_len && mce_len && !in_string)
-        {
-            if (in_comment)
-            {
-                row->highlight[cnt] = HL_MLCOMMENT;
-                if (!strncmp(&row->render[cnt], mce, mce_len))
-                {
-                    memset(&row->highlight[cnt], HL_MLCOMMENT, mce_len);
-                    cnt += mce_len;
-                    in_comment = 0;
-                    prev_separator = 1;
-                    continue;
-                }
-                else
-                {
-                    cnt++;
-                    continue;
-                }
-            }
-            else if (!strncmp(&row->render[cnt], mcs, mcs_len))
-            {
-                memset(&row->highlight[cnt], HL_MLCOMMENT, mcs_len);
-                cnt += mcs_len;
-                in_comment = 1;
-                continue;
-            }
-        }
-
-        if (E.syntax->flags & HL_HIGHLIGHT_STRINGS)
-        {
-            if (in_string)
-            {
-                row->highlight[cnt] = HL_STRING;
-
-                if (c == '\\' && cnt + 1 < row->rowsize)
-                {
-                    row->highlight[cnt + 1] = HL_STRING;
-                    cnt += 2;
-                    continue;
-                }
-
-                if (c == in_string)
-                    in_string = 0;
-                cnt++;
-                prev_separator = 1;
-                continue;
-            }
-            else
-            {
-                if (c == '"' || c == '\'')
-                {
-                    in_string = c;
-                    row->highlight[cnt] = HL_STRING;
-                    cnt++;
-                    continue;
-                }
-            }
-        }
-
-        if (E.syntax->flags & HL_HIGHLIGHT_NUMBERS)
-        {
-            if ((isdigit(c) && (prev_separator || prev_highlight == HL_NUMBER)) || (c == '.' && prev_highlight == HL_NUMBER))
-            {
-                row->highlight[cnt] = HL_NUMBER;
-                cnt++;
-                prev_separator = 0;
-                continue;
-            }
-        }
-
-        if (prev_separator)
-        {
-            int j;
-            for (j = 0; keywords[j]; j++)
-            {
-                int klen = strlen(keywords[j]);
-                int kw2 = keywords[j][klen - 1] == '|';
-
-                if (kw2)
-                    klen--;
-
-                if (!strncmp(&row->render[cnt], keywords[j], klen) &&
-                    isSeparator(row->render[cnt + klen]))
-                {
-                    memset(
-                        &row->highlight[cnt],
-
-                        kw2
-                            ? HL_KEYWORD2
-                            : HL_KEYWORD1,
-
-                        klen);
-
-                    cnt += klen;
-                    break;
-                }
-            }
-            if (keywords[j] != NULL)
-            {
-                prev_separator = 0;
-                continue;
-            }
-        }
-
-        prev_separator = isSeparator(c);
-        cnt++;
-    }
-
-    int changed = (row->highlight_open_comment != in_comment);
-    row->highlight_open_comment = in_comment;
+    for (int cnt = 0; cnt < E.screenrows; cnt++)
+        free(E.screen[cnt].b);
+    free(E.screen);
 
-    if (changed && row->index + 1 < E.numrows)
-        editorUpdateSyntax(&E.row[row->index + 1]);
+    E.screenrows = rows - 2;
+    E.screencols = cols;
+    editorAllocScreen();
 }
 
+/***  syntax highlighting  ***/
+
 int editorSyntaxToColor(int highlight)
 {
     switch (highlight)
@@ -483,335 +502,226 @@ int editorSyntaxToColor(int highlight)
     case HL_MATCH:
         return 32;
 
+    case HL_BRACKET:
+        return 36;
+
     default:
         return 37;
     }
 }
 
-void editorSelectSyntaxHighlight()
+/***  file I/O  ***/
+
+// saves run in the background; typing goes on while they write and the
+// status bar shows how far they got
+void editorSave()
 {
-    E.syntax = NULL;
+    editorContext *ctx = E.ctx;
 
-    if (E.filename == NULL)
+    if (ctx->save)
+    {
+        editorSetStatusMsg("Already saving, wait for it to finish");
         return;
+    }
 
-    char *extension = strchr(E.filename, '.');
-
-    for (unsigned int j = 0; j < HLDB_ENTRIES; j++)
+    if (ctx->filename == NULL)
     {
-        struct editorSyntax *syntax = &HLDB[j];
-        unsigned int i = 0;
-
-        while (syntax->filematch[i])
+        ctx->filename = editorPrompt("Save as: %s\t (esc to cancel)", NULL);
+        if (ctx->filename == NULL)
         {
-            int is_extension = (syntax->filematch[i][0] == '.');
-            if (
-                (is_extension &&
-                 extension &&
-                 !strcmp(
-                     extension,
-                     syntax->filematch[i])) ||
-                (!is_extension &&
-                 strstr(
-                     E.filename,
-                     syntax->filematch[i])))
-            {
-                E.syntax = syntax;
-
-                int filerow;
-                for (filerow = 0; filerow < E.numrows; filerow++)
-                    editorUpdateSyntax(&E.row[filerow]);
-
-                return;
-            }
-            i++;
+            editorSetStatusMsg("Save cancelled successfully!!");
+            return;
         }
+        editorSelectSyntaxHighlight(ctx);
     }
-}
-
-/***  row operations  ***/
-
-int editorRowCxToRx(erow *row, int cx)
-{
-    int rx = 0;
-    int cnt;
 
-    for (cnt = 0; cnt < cx; cnt++)
+    // hex views only write back the pages that were patched
+    if (ctx->hex)
     {
-        if (row->chars[cnt] == '\t')
-            rx += (ASCEND_TAB_STOP - 1) - (rx % ASCEND_TAB_STOP);
-        rx++;
+        int len = editorWriteFile(ctx);
+        if (len != -1)
+            editorSetStatusMsg("%d bytes written to disk", len);
+        else
+            editorSetStatusMsg("Can't save!! i/o error: %s", strerror(errno));
+        return;
     }
-    return rx;
+
+    if (editorSaveStart(ctx) == -1)
+        editorSetStatusMsg("Can't save!! i/o error: %s", strerror(errno));
 }
 
-int editorRowRxToCx(erow *row, int rx)
+// whether any buffer is being saved
+int editorSaving()
 {
-    int curr_rx = 0;
-    int cx;
-
-    for (cx = 0; cx < row->size; cx++)
-    {
-        if (row->chars[cx] == '\t')
-            curr_rx += (ASCEND_TAB_STOP - 1) - (curr_rx % ASCEND_TAB_STOP);
-
-        curr_rx++;
-
-        if (curr_rx > rx)
-            return cx;
-    }
-    return cx;
+    for (int cnt = 0; cnt < E.buffers->numbufs; cnt++)
+        if (E.buffers->bufs[cnt]->save)
+            return 1;
+    return 0;
 }
 
-void editorUpdateRow(erow *row)
+// reports background saves that ended. with `wait` set, blocks until all
+// of them have
+void editorSaveUpdate(int wait)
 {
-    int tabs = 0;
-    int cnt;
-
-    for (cnt = 0; cnt < row->size; cnt++)
-        if (row->chars[cnt] == '\t')
-            tabs++;
-
-    free(row->render);
-    row->render = malloc(row->size + tabs * (ASCEND_TAB_STOP - 1) + 1);
-
-    int index = 0;
-    for (cnt = 0; cnt < row->size; cnt++)
+    for (int cnt = 0; cnt < E.buffers->numbufs; cnt++)
     {
-        if (row->chars[cnt] == '\t')
-        {
-            row->render[index++] = ' ';
-            while (index % ASCEND_TAB_STOP != 0)
-                row->render[index++] = ' ';
-        }
-        else
-            row->render[index++] = row->chars[cnt];
-    }
+        editorContext *ctx = E.buffers->bufs[cnt];
+        long long written;
 
-    row->render[index] = '\0';
-    row->rowsize = index;
+        if (ctx->save == NULL)
+            continue;
 
-    editorUpdateSyntax(row);
+        int result = editorSavePoll(ctx, wait, &written);
+        if (result == 0)
+            editorSetStatusMsg("%lld bytes written to disk", written);
+        else if (result == -1)
+            editorSetStatusMsg("Can't save %.20s!! i/o error: %s", ctx->filename, strerror(errno));
+    }
 }
 
-void editorFreeRow(erow *row)
-{
-    free(row->render);
-    free(row->chars);
-    free(row->highlight);
-}
+/***  buffers  ***/
 
-void editorDeleteRow(int pos)
+int editorAnyDirty()
 {
-    if (pos < 0 || pos >= E.numrows)
-        return;
-
-    editorFreeRow(&E.row[pos]);
-    memmove(&E.row[pos], &E.row[pos + 1], sizeof(erow) * (E.numrows - pos - 1));
-    for (int cnt = pos; cnt < E.numrows - 1; cnt++)
-        E.row[cnt].index--;
-
-    E.numrows--;
-    E.dirty++;
+    for (int cnt = 0; cnt < E.buffers->numbufs; cnt++)
+        if (E.buffers->bufs[cnt]->dirty)
+            return 1;
+    return 0;
 }
 
-void editorInsertRow(int pos, char *s, size_t len)
+void editorSwitchBuffer(int index)
 {
-    if (pos < 0 || pos > E.numrows)
-        return;
-
-    E.row = realloc(E.row, sizeof(erow) * (E.numrows + 1));
-    memmove(&E.row[pos + 1], &E.row[pos], sizeof(erow) * (E.numrows - pos));
-    for (int cnt = pos + 1; cnt <= E.numrows; cnt++)
-        E.row[cnt].index++;
-
-    E.row[pos].index = pos;
-
-    E.row[pos].size = len;
-    E.row[pos].chars = malloc(len + 1);
-    memcpy(E.row[pos].chars, s, len);
-    E.row[pos].chars[len] = '\0';
+    int prev = E.buffers->current;
+    if (prev != -1)
+    {
+        E.views[prev].rowoffset = E.rowoffset;
+        E.views[prev].coloffset = E.coloffset;
+        E.views[prev].lineoffset = E.lineoffset;
+    }
 
-    E.row[pos].rowsize = 0;
-    E.row[pos].render = NULL;
-    E.row[pos].highlight = NULL;
-    E.row[pos].highlight_open_comment = 0;
-    editorUpdateRow(&E.row[pos]);
+    editorContext *ctx = editorBufferSwitch(E.buffers, index);
+    if (ctx == NULL)
+        return;
 
-    E.numrows++;
-    E.dirty++;
+    E.ctx = ctx;
+    E.ctx->stats.enabled = E.hud;
+    E.rowoffset = E.views[index].rowoffset;
+    E.coloffset = E.views[index].coloffset;
+    E.lineoffset = E.views[index].lineoffset;
 }
 
-void editorRowDeleteChar(erow *row, int pos)
+// load progress callback, repaints at most ten times a second
+void editorShowProgress(editorContext *ctx, long long done, long long total)
 {
-    if (pos < 0 || pos > row->size)
+    long long now = editorClockNs();
+    if (now - E.progress_ns < 100000000LL)
         return;
-    memmove(&row->chars[pos], &row->chars[pos + 1], row->size - pos);
-    row->size--;
-    editorUpdateRow(row);
-    E.dirty++;
-}
-
-void editorRowInsertChar(erow *row, int at, int c)
-{
-    if (at < 0 || at > row->size)
-        at = row->size;
+    E.progress_ns = now;
 
-    row->chars = realloc(row->chars, row->size + 2);
-    memmove(&row->chars[at + 1], &row->chars[at], row->size - at + 1);
-    row->size++;
-    row->chars[at] = c;
-    editorUpdateRow(row);
-    E.dirty++;
+    editorSetStatusMsg("Loading %.20s: %d%% (%d lines)",
+                       ctx->filename,
+                       total > 0 ? (int)(done * 100 / total) : 0,
+                       ctx->numrows);
+    editorRefreshScreen();
 }
 
-void editorRowAppendString(erow *row, char *str, size_t len)
-{
-    row->chars = realloc(row->chars, row->size + len + 1);
-    memcpy(&row->chars[row->size], str, len);
-    row->size += len;
-    row->chars[row->size] = '\0';
-    editorUpdateRow(row);
-    E.dirty++;
-}
-
-/***  editor operations  ***/
-
-void editorInsertChar(int c)
+// adds a fresh context to the buffer list, returns its index or -1
+int editorNewBuffer(editorContext *ctx)
 {
-    if (E.cy == E.numrows)
-        editorInsertRow(E.numrows, "", 0);
+    struct editorView *views = realloc(E.views, sizeof(struct editorView) * (E.buffers->numbufs + 1));
+    if (views == NULL)
+        return -1;
+    E.views = views;
 
-    editorRowInsertChar(&E.row[E.cy], E.cx, c);
-    E.cx++;
-}
+    int index = editorBufferAdd(E.buffers, ctx);
+    if (index == -1)
+        return -1;
 
-void editorinsertNewLine()
-{
-    if (E.cx == 0)
-        editorInsertRow(E.cy, "", 0);
-    else
-    {
-        erow *row = &E.row[E.cy];
-        editorInsertRow(E.cy + 1, &row->chars[E.cx], row->size - E.cx);
-        row = &E.row[E.cy];
-        row->size = E.cx;
-        row->chars[row->size] = '\0';
-        editorUpdateRow(row);
-    }
-    E.cy++;
-    E.cx = 0;
+    E.views[index].rowoffset = 0;
+    E.views[index].coloffset = 0;
+    E.views[index].lineoffset = 0;
+    ctx->progress = editorShowProgress;
+    return index;
 }
 
-void editorDeleteChar()
+void editorOpenBuffer()
 {
-    if (E.cy == E.numrows)
-        return;
-    if (E.cx == 0 && E.cy == 0)
+    char *filename = editorPrompt("Open: %s\t (esc to cancel)", NULL);
+    if (filename == NULL)
         return;
 
-    erow *row = &E.row[E.cy];
-    if (E.cx > 0)
+    int index = editorBufferFind(E.buffers, filename);
+    if (index != -1)
     {
-        editorRowDeleteChar(row, E.cx - 1);
-        E.cx--;
+        free(filename);
+        editorSwitchBuffer(index);
+        return;
     }
-    else
+
+    // reuse the untouched scratch buffer ascend starts with
+    if (E.ctx->filename == NULL && E.ctx->numrows == 0 && !E.ctx->dirty)
     {
-        E.cx = E.row[E.cy - 1].size;
-        editorRowAppendString(&E.row[E.cy - 1], row->chars, row->size);
-        editorDeleteRow(E.cy);
-        E.cy--;
+        if (editorOpen(E.ctx, filename) == -1)
+            editorSetStatusMsg("Can't open %s: %s", filename, strerror(errno));
+        free(filename);
+        editorBufferEnforceBudget(E.buffers);
+        return;
     }
-}
-
-/***  file I/O  ***/
-
-char *editorRowsToString(int *buffrlen)
-{
-    int totlen = 0;
-    int cnt;
-    for (cnt = 0; cnt < E.numrows; cnt++)
-        totlen += E.row[cnt].size + 1;
-    *buffrlen = totlen;
 
-    char *buffer = malloc(totlen);
-    char *ptr = buffer;
-
-    for (cnt = 0; cnt < E.numrows; cnt++)
+    editorContext *ctx = editorContextNew();
+    if (ctx)
+        ctx->progress = editorShowProgress;
+    if (ctx == NULL || editorOpen(ctx, filename) == -1)
     {
-        memcpy(ptr, E.row[cnt].chars, E.row[cnt].size);
-        ptr += E.row[cnt].size;
-        *ptr = '\n';
-        ptr++;
+        editorSetStatusMsg("Can't open %s: %s", filename, strerror(errno));
+        editorContextFree(ctx);
+        free(filename);
+        return;
     }
-    return buffer;
-}
-
-void editorOpen(char *filename)
-{
-    // status bar filename
-    free(E.filename);
-    E.filename = strdup(filename);
-
-    editorSelectSyntaxHighlight();
+    free(filename);
 
-    FILE *fp = fopen(filename, "r");
-    if (!fp)
-        errhandl("fopen");
-
-    char *line = NULL;
-    ssize_t linelen;
-    size_t linecap = 0;
-    while ((linelen = getline(&line, &linecap, fp)) != -1)
+    index = editorNewBuffer(ctx);
+    if (index == -1)
     {
-
-        while (linelen > 0 && (line[linelen - 1] == '\n' || line[linelen - 1] == '\r'))
-            linelen--;
-        editorInsertRow(E.numrows, line, linelen);
+        editorContextFree(ctx);
+        editorSetStatusMsg("Can't open buffer: out of memory");
+        return;
     }
-    free(line);
-    fclose(fp);
-    E.dirty = 0;
+    editorSwitchBuffer(index);
 }
 
-void editorSave()
+/***  follow  ***/
+
+void editorFollowUpdate()
 {
-    if (E.filename == NULL)
+    for (int cnt = 0; cnt < E.buffers->numbufs; cnt++)
     {
-        E.filename = editorPrompt("Save as: %s\t (esc to cancel)", NULL);
-        if (E.filename == NULL)
-        {
-            editorSetStatusMsg("Save cancelled successfully!!");
-            return;
-        }
-        editorSelectSyntaxHighlight();
-    }
+        editorContext *ctx = E.buffers->bufs[cnt];
+        if (ctx->follow == NULL)
+            continue;
 
-    int len;
-    char *buffer = editorRowsToString(&len);
+        // keep tailing only if the cursor was already at the end
+        int at_end = ctx->cy >= ctx->numrows - 1;
 
-    int fdefine = open(E.filename, O_RDWR | O_CREAT, 0644);
+        if (editorFollowPoll(ctx) == -1)
+        {
+            editorSetStatusMsg("Stopped following %s: %s", ctx->filename, strerror(errno));
+            editorFollowStop(ctx);
+            continue;
+        }
 
-    if (fdefine != -1)
-    {
+        if (ctx->follow->truncated)
+        {
+            editorSetStatusMsg("%s was truncated or rotated, following from its start", ctx->filename);
+            ctx->follow->truncated = 0;
+        }
 
-        if (ftruncate(fdefine, len) != -1)
+        if (at_end && ctx->numrows > 0)
         {
-            if (write(fdefine, buffer, len) == len)
-            {
-                close(fdefine);
-                free(buffer);
-                E.dirty = 0;
-                editorSetStatusMsg("%d bytes written to disk", len);
-                return;
-            }
+            ctx->cy = ctx->numrows - 1;
+            ctx->cx = 0;
         }
-        close(fdefine);
     }
-
-    free(buffer);
-    editorSetStatusMsg("Can't save!! i/o error: %s", strerror(errno));
 }
 
 /***  search  ***/
@@ -819,20 +729,31 @@ void editorFindCallback(char *query, int key)
 {
     static int last_match = -1;
     static int direction = 1;
-    static int saved_highlight_line;
-    static char *saved_highlight = NULL;
 
-    if (saved_highlight)
+    // a replaying macro skips the search-as-you-type and looks forward
+    // from the cursor once the query is complete. no wrapping around, so
+    // repeating it ends at the last match, which also ends the replay
+    if (E.macro.replaying)
     {
-        memcpy(E.row[saved_highlight_line].highlight, saved_highlight, E.row[saved_highlight_line].rowsize);
-        free(saved_highlight);
-        saved_highlight = NULL;
+        int match_cx;
+        int row = (key == '\r')
+                      ? editorFindForward(E.ctx, query, E.ctx->cy, E.ctx->cx + 1, &match_cx)
+                      : -2;
+        if (row == -1)
+            E.macro.failed = 1;
+        else if (row >= 0)
+        {
+            E.ctx->cy = row;
+            E.ctx->cx = match_cx;
+        }
+        return;
     }
 
     if (key == '\r' || key == '\x1b')
     {
         last_match = -1;
         direction = -1;
+        editorSetSearch(E.ctx, NULL);
         return;
     }
     else if (key == ARROW_RIGHT || key == ARROW_DOWN)
@@ -847,44 +768,34 @@ void editorFindCallback(char *query, int key)
         direction = -1;
     }
 
+    // a new query is looked for from the cursor's row on
+    int from = last_match;
     if (last_match == -1)
+    {
         direction = 1;
+        from = E.ctx->cy - 1;
+    }
 
-    int current = last_match;
-    int cnt;
+    // every match on screen is drawn highlighted while the prompt is open
+    editorSetSearch(E.ctx, query);
 
-    for (cnt = 0; cnt < E.numrows; cnt++)
+    int match_rx;
+    int current = editorFindRow(E.ctx, query, from, direction, &match_rx);
+    if (current != -1)
     {
-        current += direction;
-
-        if (current == -1)
-            current = E.numrows - 1;
-        else if (current == E.numrows)
-            current = 0;
-
-        erow *row = &E.row[current];
-        char *match = strstr(row->render, query);
-        if (match)
-        {
-            last_match = current;
-            E.cy = current;
-            E.cx = editorRowRxToCx(row, match - row->render);
-            E.rowoffset = E.numrows;
-
-            saved_highlight_line = current;
-            saved_highlight = malloc(row->rowsize);
-            memcpy(saved_highlight, row->highlight, row->rowsize);
+        erow *row = &E.ctx->row[current];
 
-            memset(&row->highlight[match - row->render], HL_MATCH, strlen(query));
-            break;
-        }
+        last_match = current;
+        E.ctx->cy = current;
+        E.ctx->cx = editorRowRenderToCx(row, match_rx);
+        E.rowoffset = E.ctx->numrows;
     }
 }
 
 void editorFind()
 {
-    int saved_cx = E.cx;
-    int saved_cy = E.cy;
+    int saved_cx = E.ctx->cx;
+    int saved_cy = E.ctx->cy;
     int saved_coloffset = E.coloffset;
     int saved_rowoffset = E.rowoffset;
 
@@ -894,57 +805,1039 @@ void editorFind()
         free(query);
     else
     {
-        E.cx = saved_cx;
-        E.cy = saved_cy;
+        E.ctx->cx = saved_cx;
+        E.ctx->cy = saved_cy;
         E.coloffset = saved_coloffset;
         E.rowoffset = saved_rowoffset;
     }
 }
 
-/***  append buffer  ***/
-struct abuf
+void editorReplace()
 {
-    char *b;
-    int len;
-};
+    char *query = editorPrompt("Replace: %s\t(ESC to cancel)", NULL);
+    if (query == NULL)
+        return;
 
-#define ABUF_INIT \
-    {             \
-        NULL, 0   \
+    char *replacement = editorPrompt("Replace with: %s\t(ESC to cancel)", NULL);
+    if (replacement == NULL)
+    {
+        free(query);
+        return;
     }
 
-void abAppend(struct abuf *ab, const char *s, int len)
-{
-    char *new = realloc(ab->b, ab->len + len);
+    long long start = editorClockNs();
+    long long count = editorReplaceAll(E.ctx, query, replacement);
+    long long end = editorClockNs();
 
-    if (new == NULL)
+    if (count == -1)
+        editorSetStatusMsg("Replace failed: %s", strerror(errno));
+    else
+        editorSetStatusMsg("Replaced %lld occurrence%s of \"%.20s\" in %.1fms",
+                           count, count == 1 ? "" : "s", query, (end - start) / 1e6);
+
+    // the cursor's row may have shrunk or had a character rewritten under it
+    if (E.ctx->cy < E.ctx->numrows)
+    {
+        erow *row = &E.ctx->row[E.ctx->cy];
+        if (E.ctx->cx > row->size)
+            E.ctx->cx = row->size;
+        E.ctx->cx = editorRowRxToCx(row, editorRowCxToRx(row, E.ctx->cx));
+    }
+
+    free(query);
+    free(replacement);
+}
+
+// "N" jumps to line N, "@N" to byte offset N. both accept 0x for hex.
+void editorGoto()
+{
+    char *target = editorPrompt(E.ctx->hex
+                                    ? "Goto offset: %s\t(ESC to cancel)"
+                                    : "Goto line (or @byte offset): %s\t(ESC to cancel)",
+                                NULL);
+    if (target == NULL)
+        return;
+
+    int is_offset = (target[0] == '@');
+    char *num = target + is_offset;
+    char *end;
+    long long value = strtoll(num, &end, (num[0] == '0' && (num[1] == 'x' || num[1] == 'X')) ? 16 : 10);
+
+    // hex views only have offsets, and nothing to load to reach one
+    if (E.ctx->hex && end != num && *end == '\0' && value >= 0 && value < E.ctx->hex->size)
+    {
+        E.ctx->hex->cursor = value;
+        E.ctx->hex->nibble = 0;
+        E.lineoffset = value / ASCEND_HEX_WIDTH - E.screenrows / 2;
+        if (E.lineoffset < 0)
+            E.lineoffset = 0;
+        free(target);
+        return;
+    }
+
+    if (end == num || *end != '\0' || value < 0 || E.ctx->numrows == 0)
+        editorSetStatusMsg("Can't go to \"%.20s\"", target);
+    else if (is_offset)
+    {
+        int row = editorOffsetToRow(E.ctx, value);
+        if (row == -1)
+        {
+            editorSetStatusMsg("Can't go to \"%.20s\": %s", target, strerror(errno));
+            free(target);
+            return;
+        }
+        long long cx = value - editorRowOffset(E.ctx, row);
+        erow *r = &E.ctx->row[row];
+
+        if (cx > r->size)
+            cx = r->size;
+        editorRowEnsureDerived(E.ctx, r);
+        E.ctx->cy = row;
+        E.ctx->cx = editorRowRxToCx(r, editorRowCxToRx(r, cx));
+    }
+    else
+    {
+        E.ctx->cy = (value < 1)
+                        ? 0
+                        : (value > E.ctx->numrows)
+                              ? E.ctx->numrows - 1
+                              : value - 1;
+        E.ctx->cx = 0;
+    }
+
+    // put the target in the middle of the screen
+    E.rowoffset = E.ctx->cy - E.screenrows / 2;
+    if (E.rowoffset < 0)
+        E.rowoffset = 0;
+
+    free(target);
+}
+
+/***  folding  ***/
+
+// folds the block or comment at the cursor, or opens the fold it heads
+void editorToggleFold()
+{
+    if (E.ctx->hex || E.ctx->cy >= E.ctx->numrows)
+        return;
+
+    int header = editorFoldToggle(E.ctx, E.ctx->cy);
+    if (header == -1)
+    {
+        editorSetStatusMsg("Nothing to fold here");
+        return;
+    }
+
+    // the cursor was inside the block it just hid
+    if (header != E.ctx->cy)
+    {
+        E.ctx->cy = header;
+        E.ctx->cx = 0;
+    }
+
+    int hidden = editorFoldedRows(E.ctx, header);
+    if (hidden)
+        editorSetStatusMsg("Folded %d line%s", hidden, hidden == 1 ? "" : "s");
+    else
+        editorSetStatusMsg("Unfolded");
+}
+
+/***  brackets  ***/
+
+// looks up the bracket matching the one under the cursor for drawing.
+// the nesting index skips whole blocks of rows and only sums again the
+// blocks edits touched, so this is cheap enough to run on every frame
+void editorFindBracketPartner()
+{
+    int cx;
+
+    E.bracket_row = -1;
+    if (E.ctx->hex || E.diff)
+        return;
+
+    int row = editorMatchBracket(E.ctx, E.ctx->cy, E.ctx->cx, &cx);
+    if (row == -1)
+        return;
+    E.bracket_row = row;
+    E.bracket_offset = editorRowCxToRender(&E.ctx->row[row], cx);
+}
+
+void editorJumpToBracket()
+{
+    int cx;
+
+    if (E.ctx->hex)
+        return;
+
+    int row = editorMatchBracket(E.ctx, E.ctx->cy, E.ctx->cx, &cx);
+    if (row == -1)
+    {
+        editorSetStatusMsg("No matching bracket");
+        return;
+    }
+    E.ctx->cy = row;
+    E.ctx->cx = cx;
+}
+
+/***  selection  ***/
+
+// the selection in buffer order, or 0 when nothing is selected
+int editorSelection(int *cy0, int *cx0, int *cy1, int *cx1)
+{
+    if (!E.sel_active || (E.sel_cy == E.ctx->cy && E.sel_cx == E.ctx->cx))
+        return 0;
+
+    if (E.sel_cy < E.ctx->cy || (E.sel_cy == E.ctx->cy && E.sel_cx < E.ctx->cx))
+    {
+        *cy0 = E.sel_cy;
+        *cx0 = E.sel_cx;
+        *cy1 = E.ctx->cy;
+        *cx1 = E.ctx->cx;
+    }
+    else
+    {
+        *cy0 = E.ctx->cy;
+        *cx0 = E.ctx->cx;
+        *cy1 = E.sel_cy;
+        *cx1 = E.sel_cx;
+    }
+    return 1;
+}
+
+// render columns of `row` covered by the selection, as [*from, *to)
+int editorSelectionColumns(erow *row, int *from, int *to)
+{
+    int cy0, cx0, cy1, cx1;
+    if (!editorSelection(&cy0, &cx0, &cy1, &cx1) || row->index < cy0 || row->index > cy1)
+        return 0;
+
+    *from = (row->index == cy0)
+                ? editorRowCxToRx(row, cx0)
+                : 0;
+    *to = (row->index == cy1)
+              ? editorRowCxToRx(row, cx1)
+              : row->width + 1;
+    return *from < *to;
+}
+
+// deletes the selected text, returning whether there was any
+int editorDeleteSelection()
+{
+    int cy0, cx0, cy1, cx1;
+    if (!editorSelection(&cy0, &cx0, &cy1, &cx1))
+        return 0;
+
+    editorDeleteRange(E.ctx, cy0, cx0, cy1, cx1);
+    E.ctx->cy = cy0;
+    E.ctx->cx = cx0;
+    E.sel_active = 0;
+    return 1;
+}
+
+// copies the selection, or the current line when nothing is selected, to
+// the clipboard and removes it from the buffer when cutting
+void editorCopy(int cut)
+{
+    int cy0, cx0, cy1, cx1;
+    if (!editorSelection(&cy0, &cx0, &cy1, &cx1))
+    {
+        if (E.ctx->cy >= E.ctx->numrows)
+            return;
+        cy0 = E.ctx->cy;
+        cx0 = 0;
+        cy1 = cy0 + 1;
+        cx1 = 0;
+    }
+
+    size_t len;
+    char *text = editorCopyRange(E.ctx, cy0, cx0, cy1, cx1, &len);
+    if (text == NULL)
+    {
+        editorSetStatusMsg("Can't copy: out of memory");
+        return;
+    }
+    free(E.clipboard);
+    E.clipboard = text;
+    E.clipboard_len = len;
+
+    if (cut)
+    {
+        editorDeleteRange(E.ctx, cy0, cx0, cy1, cx1);
+        E.ctx->cy = cy0;
+        E.ctx->cx = cx0;
+        E.sel_active = 0;
+    }
+    editorSetStatusMsg("%s %zu bytes", cut ? "Cut" : "Copied", len);
+}
+
+// inserts text at the cursor in one operation, replacing the selection
+void editorPasteText(const char *text, size_t len)
+{
+    int cy, cx;
+
+    editorDeleteSelection();
+    if (editorInsertText(E.ctx, E.ctx->cy, E.ctx->cx, text, len, &cy, &cx) == -1)
+    {
+        editorSetStatusMsg("Can't paste: %s", strerror(errno));
+        return;
+    }
+    E.ctx->cy = cy;
+    E.ctx->cx = cx;
+}
+
+// collects a bracketed paste up to its end marker so it can be inserted
+// in one piece instead of one keystroke at a time
+void editorReadPaste()
+{
+    static const char end[] = "\x1b[201~";
+    size_t cap = 4096;
+    size_t len = 0;
+    char *buf = malloc(cap);
+    char c;
+
+    if (buf == NULL)
+        return;
+
+    // a replayed paste is its length followed by the bytes
+    if (E.macro.replaying)
+    {
+        size_t total = editorNextKey();
+        char *text = realloc(buf, total + 1);
+        if (text == NULL)
+        {
+            free(buf);
+            return;
+        }
+        for (size_t cnt = 0; cnt < total; cnt++)
+            text[cnt] = editorNextKey();
+        editorPasteText(text, total);
+        free(text);
+        return;
+    }
+
+    while (read(STDIN_FILENO, &c, 1) == 1)
+    {
+        if (len == cap)
+        {
+            char *grown = realloc(buf, cap * 2);
+            if (grown == NULL)
+                break;
+            buf = grown;
+            cap *= 2;
+        }
+        buf[len++] = c;
+
+        if (len >= sizeof(end) - 1 && !memcmp(&buf[len - (sizeof(end) - 1)], end, sizeof(end) - 1))
+        {
+            len -= sizeof(end) - 1;
+            break;
+        }
+    }
+
+    // terminals send newlines in pastes as \r
+    size_t out = 0;
+    for (size_t cnt = 0; cnt < len; cnt++)
+    {
+        if (buf[cnt] == '\r')
+        {
+            buf[out++] = '\n';
+            if (cnt + 1 < len && buf[cnt + 1] == '\n')
+                cnt++;
+        }
+        else
+            buf[out++] = buf[cnt];
+    }
+
+    if (E.macro.recording)
+    {
+        editorMacroRecord(PASTE_START);
+        editorMacroRecord(out);
+        for (size_t cnt = 0; cnt < out; cnt++)
+            editorMacroRecord((unsigned char)buf[cnt]);
+    }
+
+    editorPasteText(buf, out);
+    free(buf);
+}
+
+// indents (or with a negative direction dedents) the selected rows, or the
+// current row when nothing is selected
+void editorIndent(int direction)
+{
+    int cy0, cx0, cy1, cx1;
+    if (!editorSelection(&cy0, &cx0, &cy1, &cx1))
+        cy0 = cy1 = E.ctx->cy;
+    else if (cx1 == 0 && cy1 > cy0)
+        cy1--;
+
+    editorIndentRows(E.ctx, cy0, cy1, direction);
+
+    if (E.ctx->cy < E.ctx->numrows && E.ctx->cx > E.ctx->row[E.ctx->cy].size)
+        E.ctx->cx = E.ctx->row[E.ctx->cy].size;
+    if (E.sel_cy < E.ctx->numrows && E.sel_cx > E.ctx->row[E.sel_cy].size)
+        E.sel_cx = E.ctx->row[E.sel_cy].size;
+}
+
+// sorts the selected rows, or the whole buffer when nothing is selected.
+// the prompt takes any of s (sort), r (reverse) and u (drop repeats)
+void editorSortLines()
+{
+    if (E.ctx->hex || E.ctx->numrows == 0)
+    {
+        editorSetStatusMsg("Nothing to sort");
+        return;
+    }
+
+    char *answer = editorPrompt("Sort lines: %s (s = sort, r = reverse, u = unique, ESC to cancel)", NULL);
+    if (answer == NULL)
+        return;
+
+    int flags = 0;
+    for (char *p = answer; *p; p++)
+    {
+        if (*p == 'r')
+            flags |= SORT_REVERSE;
+        else if (*p == 'u')
+            flags |= SORT_UNIQUE;
+        else if (*p != 's')
+        {
+            editorSetStatusMsg("Can't sort by \"%.20s\"", answer);
+            free(answer);
+            return;
+        }
+    }
+    free(answer);
+
+    int cy0, cx0, cy1, cx1;
+    if (!editorSelection(&cy0, &cx0, &cy1, &cx1))
+    {
+        cy0 = 0;
+        cy1 = E.ctx->numrows - 1;
+    }
+    else if (cx1 == 0 && cy1 > cy0)
+        cy1--;
+
+    int removed = editorSortRows(E.ctx, cy0, cy1, flags);
+    if (removed == -1)
+    {
+        editorSetStatusMsg("Can't sort: %s", strerror(errno));
+        return;
+    }
+
+    E.sel_active = 0;
+    E.ctx->cy = cy0;
+    E.ctx->cx = 0;
+    if (removed)
+        editorSetStatusMsg("Sorted %d lines, kept %d unique", cy1 - cy0 + 1, cy1 - cy0 + 1 - removed);
+    else
+        editorSetStatusMsg("Sorted %d lines", cy1 - cy0 + 1);
+}
+
+// shift+movement keys grow the selection from where it started
+void editorExtendSelection(int key)
+{
+    if (!E.sel_active)
+    {
+        E.sel_active = 1;
+        E.sel_cy = E.ctx->cy;
+        E.sel_cx = E.ctx->cx;
+    }
+
+    switch (key)
+    {
+    case SHIFT_ARROW_LEFT:
+        editorMoveCursor(ARROW_LEFT);
+        break;
+    case SHIFT_ARROW_RIGHT:
+        editorMoveCursor(ARROW_RIGHT);
+        break;
+    case SHIFT_ARROW_UP:
+        editorMoveCursor(ARROW_UP);
+        break;
+    case SHIFT_ARROW_DOWN:
+        editorMoveCursor(ARROW_DOWN);
+        break;
+    case SHIFT_HOME:
+        E.ctx->cx = 0;
+        break;
+    case SHIFT_END:
+        if (E.ctx->cy < E.ctx->numrows)
+            E.ctx->cx = E.ctx->row[E.ctx->cy].size;
+        break;
+    }
+}
+
+/***  append buffer  ***/
+struct abuf
+{
+    char *b;
+    int len;
+};
+
+#define ABUF_INIT \
+    {             \
+        NULL, 0   \
+    }
+
+void abAppend(struct abuf *ab, const char *s, int len)
+{
+    char *new = realloc(ab->b, ab->len + len);
+
+    if (new == NULL)
+        return;
+
+    memcpy(&new[ab->len], s, len);
+    ab->b = new;
+    ab->len += len;
+}
+
+void abFree(struct abuf *ab)
+{
+    free(ab->b);
+}
+
+/***  hex view  ***/
+
+// hex digits of the offset column, enough for the last offset
+int editorHexOffsetDigits()
+{
+    int digits = 8;
+    while (digits < 16 && (E.ctx->hex->size - 1) >> (digits * 4) > 0)
+        digits++;
+    return digits;
+}
+
+// screen column of the nibble under the cursor
+int editorHexCursorColumn()
+{
+    struct editorHexView *hv = E.ctx->hex;
+    int byte = hv->cursor % ASCEND_HEX_WIDTH;
+    return editorHexOffsetDigits() + 2 + byte * 3 + (byte >= ASCEND_HEX_WIDTH / 2) + hv->nibble;
+}
+
+// one line of the view: the offset, the bytes in hex, and the bytes as
+// text with anything unprintable shown as a dot. bytes are read straight
+// from the mapping.
+void editorDrawHexRow(struct abuf *ab, long long offset)
+{
+    struct editorHexView *hv = E.ctx->hex;
+    char buf[32];
+    int len;
+    int cnt;
+
+    if (offset >= hv->size && offset > 0)
+    {
+        abAppend(ab, "~", 1);
+        return;
+    }
+
+    len = snprintf(buf, sizeof(buf), "%0*llx  ", editorHexOffsetDigits(), offset);
+    abAppend(ab, buf, len);
+
+    for (cnt = 0; cnt < ASCEND_HEX_WIDTH; cnt++)
+    {
+        if (cnt == ASCEND_HEX_WIDTH / 2)
+            abAppend(ab, " ", 1);
+        if (offset + cnt < hv->size)
+        {
+            len = snprintf(buf, sizeof(buf), "%02x ", hv->data[offset + cnt]);
+            abAppend(ab, buf, len);
+        }
+        else
+            abAppend(ab, "   ", 3);
+    }
+
+    abAppend(ab, " |", 2);
+    for (cnt = 0; cnt < ASCEND_HEX_WIDTH && offset + cnt < hv->size; cnt++)
+    {
+        unsigned char c = hv->data[offset + cnt];
+        char sym = (c >= 0x20 && c < 0x7f)
+                       ? (char)c
+                       : '.';
+        abAppend(ab, &sym, 1);
+    }
+    abAppend(ab, "|", 1);
+
+    if (ab->len > E.screencols)
+        ab->len = E.screencols;
+}
+
+// moves the cursor and types hex digits over the bytes. keys that make no
+// sense without rows are swallowed; returns 0 for the ones the normal
+// handler should see (quit, save, goto, buffers, stats, macros).
+int editorHexProcessKey(int c)
+{
+    struct editorHexView *hv = E.ctx->hex;
+    long long move = 0;
+
+    switch (c)
+    {
+    case ARROW_LEFT:
+        move = -1;
+        break;
+    case ARROW_RIGHT:
+        move = 1;
+        break;
+    case ARROW_UP:
+        move = -ASCEND_HEX_WIDTH;
+        break;
+    case ARROW_DOWN:
+        move = ASCEND_HEX_WIDTH;
+        break;
+    case PAGE_UP:
+        move = -(long long)ASCEND_HEX_WIDTH * E.screenrows;
+        break;
+    case PAGE_DOWN:
+        move = (long long)ASCEND_HEX_WIDTH * E.screenrows;
+        break;
+    case HOME_KEY:
+        move = -(hv->cursor % ASCEND_HEX_WIDTH);
+        break;
+    case END_KEY:
+        move = ASCEND_HEX_WIDTH - 1 - hv->cursor % ASCEND_HEX_WIDTH;
+        break;
+
+    case CTRL_KEY('q'):
+    case CTRL_KEY('s'):
+    case CTRL_KEY('g'):
+    case CTRL_KEY('o'):
+    case CTRL_KEY('n'):
+    case CTRL_KEY('p'):
+    case CTRL_KEY('t'):
+    case CTRL_KEY('k'):
+    case CTRL_KEY('b'):
+    case CTRL_KEY('e'):
+    case FOLLOW_UPDATE:
+    case SAVE_UPDATE:
+    case TERMINAL_RESIZE:
+        return 0;
+
+    default:
+        if (c < 128 && isxdigit(c))
+        {
+            int digit = isdigit(c)
+                            ? c - '0'
+                            : tolower(c) - 'a' + 10;
+            unsigned char byte = hv->cursor < hv->size
+                                     ? hv->data[hv->cursor]
+                                     : 0;
+            byte = hv->nibble
+                       ? (byte & 0xf0) | digit
+                       : (byte & 0x0f) | (digit << 4);
+
+            if (editorHexPatch(E.ctx, hv->cursor, byte) == -1)
+                editorSetStatusMsg("Can't patch: %s", strerror(errno));
+            else if (!hv->nibble)
+                hv->nibble = 1;
+            else
+            {
+                hv->nibble = 0;
+                if (hv->cursor + 1 < hv->size)
+                    hv->cursor++;
+            }
+        }
+        return 1;
+    }
+
+    hv->cursor += move;
+    if (hv->cursor >= hv->size)
+        hv->cursor = hv->size - 1;
+    if (hv->cursor < 0)
+        hv->cursor = 0;
+    hv->nibble = 0;
+    return 1;
+}
+
+/***  diff view  ***/
+
+void editorCloseDiff()
+{
+    if (E.diff == NULL)
+        return;
+    editorDiffFree(&E.diff->diff);
+    free(E.diff->line);
+    free(E.diff);
+    E.diff = NULL;
+}
+
+// lays the hunks out as view lines: a header, a few unchanged rows before,
+// the removed and added lines, and a few unchanged rows after. context is
+// not repeated when hunks are close together.
+int editorDiffLayout(struct editorDiffView *view)
+{
+    struct editorDiff *diff = &view->diff;
+    size_t cap = 0;
+    for (int cnt = 0; cnt < diff->count; cnt++)
+        cap += 1 + 2 * ASCEND_DIFF_CONTEXT + diff->hunk[cnt].old_count + diff->hunk[cnt].new_count;
+
+    view->line = malloc(sizeof(struct editorDiffLine) * cap);
+    if (view->line == NULL)
+        return -1;
+
+    struct editorDiffLine *out = view->line;
+    int shown = 0; // rows before this have been shown
+    for (int cnt = 0; cnt < diff->count; cnt++)
+    {
+        struct editorDiffHunk *hunk = &diff->hunk[cnt];
+        int from = hunk->new_start - ASCEND_DIFF_CONTEXT;
+        if (from < shown)
+            from = shown;
+
+        *out++ = (struct editorDiffLine){'@', cnt};
+        for (int row = from; row < hunk->new_start; row++)
+            *out++ = (struct editorDiffLine){' ', row};
+        for (int line = 0; line < hunk->old_count; line++)
+            *out++ = (struct editorDiffLine){'-', hunk->old_start + line};
+        for (int row = 0; row < hunk->new_count; row++)
+            *out++ = (struct editorDiffLine){'+', hunk->new_start + row};
+
+        int end = hunk->new_start + hunk->new_count;
+        int to = end + ASCEND_DIFF_CONTEXT;
+        if (to > E.ctx->numrows)
+            to = E.ctx->numrows;
+        if (cnt + 1 < diff->count && to > diff->hunk[cnt + 1].new_start)
+            to = diff->hunk[cnt + 1].new_start;
+        for (int row = end; row < to; row++)
+            *out++ = (struct editorDiffLine){' ', row};
+        shown = to;
+    }
+    view->len = out - view->line;
+    return 0;
+}
+
+// diffs the buffer against its file and shows the hunks in place of the
+// rows until the view is closed
+void editorOpenDiff()
+{
+    if (E.ctx->hex)
+    {
+        editorSetStatusMsg("Hex views have no lines to diff");
+        return;
+    }
+    if (E.ctx->filename == NULL)
+    {
+        editorSetStatusMsg("Nothing saved to diff against");
+        return;
+    }
+
+    struct editorDiffView *view = calloc(1, sizeof(*view));
+    if (view == NULL)
+        return;
+
+    if (editorDiffFile(E.ctx, &view->diff) == -1)
+    {
+        editorSetStatusMsg("Can't diff: %s", strerror(errno));
+        free(view);
+        return;
+    }
+    if (view->diff.count == 0)
+    {
+        editorSetStatusMsg("No changes since the last save");
+        editorDiffFree(&view->diff);
+        free(view);
+        return;
+    }
+    if (editorDiffLayout(view) == -1)
+    {
+        editorSetStatusMsg("Can't diff: %s", strerror(ENOMEM));
+        editorDiffFree(&view->diff);
+        free(view);
         return;
+    }
 
-    memcpy(&new[ab->len], s, len);
-    ab->b = new;
-    ab->len += len;
+    int removed = 0, added = 0;
+    for (int cnt = 0; cnt < view->diff.count; cnt++)
+    {
+        removed += view->diff.hunk[cnt].old_count;
+        added += view->diff.hunk[cnt].new_count;
+    }
+
+    E.diff = view;
+    editorSetStatusMsg("%d hunk%s, -%d +%d | n/p: hunks, Enter: go to line, Esc: close",
+                       view->diff.count, view->diff.count == 1 ? "" : "s", removed, added);
 }
 
-void abFree(struct abuf *ab)
+// appends `len` bytes of line text, tabs expanded and control characters
+// shown as ?, until `cols` screen columns are used
+void editorDiffAppendText(struct abuf *ab, const char *s, int len, int cols)
 {
-    free(ab->b);
+    int col = 0;
+    for (int cnt = 0; cnt < len && col < cols; cnt++)
+    {
+        unsigned char c = s[cnt];
+        if (c == '\t')
+        {
+            do
+                abAppend(ab, " ", 1);
+            while (++col % ASCEND_TAB_STOP != 0 && col < cols);
+            continue;
+        }
+
+        if (c < 0x20 || c == 0x7f)
+            abAppend(ab, "?", 1);
+        else
+            abAppend(ab, (const char *)&c, 1);
+
+        // utf-8 continuation bytes share the column of their lead byte
+        if ((c & 0xc0) != 0x80)
+            col++;
+    }
+}
+
+void editorDrawDiffLine(struct abuf *ab, int index)
+{
+    if (index >= E.diff->len)
+    {
+        abAppend(ab, "~", 1);
+        return;
+    }
+
+    struct editorDiffLine *dl = &E.diff->line[index];
+    const char *text = NULL;
+    int len = 0;
+    char buf[80];
+
+    switch (dl->kind)
+    {
+    case '@':
+    {
+        struct editorDiffHunk *hunk = &E.diff->diff.hunk[dl->line];
+        len = snprintf(buf, sizeof(buf), "\x1b[36m@@ -%d,%d +%d,%d @@",
+                       hunk->old_start + 1, hunk->old_count,
+                       hunk->new_start + 1, hunk->new_count);
+        if (len > (int)sizeof(buf) - 1)
+            len = sizeof(buf) - 1;
+        abAppend(ab, buf, len);
+        abAppend(ab, "\x1b[39m", 5);
+        return;
+    }
+
+    case '-':
+        text = editorDiffOldLine(&E.diff->diff, dl->line, &len);
+        abAppend(ab, "\x1b[31m-", 6);
+        break;
+
+    default:
+        // rows past the end went away, e.g. a followed file was truncated
+        if (dl->line < E.ctx->numrows)
+        {
+            text = E.ctx->row[dl->line].chars;
+            len = E.ctx->row[dl->line].size;
+        }
+        if (dl->kind == '+')
+            abAppend(ab, "\x1b[32m+", 6);
+        else
+            abAppend(ab, " ", 1);
+        break;
+    }
+
+    if (text)
+        editorDiffAppendText(ab, text, len, E.screencols - 1);
+    abAppend(ab, "\x1b[39m", 5);
+}
+
+// the next hunk header after the cursor (direction 1) or before it (-1),
+// or the cursor itself when there is none that way
+int editorDiffFindHunk(int direction)
+{
+    for (int cnt = E.diff->cursor + direction; cnt >= 0 && cnt < E.diff->len; cnt += direction)
+        if (E.diff->line[cnt].kind == '@')
+            return cnt;
+    return E.diff->cursor;
+}
+
+// the row the line under the cursor belongs to, for jumping to it
+int editorDiffCursorRow()
+{
+    struct editorDiffLine *dl = &E.diff->line[E.diff->cursor];
+    if (dl->kind == ' ' || dl->kind == '+')
+        return dl->line;
+
+    int cnt = E.diff->cursor;
+    while (E.diff->line[cnt].kind != '@')
+        cnt--;
+    return E.diff->diff.hunk[E.diff->line[cnt].line].new_start;
+}
+
+// moves through the diff, jumps between hunks and closes the view. the
+// view is read-only, so keys other than quitting are swallowed; returns 0
+// for the ones the normal handler should see.
+int editorDiffProcessKey(int c)
+{
+    struct editorDiffView *view = E.diff;
+
+    switch (c)
+    {
+    case ARROW_UP:
+        view->cursor--;
+        break;
+    case ARROW_DOWN:
+        view->cursor++;
+        break;
+    case PAGE_UP:
+        view->cursor -= E.screenrows;
+        break;
+    case PAGE_DOWN:
+        view->cursor += E.screenrows;
+        break;
+    case HOME_KEY:
+        view->cursor = 0;
+        break;
+    case END_KEY:
+        view->cursor = view->len - 1;
+        break;
+
+    case 'n':
+        view->cursor = editorDiffFindHunk(1);
+        // show the hunk from its header down
+        view->top = view->cursor;
+        break;
+    case 'p':
+        view->cursor = editorDiffFindHunk(-1);
+        view->top = view->cursor;
+        break;
+
+    case '\r':
+    {
+        int row = editorDiffCursorRow();
+        editorCloseDiff();
+        editorSetStatusMsg("");
+        E.ctx->cy = (row < E.ctx->numrows)
+                        ? row
+                        : E.ctx->numrows;
+        E.ctx->cx = 0;
+        return 1;
+    }
+
+    case '\x1b':
+    case 'q':
+    case CTRL_KEY('d'):
+        editorCloseDiff();
+        editorSetStatusMsg("");
+        return 1;
+
+    case CTRL_KEY('q'):
+    case FOLLOW_UPDATE:
+    case SAVE_UPDATE:
+    case TERMINAL_RESIZE:
+        return 0;
+    }
+
+    if (view->cursor >= view->len)
+        view->cursor = view->len - 1;
+    if (view->cursor < 0)
+        view->cursor = 0;
+    return 1;
 }
 
 /*** output ***/
 
+// screen line of the cursor when soft wrapping. the wrapped segment of
+// its row goes to `segment`.
+long long editorCursorLine(int *segment)
+{
+    int seg = 0;
+    if (E.ctx->cy < E.ctx->numrows)
+    {
+        erow *row = &E.ctx->row[E.ctx->cy];
+        editorRowEnsureDerived(E.ctx, row);
+
+        // the end of a row that fills its last segment stays on that line
+        int count = editorRowWrapCount(row, E.screencols);
+        seg = editorRowCxToRx(row, E.ctx->cx) / E.screencols;
+        if (seg >= count)
+            seg = count - 1;
+    }
+    if (segment)
+        *segment = seg;
+    return editorWrapRowLine(E.ctx, E.ctx->cy) + seg;
+}
+
+// puts the cursor `col` columns into screen line `line` of the wrapped
+// view, or on the empty line after the last row when `line` is past it
+void editorMoveToScreenLine(long long line, int col)
+{
+    if (line < 0)
+        line = 0;
+    if (line >= editorWrapRowLine(E.ctx, E.ctx->numrows))
+    {
+        E.ctx->cy = E.ctx->numrows;
+        E.ctx->cx = 0;
+        return;
+    }
+
+    int seg;
+    E.ctx->cy = editorWrapLineToRow(E.ctx, line, &seg);
+    erow *row = &E.ctx->row[E.ctx->cy];
+    editorRowEnsureDerived(E.ctx, row);
+
+    // a wide character cut by the segment start belongs to the line above
+    int start = seg * E.screencols;
+    E.ctx->cx = editorRowRxToCx(row, start + col);
+    if (editorRowCxToRx(row, E.ctx->cx) < start)
+        E.ctx->cx = editorRowNextCx(row, E.ctx->cx);
+}
+
 void editorScroll()
 {
     // tab rendering
     E.rx = 0;
-    if (E.cy < E.numrows)
-        E.rx = editorRowCxToRx(&E.row[E.cy], E.cx);
+    if (E.ctx->cy < E.ctx->numrows)
+    {
+        editorRowEnsureDerived(E.ctx, &E.ctx->row[E.ctx->cy]);
+        E.rx = editorRowCxToRx(&E.ctx->row[E.ctx->cy], E.ctx->cx);
+    }
+
+    if (E.diff)
+    {
+        if (E.diff->cursor < E.diff->top)
+            E.diff->top = E.diff->cursor;
+        if (E.diff->cursor >= E.diff->top + E.screenrows)
+            E.diff->top = E.diff->cursor - E.screenrows + 1;
+        return;
+    }
+
+    if (E.ctx->hex)
+    {
+        long long line = E.ctx->hex->cursor / ASCEND_HEX_WIDTH;
+
+        if (line < E.lineoffset)
+            E.lineoffset = line;
+        if (line >= E.lineoffset + E.screenrows)
+            E.lineoffset = line - E.screenrows + 1;
+        return;
+    }
+
+    // whatever moved the cursor into a fold opens it
+    if (E.ctx->cy < E.ctx->numrows)
+        editorFoldReveal(E.ctx, E.ctx->cy);
+
+    // a no-op unless wrapping was toggled or the terminal width changed
+    editorSetWrapWidth(E.ctx, E.wrap ? E.screencols : 0);
+    if (E.wrap)
+    {
+        long long line = editorCursorLine(NULL);
+
+        if (line < E.lineoffset)
+            E.lineoffset = line;
+        if (line >= E.lineoffset + E.screenrows)
+            E.lineoffset = line - E.screenrows + 1;
+
+        E.rowoffset = editorWrapLineToRow(E.ctx, E.lineoffset, NULL);
+        E.coloffset = 0;
+        return;
+    }
+
+    // Vertical Scrolling, in screen lines since folded rows take none
+    if (editorRowHidden(E.ctx, E.rowoffset))
+        E.rowoffset = editorFoldLineToRow(E.ctx, editorFoldRowToLine(E.ctx, E.rowoffset));
 
-    // Vertical Scrolling
-    if (E.cy < E.rowoffset)
-        E.rowoffset = E.cy;
+    if (E.ctx->cy < E.rowoffset)
+        E.rowoffset = E.ctx->cy;
 
-    if (E.cy >= E.rowoffset + E.screenrows)
-        E.rowoffset = E.cy - E.screenrows + 1;
+    int line = editorFoldRowToLine(E.ctx, E.ctx->cy);
+    if (line >= editorFoldRowToLine(E.ctx, E.rowoffset) + E.screenrows)
+        E.rowoffset = editorFoldLineToRow(E.ctx, line - E.screenrows + 1);
 
     // Horizontal Scrolling
     if (E.rx < E.coloffset)
@@ -954,15 +1847,326 @@ void editorScroll()
         E.coloffset = E.rx - E.screencols + 1;
 }
 
-void editorDrawRows(struct abuf *ab)
+// switches inverse video on or off as drawing enters or leaves the selection
+void editorMarkSelection(struct abuf *ab, int selected, int *sel_on)
+{
+    if (selected == *sel_on)
+        return;
+    abAppend(ab, selected ? "\x1b[7m" : "\x1b[27m", selected ? 4 : 5);
+    *sel_on = selected;
+}
+
+// search matches of the row being drawn, walked in step with the draw loop
+struct editorMatchCursor
+{
+    const int *rx;
+    int count;
+    int len;
+    int next;
+    int bracket; // render offset of the matching bracket, or -1
+};
+
+void editorMatchCursorInit(struct editorMatchCursor *mc, int filerow)
+{
+    mc->rx = editorRowMatches(E.ctx, filerow, &mc->count);
+    mc->len = E.ctx->matches
+                  ? E.ctx->matches->len
+                  : 0;
+    mc->next = 0;
+    mc->bracket = (filerow == E.bracket_row)
+                      ? E.bracket_offset
+                      : -1;
+}
+
+// the highlight to draw render byte `offset` with. offsets must not go
+// backwards between calls.
+int editorMatchHighlight(struct editorMatchCursor *mc, int offset, int hl)
+{
+    if (offset == mc->bracket)
+        return HL_BRACKET;
+    while (mc->next < mc->count && mc->rx[mc->next] + mc->len <= offset)
+        mc->next++;
+    return (mc->next < mc->count && mc->rx[mc->next] <= offset)
+               ? HL_MATCH
+               : hl;
+}
+
+// draws the screen columns of a row from `coloffset` on, one codepoint at
+// a time so wide characters take two columns and combining marks none
+void editorDrawUtf8Row(struct abuf *ab, erow *row, int coloffset)
 {
+    int index = editorRowColumnToIndex(row, coloffset);
+    int limit = coloffset + E.screencols;
+    int curr_color = -1;
+    int sel_from = 0, sel_to = 0, sel_on = 0;
+    struct editorMatchCursor mc;
+
+    editorSelectionColumns(row, &sel_from, &sel_to);
+    editorMatchCursorInit(&mc, row->index);
+
+    // a wide character or tab cut by the left edge is shown as padding
+    if (row->cp[index].col < coloffset && index < row->ncp)
+    {
+        int pad = row->cp[index + 1].col - coloffset;
+        while (pad-- > 0)
+            abAppend(ab, " ", 1);
+        index++;
+    }
+
+    for (; index < row->ncp; index++)
+    {
+        struct editorCodepoint *cp = &row->cp[index];
+        if (cp[1].col > limit)
+            break;
+
+        char *c = &row->render[cp->render];
+        int len = cp[1].render - cp->render;
+        int hl = editorMatchHighlight(&mc, cp->render, row->highlight[cp->render]);
+        int codepoint;
+
+        editorMarkSelection(ab, cp->col >= sel_from && cp->col < sel_to, &sel_on);
+
+        editorUtf8Decode(c, len, &codepoint);
+        if (codepoint < 0x20 || (codepoint >= 0x7F && codepoint < 0xA0))
+        {
+            char sym = (codepoint >= 0 && codepoint < 26)
+                           ? '@' + codepoint
+                           : '?';
+
+            abAppend(ab, "\x1b[7m", 4);
+            abAppend(ab, &sym, 1);
+            abAppend(ab, "\x1b[m", 3);
+            if (sel_on)
+                abAppend(ab, "\x1b[7m", 4);
+
+            if (curr_color != -1)
+            {
+                char buffer[16];
+                int clength = snprintf(buffer, sizeof(buffer), "\x1b[%dm", curr_color);
+                abAppend(ab, buffer, clength);
+            }
+        }
+        else if (hl == HL_NORMAL)
+        {
+            if (curr_color != -1)
+            {
+                abAppend(ab, "\x1b[39m", 5);
+                curr_color = -1;
+            }
+            abAppend(ab, c, len);
+        }
+        else
+        {
+            int color = editorSyntaxToColor(hl);
+            if (color != curr_color)
+            {
+                curr_color = color;
+                char buffer[16];
+                int clength = snprintf(buffer, sizeof(buffer), "\x1b[%dm", color);
+                abAppend(ab, buffer, clength);
+            }
+            abAppend(ab, c, len);
+        }
+    }
+    editorMarkSelection(ab, 0, &sel_on);
+    abAppend(ab, "\x1b[39m", 5);
+}
+
+// draws the screen columns of an ASCII row from `coloffset` on
+void editorDrawAsciiRow(struct abuf *ab, erow *row, int coloffset)
+{
+    int len = row->rowsize - coloffset;
+
+    if (len < 0)
+        len = 0;
+
+    if (len > E.screencols)
+        len = E.screencols;
+
+    char *c = &row->render[coloffset];
+    unsigned char *highlight = &row->highlight[coloffset];
+    int curr_color = -1;
+    int sel_from = 0, sel_to = 0, sel_on = 0;
+    struct editorMatchCursor mc;
+    int cnt;
+
+    editorSelectionColumns(row, &sel_from, &sel_to);
+    editorMatchCursorInit(&mc, row->index);
+
+    for (cnt = 0; cnt < len; cnt++)
+    {
+        int col = coloffset + cnt;
+        int hl = editorMatchHighlight(&mc, col, highlight[cnt]);
+        editorMarkSelection(ab, col >= sel_from && col < sel_to, &sel_on);
+
+        if (iscntrl(c[cnt]))
+        {
+            char sym = (c[cnt] < 26)
+                           ? '@' + c[cnt]
+                           : '?';
+
+            abAppend(ab, "\x1b[7m", 4);
+            abAppend(ab, &sym, 1);
+            abAppend(ab, "\x1b[m", 3);
+            if (sel_on)
+                abAppend(ab, "\x1b[7m", 4);
+
+            if (curr_color != -1)
+            {
+                char buffer[16];
+                int clength = snprintf(buffer, sizeof(buffer), "\x1b[%dm", curr_color);
+                abAppend(ab, buffer, clength);
+            }
+        }
+        else if (hl == HL_NORMAL)
+        {
+            if (curr_color != -1)
+            {
+                abAppend(ab, "\x1b[39m", 5);
+                curr_color = -1;
+            }
+            abAppend(ab, &c[cnt], 1);
+        }
+        else
+        {
+            int color = editorSyntaxToColor(hl);
+            if (color != curr_color)
+            {
+                curr_color = color;
+                char buffer[16];
+                int clength = snprintf(buffer, sizeof(buffer), "\x1b[%dm", color);
+                abAppend(ab, buffer, clength);
+            }
+            abAppend(ab, &c[cnt], 1);
+        }
+    }
+    editorMarkSelection(ab, 0, &sel_on);
+    abAppend(ab, "\x1b[39m", 5);
+}
+
+// moves what is already on the terminal when the view scrolled by less
+// than a screen: a scroll region over the text lines (DECSTBM) is scrolled
+// with SU/SD, so only the lines that come into view have to be sent
+void editorScrollScreen(struct abuf *ab)
+{
+    long long top = E.diff
+                        ? E.diff->top
+                        : (E.wrap || E.ctx->hex)
+                              ? E.lineoffset
+                              : editorFoldRowToLine(E.ctx, E.rowoffset);
+    long long shift = top - E.screen_top;
+    int count = (shift > 0 ? shift : -shift) < E.screenrows
+                    ? (int)(shift > 0 ? shift : -shift)
+                    : E.screenrows;
+
+    E.screen_top = top;
+    if (shift == 0 || count >= E.screenrows)
+        return;
+
+    char buf[48];
+    int len = snprintf(buf, sizeof(buf), "\x1b[1;%dr\x1b[%d%c\x1b[r",
+                       E.screenrows, count, shift > 0 ? 'S' : 'T');
+    abAppend(ab, buf, len);
+
+    // rotate the cached lines along with the screen; the ones rotated
+    // into the exposed lines no longer describe anything
+    struct editorScreenLine tmp;
+    int cnt;
+    if (shift > 0)
+    {
+        for (cnt = 0; cnt + count < E.screenrows; cnt++)
+        {
+            tmp = E.screen[cnt];
+            E.screen[cnt] = E.screen[cnt + count];
+            E.screen[cnt + count] = tmp;
+        }
+        for (cnt = E.screenrows - count; cnt < E.screenrows; cnt++)
+            E.screen[cnt].len = -1;
+    }
+    else
+    {
+        for (cnt = E.screenrows - 1; cnt - count >= 0; cnt--)
+        {
+            tmp = E.screen[cnt];
+            E.screen[cnt] = E.screen[cnt - count];
+            E.screen[cnt - count] = tmp;
+        }
+        for (cnt = 0; cnt < count; cnt++)
+            E.screen[cnt].len = -1;
+    }
+}
+
+// sends text line `y` unless the terminal already shows exactly that
+void editorFlushLine(struct abuf *ab, int y, struct abuf *line)
+{
+    struct editorScreenLine *cached = &E.screen[y];
+    if (cached->len == line->len && !memcmp(cached->b, line->b, line->len))
+        return;
+
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "\x1b[%d;1H", y + 1);
+    abAppend(ab, buf, len);
+    abAppend(ab, line->b, line->len);
+    abAppend(ab, "\x1b[K", 3); // erase in-line [http://vt100.net/docs/vt100-ug/chapter3.html#EL]
+
+    char *copy = realloc(cached->b, line->len ? line->len : 1);
+    if (copy == NULL)
+    {
+        cached->len = -1;
+        return;
+    }
+    memcpy(copy, line->b, line->len);
+    cached->b = copy;
+    cached->len = line->len;
+}
+
+// after the row heading a fold, how many rows it hides, if that fits
+// on the screen line
+void editorDrawFoldMarker(struct abuf *ab, erow *row, int coloffset)
+{
+    int hidden = editorFoldedRows(E.ctx, row->index);
+    if (hidden == 0)
+        return;
+
+    char marker[32];
+    int len = snprintf(marker, sizeof(marker), " ... %d lines", hidden);
+    int used = row->width - coloffset;
+    if (used < 0)
+        used = 0;
+    if (E.wrap && row->width > coloffset + E.screencols)
+        return;
+    if (used + len > E.screencols)
+        return;
+
+    abAppend(ab, "\x1b[90m", 5);
+    abAppend(ab, marker, len);
+    abAppend(ab, "\x1b[39m", 5);
+}
+
+void editorDrawRows(struct abuf *out)
+{
+    struct abuf line = ABUF_INIT;
+    struct abuf *ab = &line;
     int lines;
+    int segment = 0;
+    int filerow = E.wrap
+                      ? editorWrapLineToRow(E.ctx, E.lineoffset, &segment)
+                      : E.rowoffset;
+
     for (lines = 0; lines < E.screenrows; lines++)
     {
-        int filerow = lines + E.rowoffset;
-        if (filerow >= E.numrows)
+        line.len = 0;
+        int coloffset = E.coloffset + segment * E.screencols;
+        if (filerow < E.ctx->numrows)
+            editorRowEnsureDerived(E.ctx, &E.ctx->row[filerow]);
+
+        if (E.diff)
+            editorDrawDiffLine(ab, E.diff->top + lines);
+        else if (E.ctx->hex)
+            editorDrawHexRow(ab, (E.lineoffset + lines) * ASCEND_HEX_WIDTH);
+        else if (filerow >= E.ctx->numrows)
         {
-            if (E.numrows == 0 && lines == E.screenrows / 3)
+            if (E.ctx->numrows == 0 && lines == E.screenrows / 3)
             {
                 char welcome[80];
                 int welcomelen = snprintf(welcome, sizeof(welcome),
@@ -991,99 +2195,136 @@ void editorDrawRows(struct abuf *ab)
         }
         else
         {
-            int len = E.row[filerow].rowsize - E.coloffset;
+            if (E.ctx->row[filerow].cp)
+                editorDrawUtf8Row(ab, &E.ctx->row[filerow], coloffset);
+            else
+                editorDrawAsciiRow(ab, &E.ctx->row[filerow], coloffset);
+            editorDrawFoldMarker(ab, &E.ctx->row[filerow], coloffset);
+        }
 
-            if (len < 0)
-                len = 0;
+        editorFlushLine(out, lines, &line);
 
-            if (len > E.screencols)
-                len = E.screencols;
+        // the next screen line shows the row's next segment when wrapping,
+        // or the next row that isn't folded away
+        if (E.wrap && filerow < E.ctx->numrows &&
+            segment + 1 < editorRowWrapCount(&E.ctx->row[filerow], E.screencols))
+            segment++;
+        else
+        {
+            filerow = editorFoldNextRow(E.ctx, filerow);
+            segment = 0;
+        }
+    }
+    abFree(&line);
 
-            char *c = &E.row[filerow].render[E.coloffset];
-            unsigned char *highlight = &E.row[filerow].highlight[E.coloffset];
-            int curr_color = -1;
-            int cnt;
+    char buf[32];
+    int len = snprintf(buf, sizeof(buf), "\x1b[%d;1H", E.screenrows + 1);
+    abAppend(out, buf, len);
+}
 
-            for (cnt = 0; cnt < len; cnt++)
-            {
-                if (iscntrl(c[cnt]))
-                {
-                    char sym = (c[cnt] < 26)
-                                   ? '@' + c[cnt]
-                                   : '?';
+void editorFormatBytes(char *buf, size_t bufsize, size_t bytes)
+{
+    if (bytes >= 1024 * 1024 * 1024)
+        snprintf(buf, bufsize, "%.1fGB", bytes / (1024.0 * 1024 * 1024));
+    else if (bytes >= 1024 * 1024)
+        snprintf(buf, bufsize, "%.1fMB", bytes / (1024.0 * 1024));
+    else if (bytes >= 1024)
+        snprintf(buf, bufsize, "%.1fKB", bytes / 1024.0);
+    else
+        snprintf(buf, bufsize, "%zuB", bytes);
+}
 
-                    abAppend(ab, "\x1b[7m", 4);
-                    abAppend(ab, &sym, 1);
-                    abAppend(ab, "\x1b[m", 3);
+void editorDrawStatusBar(struct abuf *ab)
+{
+    abAppend(ab, "\x1b[7m", 4); // selective graphic rendition [http://vt100.net/docs/vt100-ug/chapter3.html#SGR]
 
-                    if (curr_color != -1)
-                    {
-                        char buffer[16];
-                        int clength = snprintf(buffer, sizeof(buffer), "\x1b[%dm", curr_color);
-                        abAppend(ab, buffer, clength);
-                    }
-                }
-                else if (highlight[cnt] == HL_NORMAL)
-                {
-                    if (curr_color != -1)
-                    {
-                        abAppend(ab, "\x1b[39m", 5);
-                        curr_color = -1;
-                    }
-                    abAppend(ab, &c[cnt], 1);
-                }
-                else
-                {
-                    int color = editorSyntaxToColor(highlight[cnt]);
-                    if (color != curr_color)
-                    {
-                        curr_color = color;
-                        char buffer[16];
-                        int clength = snprintf(buffer, sizeof(buffer), "\x1b[%dm", color);
-                        abAppend(ab, buffer, clength);
-                    }
-                    abAppend(ab, &c[cnt], 1);
-                }
-            }
-            abAppend(ab, "\x1b[39m", 5);
-        }
+    char rstatus[80];
+    char status[80];
+    int len;
+
+    if (E.hud)
+    {
+        char heap[16];
+        editorFormatBytes(heap, sizeof(heap), editorRowHeapBytes(E.ctx));
 
-        abAppend(ab, "\x1b[K", 3); // erase in-line [http://vt100.net/docs/vt100-ug/chapter3.html#EL]
-        abAppend(ab, "\r\n", 2);
+        len = snprintf(status,
+                       sizeof(status),
+                       "frame %.2fms | out %dB | syntax %.2fms | %d rows | heap %s",
+                       E.hud_frame_ns / 1e6,
+                       E.hud_frame_bytes,
+                       E.hud_syntax_ns / 1e6,
+                       E.ctx->numrows,
+                       heap);
     }
-}
+    else
+    {
+        char bufnum[32] = "";
+        if (E.buffers->numbufs > 1)
+            snprintf(bufnum, sizeof(bufnum), "[%d/%d] ", E.buffers->current + 1, E.buffers->numbufs);
 
-void editorDrawStatusBar(struct abuf *ab)
-{
-    abAppend(ab, "\x1b[7m", 4); // selective graphic rendition [http://vt100.net/docs/vt100-ug/chapter3.html#SGR]
+        char size[32];
+        if (E.ctx->hex)
+            snprintf(size, sizeof(size), "hex, %lld bytes", E.ctx->hex->size);
+        else
+            snprintf(size, sizeof(size), "%d lines", E.ctx->numrows);
 
-    char rstatus[80];
-    char status[80];
-    int len = snprintf(status,
+        char saving[24] = "";
+        if (E.ctx->save)
+        {
+            int percent = editorSavePercent(E.ctx);
+            if (percent == -1)
+                snprintf(saving, sizeof(saving), "(saving)");
+            else
+                snprintf(saving, sizeof(saving), "(saving %d%%)", percent);
+        }
+
+        len = snprintf(status,
                        sizeof(status),
-                       "%.20s - %d lines %s",
-                       E.filename
-                           ? E.filename
+                       "%s%.20s - %s %s%s%s%s",
+                       bufnum,
+                       E.ctx->filename
+                           ? E.ctx->filename
                            : "[NO FILE]",
-                       E.numrows,
-                       E.dirty
+                       size,
+                       E.ctx->dirty
                            ? "(modified)"
-                           : "");
+                           : "",
+                       E.ctx->follow
+                           ? "(following)"
+                           : "",
+                       E.macro.recording
+                           ? "(recording)"
+                           : "",
+                       saving);
+    }
+
+    if (len >= (int)sizeof(status))
+        len = sizeof(status) - 1;
 
-    int rlen = snprintf(
-        rstatus,
+    int rlen;
+    if (E.ctx->hex)
+        rlen = snprintf(rstatus,
+                        sizeof(rstatus),
+                        "%lld dirty pages | offset 0x%llx",
+                        E.ctx->hex->dirty_pages,
+                        E.ctx->hex->cursor);
+    else
+        rlen = snprintf(
+            rstatus,
+
+            sizeof(rstatus),
 
-        sizeof(rstatus),
+            "%s | byte %lld | %d/%d",
 
-        "%s | %d/%d",
+            E.ctx->syntax
+                ? E.ctx->syntax->filetype
+                : "no filetype",
 
-        E.syntax
-            ? E.syntax->filetype
-            : "no filetype",
+            editorRowOffset(E.ctx, E.ctx->cy) + E.ctx->cx,
 
-        E.cy + 1,
+            E.ctx->cy + 1,
 
-        E.numrows);
+            E.ctx->numrows);
 
     if (len > E.screencols)
         len = E.screencols;
@@ -1120,28 +2361,83 @@ void editorRenderMsgBar(struct abuf *ab)
 
 void editorRefreshScreen()
 {
+    // a replaying macro draws once, when it is done
+    if (E.macro.replaying)
+        return;
+
+    long long frame_start = 0;
+    if (E.hud)
+    {
+        frame_start = editorClockNs();
+        E.hud_syntax_ns = E.ctx->stats.syntax_ns;
+        E.ctx->stats.syntax_ns = 0;
+    }
+
     editorScroll();
+    editorFindBracketPartner();
     struct abuf ab = ABUF_INIT;
 
     abAppend(&ab, "\x1b[?25l", 6); // reset mode [http://vt100.net/docs/vt100-ug/chapter3.html#RM]
-    abAppend(&ab, "\x1b[H", 3);
+    editorScrollScreen(&ab);
 
+    long long draw_start = editorTraceEnabled
+                               ? editorClockNs()
+                               : 0;
     editorDrawRows(&ab);
+    if (editorTraceEnabled)
+        editorTraceEvent("draw_rows", draw_start, editorClockNs());
+
     editorDrawStatusBar(&ab);
     editorRenderMsgBar(&ab);
 
+    // folds above the cursor take one screen line each
+    int cursor_y = editorFoldRowToLine(E.ctx, E.ctx->cy) - editorFoldRowToLine(E.ctx, E.rowoffset);
+    int cursor_x = E.rx - E.coloffset;
+    if (E.diff)
+    {
+        cursor_y = E.diff->cursor - E.diff->top;
+        cursor_x = 0;
+    }
+    else if (E.ctx->hex)
+    {
+        cursor_y = E.ctx->hex->cursor / ASCEND_HEX_WIDTH - E.lineoffset;
+        cursor_x = editorHexCursorColumn();
+    }
+    else if (E.wrap)
+    {
+        int segment;
+        cursor_y = editorCursorLine(&segment) - E.lineoffset;
+        cursor_x = E.rx - segment * E.screencols;
+        if (cursor_x >= E.screencols)
+            cursor_x = E.screencols - 1;
+    }
+
     char buf[32];
-    snprintf(buf, sizeof(buf), "\x1b[%d;%dH", (E.cy - E.rowoffset) + 1, (E.rx - E.coloffset) + 1);
+    snprintf(buf, sizeof(buf), "\x1b[%d;%dH", cursor_y + 1, cursor_x + 1);
     abAppend(&ab, buf, strlen(buf));
 
     abAppend(&ab, "\x1b[?25h", 6); // set mode [http://vt100.net/docs/vt100-ug/chapter3.html#SM]
 
+    if (E.hud)
+        E.hud_frame_ns = editorClockNs() - frame_start;
+    E.hud_frame_bytes = ab.len;
+    if ((size_t)ab.len > E.out_peak)
+        E.out_peak = ab.len;
+
+    long long write_start = editorTraceEnabled
+                                ? editorClockNs()
+                                : 0;
     write(STDOUT_FILENO, ab.b, ab.len);
+    if (editorTraceEnabled)
+        editorTraceEvent("write", write_start, editorClockNs());
     abFree(&ab);
 }
 
 void editorSetStatusMsg(const char *formatstr, ...)
 {
+    if (E.macro.replaying)
+        return;
+
     va_list ap;
     va_start(ap, formatstr);
     vsnprintf(E.statusmsg, sizeof(E.statusmsg), formatstr, ap);
@@ -1149,6 +2445,282 @@ void editorSetStatusMsg(const char *formatstr, ...)
     E.statusmsg_time = time(NULL);
 }
 
+/***  memory stats  ***/
+
+// bytes the terminal line cache holds
+size_t editorScreenBytes()
+{
+    size_t total = sizeof(struct editorScreenLine) * E.screenrows;
+    for (int cnt = 0; cnt < E.screenrows; cnt++)
+        if (E.screen[cnt].len > 0)
+            total += E.screen[cnt].len;
+    return total;
+}
+
+// front end allocations: frame buffer, line cache, clipboard, macro and
+// diff view
+size_t editorFrontendBytes()
+{
+    size_t diff = E.diff
+                      ? sizeof(struct editorDiffLine) * E.diff->len +
+                            sizeof(struct editorDiffHunk) * E.diff->diff.count +
+                            (sizeof(long long) + sizeof(int)) * E.diff->diff.lines
+                      : 0;
+    return E.out_peak + editorScreenBytes() + E.clipboard_len + sizeof(int) * E.macro.cap + diff;
+}
+
+// one line summary of where memory goes, shown with ctrl-k
+void editorShowMemory()
+{
+    struct editorMemory mem;
+    size_t all = editorFrontendBytes();
+
+    for (int cnt = 0; cnt < E.buffers->numbufs; cnt++)
+    {
+        editorMemoryUsage(E.buffers->bufs[cnt], &mem);
+        all += editorMemoryTotal(&mem);
+    }
+    editorMemoryUsage(E.ctx, &mem);
+
+    char chars[16], render[16], hl[16], rows[16], front[16], total[16];
+    editorFormatBytes(chars, sizeof(chars), mem.chars);
+    editorFormatBytes(render, sizeof(render), mem.render + mem.codepoints);
+    editorFormatBytes(hl, sizeof(hl), mem.highlight);
+    editorFormatBytes(rows, sizeof(rows), mem.rows + mem.line_index);
+    editorFormatBytes(front, sizeof(front), editorFrontendBytes());
+    editorFormatBytes(total, sizeof(total), all);
+
+    editorSetStatusMsg("mem text %s rend %s hl %s rows %s ui %s all %s",
+                       chars, render, hl, rows, front, total);
+}
+
+// writes the full report as `key=value` records, one line per buffer, to
+// the dump path. the file is replaced atomically so readers never see
+// half a report.
+void editorMemoryDump()
+{
+    char tmp[4096 + 16];
+    struct editorMemory mem;
+    size_t all = editorFrontendBytes();
+
+    if (E.mem_dump_path == NULL)
+        return;
+    snprintf(tmp, sizeof(tmp), "%s.tmp", E.mem_dump_path);
+    FILE *fp = fopen(tmp, "w");
+    if (fp == NULL)
+        return;
+
+    fprintf(fp, "pid=%d time=%lld buffers=%d budget=%zu\n",
+            (int)getpid(), (long long)time(NULL), E.buffers->numbufs, E.buffers->budget);
+    for (int cnt = 0; cnt < E.buffers->numbufs; cnt++)
+    {
+        editorContext *ctx = E.buffers->bufs[cnt];
+        editorMemoryUsage(ctx, &mem);
+        all += editorMemoryTotal(&mem);
+        fprintf(fp,
+                "buffer=%d file=%s rows=%d chars=%zu render=%zu highlight=%zu "
+                "codepoints=%zu row_array=%zu line_index=%zu matches=%zu total=%zu\n",
+                cnt,
+                ctx->filename
+                    ? ctx->filename
+                    : "-",
+                ctx->numrows,
+                mem.chars,
+                mem.render,
+                mem.highlight,
+                mem.codepoints,
+                mem.rows,
+                mem.line_index,
+                mem.matches,
+                editorMemoryTotal(&mem));
+    }
+    fprintf(fp, "frontend output=%zu screen=%zu clipboard=%zu\n",
+            E.out_peak, editorScreenBytes(), E.clipboard_len);
+    fprintf(fp, "total=%zu\n", all);
+
+    if (fclose(fp) != 0 || rename(tmp, E.mem_dump_path) == -1)
+        unlink(tmp);
+}
+
+void editorMemoryDumpIfRequested()
+{
+    if (!mem_dump_requested)
+        return;
+    mem_dump_requested = 0;
+    editorMemoryDump();
+}
+
+void editorMemorySignal(int sig)
+{
+    (void)sig;
+    mem_dump_requested = 1;
+}
+
+// SIGUSR1 asks for a report in `path`, or $TMPDIR/ascend-<pid>.mem
+void editorSetupMemoryDump(const char *path)
+{
+    static char buf[4096];
+    char *tmpdir = getenv("TMPDIR");
+
+    if (path && *path)
+        snprintf(buf, sizeof(buf), "%s", path);
+    else
+        snprintf(buf, sizeof(buf), "%s/ascend-%d.mem",
+                 tmpdir && *tmpdir
+                     ? tmpdir
+                     : "/tmp",
+                 (int)getpid());
+    E.mem_dump_path = buf;
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = editorMemorySignal;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR1, &sa, NULL);
+}
+
+/***  macros  ***/
+
+// keys that start, stop or replay a macro, or leave the editor, are never
+// part of one. pastes record themselves in editorReadPaste
+int editorMacroRecordable(int c)
+{
+    return c != CTRL_KEY('b') && c != CTRL_KEY('e') && c != CTRL_KEY('q') &&
+           c != PASTE_START && c != FOLLOW_UPDATE && c != SAVE_UPDATE && c != TERMINAL_RESIZE;
+}
+
+void editorMacroRecord(int key)
+{
+    if (E.macro.len == E.macro.cap)
+    {
+        int cap = E.macro.cap ? E.macro.cap * 2 : 256;
+        int *keys = realloc(E.macro.keys, sizeof(int) * cap);
+        if (keys == NULL)
+        {
+            E.macro.recording = 0;
+            editorSetStatusMsg("Macro recording stopped: out of memory");
+            return;
+        }
+        E.macro.keys = keys;
+        E.macro.cap = cap;
+    }
+    E.macro.keys[E.macro.len++] = key;
+}
+
+// the next key to handle: from the macro while one replays, otherwise from
+// the terminal, keeping a copy when a macro is being recorded
+int editorNextKey()
+{
+    if (E.macro.replaying)
+    {
+        // a prompt left open at the end of the macro is cancelled
+        return (E.macro.pos < E.macro.len)
+                   ? E.macro.keys[E.macro.pos++]
+                   : '\x1b';
+    }
+
+    int c = editorReadKey();
+    if (E.macro.recording && editorMacroRecordable(c))
+        editorMacroRecord(c);
+    return c;
+}
+
+void editorToggleRecording()
+{
+    if (E.macro.recording)
+    {
+        E.macro.recording = 0;
+        editorSetStatusMsg("Recorded %d key%s, ctrl-e replays them",
+                           E.macro.len, E.macro.len == 1 ? "" : "s");
+        return;
+    }
+
+    E.macro.len = 0;
+    E.macro.recording = 1;
+    editorSetStatusMsg("Recording a macro, ctrl-b to stop");
+}
+
+// a key pressed during a replay stops it; the key itself is dropped
+int editorReplayInterrupted()
+{
+    struct pollfd fd = {STDIN_FILENO, POLLIN, 0};
+    if (poll(&fd, 1, 0) != 1 || !(fd.revents & POLLIN))
+        return 0;
+
+    editorReadKey();
+    return 1;
+}
+
+// replays the macro N times, or with 0 until a search in it finds nothing.
+// the keys go through editorProcessKeypress as if typed, but no frame is
+// drawn and no status is set until the whole replay is done.
+void editorReplayMacro()
+{
+    if (E.macro.recording)
+    {
+        editorSetStatusMsg("Stop recording with ctrl-b first");
+        return;
+    }
+    if (E.macro.len == 0)
+    {
+        editorSetStatusMsg("No macro yet, ctrl-b starts recording one");
+        return;
+    }
+
+    char *answer = editorPrompt("Replay macro: %s times (0 = until a search fails, ESC to cancel)", NULL);
+    if (answer == NULL)
+        return;
+
+    char *end;
+    long long times = strtoll(answer, &end, 10);
+    if (end == answer || *end != '\0' || times < 0)
+    {
+        editorSetStatusMsg("Can't replay \"%.20s\" times", answer);
+        free(answer);
+        return;
+    }
+    free(answer);
+
+    editorSetStatusMsg("Replaying macro, press any key to stop");
+    editorRefreshScreen();
+
+    long long start = editorClockNs();
+    long long checked = start;
+    long long done = 0;
+    int interrupted = 0;
+
+    E.macro.replaying = 1;
+    E.macro.failed = 0;
+    while ((times == 0 || done < times) && !E.macro.failed)
+    {
+        E.macro.pos = 0;
+        while (E.macro.pos < E.macro.len && !E.macro.failed)
+            editorProcessKeypress();
+        if (!E.macro.failed)
+            done++;
+
+        // looking at the terminal costs a syscall, so only every 50ms
+        long long now = editorClockNs();
+        if (now - checked > 50000000LL)
+        {
+            checked = now;
+            if ((interrupted = editorReplayInterrupted()))
+                break;
+        }
+    }
+    E.macro.replaying = 0;
+
+    editorSetStatusMsg("Replayed macro %lld time%s in %.1fms%s",
+                       done, done == 1 ? "" : "s",
+                       (editorClockNs() - start) / 1e6,
+                       interrupted
+                           ? ", stopped by a key"
+                           : E.macro.failed
+                                 ? ", stopped at a failed search"
+                                 : "");
+}
+
 /*** input ***/
 
 char *editorPrompt(char *prompt, void (*callback)(char *, int))
@@ -1164,7 +2736,27 @@ char *editorPrompt(char *prompt, void (*callback)(char *, int))
         editorSetStatusMsg(prompt, buffer);
         editorRefreshScreen();
 
-        int c = editorReadKey();
+        int c = editorNextKey();
+
+        if (editorTraceEnabled && !E.macro.replaying)
+            editorTraceKey(c, editorClockNs());
+
+        if (c == FOLLOW_UPDATE)
+        {
+            editorFollowUpdate();
+            continue;
+        }
+        if (c == SAVE_UPDATE)
+        {
+            editorSaveUpdate(0);
+            editorFollowUpdate();
+            continue;
+        }
+        if (c == TERMINAL_RESIZE)
+        {
+            editorResize();
+            continue;
+        }
 
         if (c == DEL_KEY || c == CTRL_KEY('h') || c == BACKSPACE)
         {
@@ -1192,7 +2784,7 @@ char *editorPrompt(char *prompt, void (*callback)(char *, int))
                 return buffer;
             }
         }
-        else if (!iscntrl(c) && c < 128)
+        else if (!iscntrl(c) && c < 256)
         {
             if (buflen == buffrsize - 1)
             {
@@ -1209,55 +2801,159 @@ char *editorPrompt(char *prompt, void (*callback)(char *, int))
 
 void editorMoveCursor(int key)
 {
-    erow *row = (E.cy >= E.numrows)
+    erow *row = (E.ctx->cy >= E.ctx->numrows)
                     ? NULL
-                    : &E.row[E.cy];
+                    : &E.ctx->row[E.ctx->cy];
+    int oldcy = E.ctx->cy;
 
     switch (key)
     {
     case ARROW_LEFT:
-        if (E.cx != 0)
-            E.cx--;
-        else if (E.cy > 0)
+        if (E.ctx->cx != 0)
+            E.ctx->cx = editorRowPrevCx(row, E.ctx->cx);
+        else if (E.ctx->cy > 0)
         {
-            E.cy--;
-            E.cx = E.row[E.cy].size;
+            E.ctx->cy = editorFoldPrevRow(E.ctx, E.ctx->cy);
+            E.ctx->cx = E.ctx->row[E.ctx->cy].size;
         }
 
         break;
     case ARROW_RIGHT:
-        if (row && E.cx < row->size)
-            E.cx++;
-        else if (row && E.cx == row->size)
+        if (row && E.ctx->cx < row->size)
+            E.ctx->cx = editorRowNextCx(row, E.ctx->cx);
+        else if (row && E.ctx->cx == row->size)
         {
-            E.cy++;
-            E.cx = 0;
+            E.ctx->cy = editorFoldNextRow(E.ctx, E.ctx->cy);
+            E.ctx->cx = 0;
         }
         break;
     case ARROW_UP:
-        if (E.cy != 0)
-            E.cy--;
-        break;
     case ARROW_DOWN:
-        if (E.cy < E.numrows)
-            E.cy++;
+        if (E.wrap)
+        {
+            // one screen line at a time, keeping the column on screen
+            int segment;
+            long long line = editorCursorLine(&segment);
+            int col = (row)
+                          ? editorRowCxToRx(row, E.ctx->cx) - segment * E.screencols
+                          : 0;
+            if (key == ARROW_UP && line > 0)
+                editorMoveToScreenLine(line - 1, col);
+            else if (key == ARROW_DOWN && E.ctx->cy < E.ctx->numrows)
+                editorMoveToScreenLine(line + 1, col);
+            return;
+        }
+        if (key == ARROW_UP && E.ctx->cy != 0)
+            E.ctx->cy = editorFoldPrevRow(E.ctx, E.ctx->cy);
+        else if (key == ARROW_DOWN && E.ctx->cy < E.ctx->numrows)
+            E.ctx->cy = editorFoldNextRow(E.ctx, E.ctx->cy);
         break;
     }
+
+    // keep the cursor in the same screen column when changing rows, and
+    // never leave it inside a multibyte character or past the end
+    if ((key == ARROW_UP || key == ARROW_DOWN) && E.ctx->cy != oldcy)
+    {
+        int rx = 0;
+        if (row)
+        {
+            editorRowEnsureDerived(E.ctx, row);
+            rx = editorRowCxToRx(row, E.ctx->cx);
+        }
+
+        if (E.ctx->cy >= E.ctx->numrows)
+            E.ctx->cx = 0;
+        else
+        {
+            editorRowEnsureDerived(E.ctx, &E.ctx->row[E.ctx->cy]);
+            E.ctx->cx = editorRowRxToCx(&E.ctx->row[E.ctx->cy], rx);
+        }
+    }
 }
 
 void editorProcessKeypress()
 {
     static int quit_times = ASCEND_QUIT_TIMES;
-    int c = editorReadKey();
+    int c = editorNextKey();
+
+    if (editorTraceEnabled && !E.macro.replaying)
+    {
+        E.trace_key_ns = editorClockNs();
+        editorTraceKey(c, E.trace_key_ns);
+    }
+
+    if (E.diff && editorDiffProcessKey(c))
+    {
+        quit_times = ASCEND_QUIT_TIMES;
+        return;
+    }
+
+    if (E.ctx->hex && editorHexProcessKey(c))
+    {
+        quit_times = ASCEND_QUIT_TIMES;
+        return;
+    }
 
     switch (c)
     {
+    case FOLLOW_UPDATE:
+        // not a keystroke, leave the quit confirmation alone
+        editorFollowUpdate();
+        return;
+
+    case SAVE_UPDATE:
+        // the wait that ended may have seen followed files change too
+        editorSaveUpdate(0);
+        editorFollowUpdate();
+        return;
+
     case '\r':
-        editorinsertNewLine();
+        editorDeleteSelection();
+        editorinsertNewLine(E.ctx);
+        break;
+
+    case '\t':
+        if (E.sel_active)
+            editorIndent(1);
+        else
+            editorInsertChar(E.ctx, c);
+        break;
+
+    case SHIFT_TAB:
+        editorIndent(-1);
+        break;
+
+    case SHIFT_ARROW_LEFT:
+    case SHIFT_ARROW_RIGHT:
+    case SHIFT_ARROW_UP:
+    case SHIFT_ARROW_DOWN:
+    case SHIFT_HOME:
+    case SHIFT_END:
+        editorExtendSelection(c);
+        break;
+
+    case CTRL_KEY('c'):
+    case CTRL_KEY('x'):
+        editorCopy(c == CTRL_KEY('x'));
+        break;
+
+    case CTRL_KEY('v'):
+        if (E.clipboard)
+            editorPasteText(E.clipboard, E.clipboard_len);
+        break;
+
+    case PASTE_START:
+        editorReadPaste();
         break;
 
     case CTRL_KEY('q'):
-        if (E.dirty && quit_times > 0)
+        if (editorSaving())
+        {
+            editorSetStatusMsg("Waiting for saves to finish...");
+            editorRefreshScreen();
+            editorSaveUpdate(1);
+        }
+        if (editorAnyDirty() && quit_times > 0)
         {
             editorSetStatusMsg(
                 "WARNING! File has unsaved changes."
@@ -1276,36 +2972,114 @@ void editorProcessKeypress()
         break;
 
     case HOME_KEY:
-        E.cx = 0;
+        E.ctx->cx = 0;
         break;
 
     case END_KEY:
-        if (E.cy < E.numrows)
-            E.cx = E.row[E.cy].size;
+        if (E.ctx->cy < E.ctx->numrows)
+            E.ctx->cx = E.ctx->row[E.ctx->cy].size;
         break;
 
     case CTRL_KEY('f'):
         editorFind();
         break;
 
+    case CTRL_KEY('r'):
+        editorReplace();
+        break;
+
+    case CTRL_KEY('g'):
+        editorGoto();
+        break;
+
+    case CTRL_KEY('o'):
+        editorOpenBuffer();
+        break;
+
+    case CTRL_KEY('n'):
+    case CTRL_KEY('p'):
+        if (E.buffers->numbufs > 1)
+            editorSwitchBuffer((E.buffers->current + E.buffers->numbufs +
+                                (c == CTRL_KEY('n') ? 1 : -1)) %
+                               E.buffers->numbufs);
+        break;
+
+    case CTRL_KEY('k'):
+        editorShowMemory();
+        break;
+
+    case CTRL_KEY('b'):
+        editorToggleRecording();
+        break;
+
+    case CTRL_KEY('e'):
+        editorReplayMacro();
+        break;
+
+    case CTRL_KEY('y'):
+        editorToggleFold();
+        break;
+
+    case CTRL_KEY('d'):
+        editorOpenDiff();
+        break;
+
+    case CTRL_KEY(']'):
+        editorJumpToBracket();
+        break;
+
+    case CTRL_KEY('u'):
+        editorSortLines();
+        break;
+
+    case CTRL_KEY('w'):
+        E.wrap = !E.wrap;
+        E.lineoffset = 0;
+        editorSetStatusMsg("soft wrap %s", E.wrap ? "on" : "off");
+        break;
+
+    case TERMINAL_RESIZE:
+        editorResize();
+        return;
+
+    case CTRL_KEY('t'):
+        E.hud = !E.hud;
+        E.ctx->stats.enabled = E.hud;
+        E.ctx->stats.syntax_ns = 0;
+        break;
+
     case BACKSPACE:
     case CTRL_KEY('h'):
     case DEL_KEY:
+        if (editorDeleteSelection())
+            break;
         if (c == DEL_KEY)
             editorMoveCursor(ARROW_RIGHT);
-        editorDeleteChar();
+        editorDeleteChar(E.ctx);
         break;
 
     case PAGE_UP:
     case PAGE_DOWN:
     {
+        // a screen of wrapped lines; the target line is found directly
+        if (E.wrap)
+        {
+            int segment;
+            editorCursorLine(&segment);
+            editorMoveToScreenLine(c == PAGE_UP
+                                       ? E.lineoffset - E.screenrows
+                                       : E.lineoffset + 2 * E.screenrows - 1,
+                                   E.rx - segment * E.screencols);
+            break;
+        }
+
         if (c == PAGE_UP)
-            E.cy = E.rowoffset;
+            E.ctx->cy = E.rowoffset;
         else if (c == PAGE_DOWN)
         {
-            E.cy = E.rowoffset + E.screenrows - 1;
-            if (E.cy > E.numrows)
-                E.cy = E.numrows;
+            E.ctx->cy = editorFoldLineToRow(E.ctx, editorFoldRowToLine(E.ctx, E.rowoffset) + E.screenrows - 1);
+            if (E.ctx->cy > E.ctx->numrows)
+                E.ctx->cy = E.ctx->numrows;
         }
 
         int times = E.screenrows;
@@ -1326,41 +3100,222 @@ void editorProcessKeypress()
         break;
 
     default:
-        editorInsertChar(c);
+        editorDeleteSelection();
+        editorInsertChar(E.ctx, c);
         break;
     }
+
+    // anything but extending it, indenting, copying or looking at stats
+    // ends a selection
+    if (!(c >= SHIFT_ARROW_LEFT && c <= SHIFT_TAB) && c != '\t' && c != CTRL_KEY('c') && c != CTRL_KEY('t') && c != CTRL_KEY('k'))
+        E.sel_active = 0;
     quit_times = ASCEND_QUIT_TIMES;
 }
 
+/***  batch mode  ***/
+
+// --exec: applies a script of editor commands to the file and exits. the
+// terminal is left alone, nothing is drawn and no syntax is highlighted.
+// returns the exit status.
+int editorExec(const char *script_path, char *filename)
+{
+    if (filename == NULL)
+    {
+        fprintf(stderr, "ascend: --exec needs a file to edit\n");
+        return 2;
+    }
+
+    FILE *script = strcmp(script_path, "-")
+                       ? fopen(script_path, "r")
+                       : stdin;
+    if (script == NULL)
+    {
+        perror(script_path);
+        return 2;
+    }
+
+    editorContext *ctx = editorContextNew();
+    if (ctx == NULL)
+    {
+        perror("editorContextNew");
+        return 1;
+    }
+    ctx->text_only = 1;
+    if (editorOpen(ctx, filename) == -1)
+    {
+        perror(filename);
+        return 1;
+    }
+    if (ctx->hex)
+    {
+        fprintf(stderr, "ascend: %s: binary files can't be scripted\n", filename);
+        return 1;
+    }
+
+    // the process exits straight after, so the rows aren't freed one by one
+    int result = editorRunScript(ctx, script, script_path, stderr);
+    if (script != stdin)
+        fclose(script);
+    return (result == 0)
+               ? 0
+               : 1;
+}
+
 /*** init utils ***/
 
-void editorInit()
+// syntax definitions come from $ASCEND_SYNTAX_DIR, falling back to
+// $XDG_CONFIG_HOME/ascend/syntax or ~/.config/ascend/syntax; compiled
+// tables are cached under $XDG_CACHE_HOME/ascend or ~/.cache/ascend
+void editorLoadSyntaxes()
+{
+    char dir[4096];
+    char cache[4096];
+    char *home = getenv("HOME");
+    char *syntax_dir = getenv("ASCEND_SYNTAX_DIR");
+    char *config_home = getenv("XDG_CONFIG_HOME");
+    char *cache_home = getenv("XDG_CACHE_HOME");
+
+    if (syntax_dir && *syntax_dir)
+        snprintf(dir, sizeof(dir), "%s", syntax_dir);
+    else if (config_home && *config_home)
+        snprintf(dir, sizeof(dir), "%s/ascend/syntax", config_home);
+    else if (home)
+        snprintf(dir, sizeof(dir), "%s/.config/ascend/syntax", home);
+    else
+        return;
+
+    cache[0] = '\0';
+    if (cache_home && *cache_home)
+        snprintf(cache, sizeof(cache), "%s/ascend/syntax.cache", cache_home);
+    else if (home)
+        snprintf(cache, sizeof(cache), "%s/.cache/ascend/syntax.cache", home);
+
+    editorLoadSyntaxDir(dir, cache[0] ? cache : NULL);
+}
+
+void editorSetupLineCache()
+{
+    char dir[4096];
+    char *home = getenv("HOME");
+    char *cache_home = getenv("XDG_CACHE_HOME");
+
+    if (cache_home && *cache_home)
+        snprintf(dir, sizeof(dir), "%s/ascend/lines", cache_home);
+    else if (home)
+        snprintf(dir, sizeof(dir), "%s/.cache/ascend/lines", home);
+    else
+        return;
+
+    editorSetLineCacheDir(dir);
+}
+
+void editorInit(size_t budget)
 {
-    E.cx = 0;
-    E.cy = 0;
+    E.buffers = editorBufferListNew(budget);
+    E.views = NULL;
+    editorContext *ctx = editorContextNew();
+    if (E.buffers == NULL || ctx == NULL || editorNewBuffer(ctx) == -1)
+        errhandl("editorInit");
+
+    E.ctx = editorBufferSwitch(E.buffers, 0);
     E.rx = 0;
     E.rowoffset = 0;
     E.coloffset = 0;
-    E.numrows = 0;
-    E.row = NULL;
-    E.dirty = 0;
-    E.filename = NULL;
     E.statusmsg[0] = '\0';
     E.statusmsg_time = 0;
-    E.syntax = NULL;
+    E.hud = 0;
+    E.hud_frame_ns = 0;
+    E.hud_frame_bytes = 0;
+    E.hud_syntax_ns = 0;
+    E.trace_key_ns = 0;
+    E.progress_ns = 0;
+    E.sel_active = 0;
+    E.clipboard = NULL;
+    E.clipboard_len = 0;
+    E.wrap = 0;
+    E.lineoffset = 0;
+    E.screen_top = 0;
+    E.out_peak = 0;
+    E.mem_dump_path = NULL;
+    memset(&E.macro, 0, sizeof(E.macro));
+    E.diff = NULL;
+    E.bracket_row = -1;
+    E.bracket_offset = 0;
 
     if (getWindowSize(&E.screenrows, &E.screencols) == -1)
         errhandl("getWindowSize");
     E.screenrows -= 2;
+
+    E.screen = NULL;
+    editorAllocScreen();
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = editorResizeSignal;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGWINCH, &sa, NULL);
 }
 
 int main(int argc, char *argv[])
 {
+    char *filename = NULL;
+    char *exec_path = NULL;
+    int follow = 0;
+    int hex = 0;
+    char *trace_path = getenv("ASCEND_TRACE");
+    char *budget_mb = getenv("ASCEND_MEM_BUDGET");
+    char *mem_dump = getenv("ASCEND_MEM_DUMP");
+
+    for (int cnt = 1; cnt < argc; cnt++)
+    {
+        if (!strcmp(argv[cnt], "--trace") && cnt + 1 < argc)
+            trace_path = argv[++cnt];
+        else if (!strcmp(argv[cnt], "--mem-budget") && cnt + 1 < argc)
+            budget_mb = argv[++cnt];
+        else if (!strcmp(argv[cnt], "--mem-dump") && cnt + 1 < argc)
+            mem_dump = argv[++cnt];
+        else if (!strcmp(argv[cnt], "-f") || !strcmp(argv[cnt], "--follow"))
+            follow = 1;
+        else if (!strcmp(argv[cnt], "--hex"))
+            hex = 1;
+        else if (!strcmp(argv[cnt], "--exec") && cnt + 1 < argc)
+            exec_path = argv[++cnt];
+        else
+            filename = argv[cnt];
+    }
+
+    size_t budget = (size_t)(budget_mb
+                                 ? atol(budget_mb)
+                                 : ASCEND_MEM_BUDGET_MB) *
+                    1024 * 1024;
+
+    if (exec_path)
+        return editorExec(exec_path, filename);
+
     enableRawMode();
-    editorInit();
+    editorInit(budget);
+
+    if (trace_path && *trace_path && editorTraceOpen(trace_path) == -1)
+        errhandl("editorTraceOpen");
+
+    editorLoadSyntaxes();
+    editorSetupLineCache();
+    editorSetupMemoryDump(mem_dump);
+
+    if (filename && (hex
+                         ? editorOpenHex(E.ctx, filename)
+                         : editorOpen(E.ctx, filename)) == -1)
+        errhandl("fopen");
 
-    if (argc >= 2)
-        editorOpen(argv[1]);
+    if (follow && filename)
+    {
+        if (editorFollowStart(E.ctx) == -1)
+            errhandl("editorFollowStart");
+        E.ctx->cy = E.ctx->numrows > 0
+                        ? E.ctx->numrows - 1
+                        : 0;
+    }
 
     editorSetStatusMsg("HELP: ctrl-q: quit  |   ctrl-s: save    |   ctrl-f: search");
 
@@ -1368,6 +3323,9 @@ int main(int argc, char *argv[])
     {
         editorRefreshScreen();
         editorProcessKeypress();
+
+        if (editorTraceEnabled)
+            editorTraceEvent("process_keypress", E.trace_key_ns, editorClockNs());
     }
 
     return 0;
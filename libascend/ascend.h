@@ -0,0 +1,517 @@
+#ifndef ASCEND_H
+#define ASCEND_H
+
+/*** includes ***/
+
+#include <stddef.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+/*** defines ***/
+#define ASCEND_VERSION "4.0.156 -stable"
+#define ASCEND_TAB_STOP 8
+#define ASCEND_MATCH_SLOTS 256 // rows whose search matches are cached
+
+enum editorHighlight
+{
+    HL_NORMAL = 0,
+    HL_COMMENT,
+    HL_MLCOMMENT,
+    HL_KEYWORD1,
+    HL_KEYWORD2,
+    HL_STRING,
+    HL_NUMBER,
+    HL_MATCH,
+    HL_BRACKET
+};
+
+#define HL_HIGHLIGHT_NUMBERS (1 << 0)
+#define HL_HIGHLIGHT_STRINGS (1 << 1)
+#define HL_IGNORE_CASE (1 << 2)
+
+// character classes of a compiled lexer
+#define LEX_SEPARATOR (1 << 0)
+#define LEX_QUOTE (1 << 1)
+#define LEX_DIGIT (1 << 2)
+
+// what a lexer state accepts
+enum editorLexToken
+{
+    LEX_NONE = 0,
+    LEX_KEYWORD1,
+    LEX_KEYWORD2,
+    LEX_COMMENT,
+    LEX_MLCOMMENT_START,
+    LEX_MLCOMMENT_END
+};
+
+#define LEX_ROOT 0         // start state outside comments
+#define LEX_ROOT_COMMENT 1 // start state inside a multi-line comment
+
+// how editorSortRows orders rows
+#define SORT_REVERSE (1 << 0)
+#define SORT_UNIQUE (1 << 1) // keep one of each run of equal rows
+
+/*** data ***/
+
+// table-driven lexer compiled from an editorSyntax. keywords and comment
+// delimiters share one trie stored as a dense transition table: `sym` maps
+// a byte to its column (0 = byte never appears in a token) and
+// next[state * nsyms + sym] is the following state, 0 meaning no edge.
+struct editorLexer
+{
+    unsigned char cls[256];
+    unsigned char sym[256];
+    int nsyms;
+    int nstates;
+    int *next;
+    unsigned char *accept;
+};
+
+struct editorSyntax
+{
+    char *filetype;
+    char **filematch;
+    char **keywords;
+    char *singleline_comment_start;
+    char *multiline_comment_start;
+    char *multiline_comment_end;
+    int flags;
+    char *string_quotes; // NULL means " and '
+    char *separators;    // NULL means the C-ish default set
+    struct editorLexer *lexer;
+};
+
+// where a codepoint of a non-ASCII row starts in chars, on screen and in
+// render. a row with n codepoints has n + 1 entries, the last one marking
+// the end of the row.
+struct editorCodepoint
+{
+    int byte;
+    int col;
+    int render;
+};
+
+typedef struct erow
+{
+    int index;
+    int size;
+    int rowsize;
+    char *chars;
+    char *render;
+    unsigned char *highlight;
+    int highlight_open_comment;
+    int width;                  // display columns of render
+    int ncp;                    // codepoints, when cp is set
+    unsigned match_stamp;       // search cache entry holding this row's matches
+    struct editorCodepoint *cp; // NULL for pure ASCII rows
+
+    // brackets in code, opening ones counted +1 and closing ones -1: the
+    // row's total and the lowest running total along it. bracket_min is 1
+    // until the row has been highlighted
+    int bracket_net;
+    int bracket_min;
+} erow;
+
+// cheap counters for the front end's performance HUD. row_bytes (and its
+// render/highlight share, derived_bytes) is kept up to date by the row
+// operations; syntax_ns is only accumulated while `enabled` is set so the
+// clock reads cost nothing when nobody is looking.
+struct editorStats
+{
+    int enabled;
+    long long syntax_ns;
+    size_t row_bytes;
+    size_t derived_bytes;
+};
+
+// where a buffer's memory goes, filled in by editorMemoryUsage
+struct editorMemory
+{
+    size_t chars;      // row text
+    size_t render;     // rendered text
+    size_t highlight;  // one byte per rendered byte
+    size_t codepoints; // utf-8 column maps
+    size_t rows;       // the row array
+    size_t line_index; // offset and bracket trees
+    size_t matches;    // search match cache
+    size_t hex;        // patched pages of a hex view
+};
+
+// where the current search query occurs in the rows that were drawn, in a
+// table indexed by row number modulo ASCEND_MATCH_SLOTS. every fill gets a
+// fresh stamp that is also stored in the row; rendering a row clears its
+// stamp, so edits invalidate cached matches without telling the cache.
+struct editorMatchSlot
+{
+    int row;
+    unsigned stamp; // 0 when empty
+    int count;
+    int cap;
+    int *rx; // render offsets of the matches
+};
+
+struct editorMatches
+{
+    char *query;
+    int len;
+    unsigned stamp; // last stamp handed out
+    struct editorMatchSlot slot[ASCEND_MATCH_SLOTS];
+};
+
+// row lengths (newline included) in blocks of at most LINE_BLOCK_ROWS,
+// with Fenwick trees over the blocks' row counts and sums, so the byte
+// offset of a row, the row holding a byte offset and inserting or deleting
+// a row anywhere are all O(log n) plus a pass over one block. loads clear
+// `valid` and the next lookup rebuilds it. with `width` set the same index
+// counts the screen lines each row wraps to instead.
+#define LINE_BLOCK_ROWS 512
+#define LINE_BLOCK_FILL 384 // rows per block after a rebuild or a split
+
+struct editorLineBlock
+{
+    int *value; // LINE_BLOCK_ROWS entries
+    int count;
+    long long sum;
+};
+
+struct editorLineIndex
+{
+    struct editorLineBlock *block;
+    long long *sums; // 1-based
+    int *counts;     // 1-based
+    int nblocks;
+    int cap;  // blocks allocated
+    int size; // rows covered
+    int valid;
+    int width; // wrap width, 0 for byte lengths
+};
+
+// rows in blocks of at most BRACKET_BLOCK_ROWS, with a segment tree over
+// the blocks: node 1 is the root and block i is leaf cap + i. a node holds
+// its rows, their bracket total and lowest running total, and how many of
+// its blocks are stale. edits resize a block and mark it stale, splitting
+// or dropping it as needed; its totals are summed from the rows when a
+// lookup first has to cross it.
+#define BRACKET_BLOCK_ROWS 512
+#define BRACKET_BLOCK_FILL 384 // rows per block after a rebuild or a split
+
+struct editorBracketNode
+{
+    int count; // rows
+    int net;
+    int min;
+    int stale; // blocks whose totals are out of date
+};
+
+struct editorBracketIndex
+{
+    struct editorBracketNode *node;
+    int nblocks;
+    int size; // rows covered
+    int cap;  // leaves, a power of two
+    int valid;
+};
+
+// rows first..last hidden behind row first - 1, and the rows hidden by the
+// folds before this one
+struct editorFold
+{
+    int first;
+    int last;
+    int hidden;
+};
+
+// folded blocks in row order, never overlapping
+struct editorFolds
+{
+    struct editorFold *fold;
+    int count;
+    int cap;
+};
+
+// one open file: its rows, cursor and syntax. every libascend call takes
+// the context explicitly, there is no global editor state in the library.
+typedef struct editorContext
+{
+    int cx, cy;
+    int numrows;
+    erow *row;
+    int dirty;
+    char *filename;
+    struct editorSyntax *syntax;
+    struct editorStats stats;
+    unsigned long last_viewed; // buffer list LRU tick
+    long long file_bytes;      // bytes editorOpen read from disk
+    int compressed;            // loaded from a gzip file
+    struct editorFollow *follow;
+    struct editorLineIndex lines;
+    struct editorLineIndex wrap; // screen lines per row, when soft wrapping
+    struct editorFolds folds;
+    struct editorBracketIndex brackets;
+    struct editorMatches *matches; // NULL when no search is shown
+    struct editorHexView *hex;     // set for buffers shown in hex
+    struct editorSave *save;       // set while a background save runs
+
+    // rows keep only their chars: loads and edits build no render or
+    // highlight data. for buffers that are edited but never drawn
+    int text_only;
+
+    // called now and then during slow loads so a front end can show progress
+    void (*progress)(struct editorContext *ctx, long long done, long long total);
+} editorContext;
+
+// tails a file that keeps growing: inotify tells us when it changed and
+// only the bytes past `offset` are read and appended
+struct editorFollow
+{
+    int inotify_fd;
+    int watch;
+    int fd;
+    long long offset;
+    int partial;   // the last row is still waiting for its newline
+    int truncated; // set when the file shrank or was replaced
+};
+
+// a binary file shown as hex instead of rows. the file is mapped
+// copy-on-write; patched pages are flagged in `dirty` (one bit per page)
+// and only those are written back on save.
+struct editorHexView
+{
+    unsigned char *data;
+    long long size;
+    long pagesize;
+    unsigned char *dirty;
+    long long dirty_pages;
+    long long cursor; // byte under the cursor
+    int nibble;       // 1 after the high nibble of the cursor byte was typed
+};
+
+// `old_count` lines of the saved file from `old_start` were replaced by
+// `new_count` rows from `new_start`. both are 0-based
+struct editorDiffHunk
+{
+    int old_start;
+    int old_count;
+    int new_start;
+    int new_count;
+};
+
+// what changed between the rows and the file on disk. the file stays
+// mapped and the lines between the common prefix and suffix keep their
+// offsets, so removed lines can be shown without copying them.
+struct editorDiff
+{
+    struct editorDiffHunk *hunk;
+    int count;
+    char *data;
+    long long size;
+    int base;  // first line that differs, the rest before it are equal
+    int lines; // lines of the file from base on that were diffed
+    long long *old_offset;
+    int *old_len;
+};
+
+// what a save running in the background shares with the editor: the
+// bytes written so far, and how it ended
+struct editorSaveShared
+{
+    long long done;
+    long long written; // file size, set when it succeeded
+    int error;         // errno, set when it failed
+};
+
+// a save in flight, see save.c
+struct editorSave
+{
+    pid_t pid;
+    int fd;          // readable once the child has exited
+    long long total; // bytes the rows take
+    int dirty;       // ctx->dirty when the snapshot was taken
+    int compressed;
+    struct editorSaveShared *shared;
+};
+
+// several open contexts with one of them current. when the rows of all
+// buffers hold more than `budget` bytes, the render and highlight data of
+// the least recently viewed buffers is evicted and rebuilt lazily.
+typedef struct editorBufferList
+{
+    editorContext **bufs;
+    int numbufs;
+    int current;
+    size_t budget; // 0 means unlimited
+    unsigned long tick;
+} editorBufferList;
+
+/***  context  ***/
+editorContext *editorContextNew(void);
+void editorContextFree(editorContext *ctx);
+
+/***  line index  ***/
+void editorLineIndexFree(editorContext *ctx);
+void editorLineIndexUpdate(editorContext *ctx, erow *row);
+void editorLineIndexInsert(editorContext *ctx, int pos);
+void editorLineIndexDelete(editorContext *ctx, int pos);
+void editorLineIndexSplice(editorContext *ctx, int pos, int removed, int added);
+long long editorRowOffset(editorContext *ctx, int pos);
+int editorOffsetToRow(editorContext *ctx, long long offset);
+
+/***  wrap index  ***/
+int editorRowWrapCount(erow *row, int width);
+void editorSetWrapWidth(editorContext *ctx, int width);
+void editorWrapIndexRefresh(editorContext *ctx, int first, int last);
+long long editorWrapRowLine(editorContext *ctx, int pos);
+int editorWrapLineToRow(editorContext *ctx, long long line, int *segment);
+
+/***  folding  ***/
+int editorFoldToggle(editorContext *ctx, int row);
+void editorUnfoldAll(editorContext *ctx);
+void editorFoldFree(editorContext *ctx);
+void editorFoldReveal(editorContext *ctx, int row);
+int editorRowHidden(editorContext *ctx, int row);
+int editorFoldedRows(editorContext *ctx, int row);
+int editorFoldNextRow(editorContext *ctx, int row);
+int editorFoldPrevRow(editorContext *ctx, int row);
+int editorFoldRowToLine(editorContext *ctx, int row);
+int editorFoldLineToRow(editorContext *ctx, int line);
+void editorFoldRowsReplaced(editorContext *ctx, int pos, int removed, int added);
+
+/***  bracket index  ***/
+void editorBracketSummarize(erow *row);
+void editorBracketUpdate(editorContext *ctx, erow *row);
+void editorBracketInsert(editorContext *ctx, int pos);
+void editorBracketDelete(editorContext *ctx, int pos);
+void editorBracketSplice(editorContext *ctx, int pos, int removed, int added);
+void editorBracketFree(editorContext *ctx);
+int editorMatchBracket(editorContext *ctx, int cy, int cx, int *match_cx);
+
+/***  line cache  ***/
+void editorSetLineCacheDir(const char *dir);
+int editorLineCacheLoad(editorContext *ctx, int fd);
+void editorLineCacheWrite(editorContext *ctx, int fd);
+
+/***  hex view  ***/
+int editorIsBinary(int fd);
+int editorHexMap(editorContext *ctx, int fd);
+int editorOpenHex(editorContext *ctx, char *filename);
+void editorHexClose(editorContext *ctx);
+int editorHexPatch(editorContext *ctx, long long offset, unsigned char value);
+long long editorHexSave(editorContext *ctx);
+
+/***  background save  ***/
+int editorSaveStart(editorContext *ctx);
+int editorSavePercent(editorContext *ctx);
+int editorSavePoll(editorContext *ctx, int wait, long long *written);
+
+/***  sorting  ***/
+int editorSortRows(editorContext *ctx, int first, int last, int flags);
+
+/***  diff  ***/
+int editorDiffFile(editorContext *ctx, struct editorDiff *diff);
+const char *editorDiffOldLine(struct editorDiff *diff, int line, int *len);
+void editorDiffFree(struct editorDiff *diff);
+
+/***  follow  ***/
+int editorFollowStart(editorContext *ctx);
+void editorFollowStop(editorContext *ctx);
+int editorFollowPoll(editorContext *ctx);
+
+/***  buffers  ***/
+editorBufferList *editorBufferListNew(size_t budget);
+void editorBufferListFree(editorBufferList *bl);
+int editorBufferAdd(editorBufferList *bl, editorContext *ctx);
+int editorBufferFind(editorBufferList *bl, const char *filename);
+editorContext *editorBufferSwitch(editorBufferList *bl, int index);
+void editorBufferEnforceBudget(editorBufferList *bl);
+
+/***  scripts  ***/
+int editorRunScript(editorContext *ctx, FILE *script, const char *name, FILE *errors);
+
+/***  stats  ***/
+long long editorClockNs(void);
+size_t editorRowHeapBytes(editorContext *ctx);
+void editorMemoryUsage(editorContext *ctx, struct editorMemory *mem);
+size_t editorMemoryTotal(struct editorMemory *mem);
+
+/***  tracing  ***/
+// latency tracing is process wide and must only be fed from one thread
+extern int editorTraceEnabled;
+int editorTraceOpen(const char *path);
+void editorTraceClose(void);
+void editorTraceKey(int key, long long ns);
+void editorTraceEvent(const char *name, long long start_ns, long long end_ns);
+
+/***  syntax highlighting  ***/
+void editorUpdateSyntax(editorContext *ctx, erow *row);
+int editorHighlightRowFrom(editorContext *ctx, erow *row, int in_comment);
+void editorHighlightRows(editorContext *ctx, erow *rows, int count);
+void editorUpdateSyntaxRange(editorContext *ctx, int first, int last);
+void editorSelectSyntaxHighlight(editorContext *ctx);
+void editorRegisterSyntax(struct editorSyntax *syntax);
+
+/***  lexer  ***/
+struct editorLexer *editorCompileSyntax(struct editorSyntax *syntax);
+int editorLexMatch(struct editorLexer *lex, int root, const char *s, int len, int prev_separator, int *kind);
+struct editorSyntax *editorParseSyntaxFile(const char *path);
+int editorLoadSyntaxDir(const char *dir, const char *cachefile);
+
+/***  utf-8  ***/
+int editorIsAscii(const char *s, int len);
+int editorUtf8Decode(const char *str, int len, int *codepoint);
+int editorCodepointWidth(int cp);
+
+/***  row operations  ***/
+int editorRowCxToRx(erow *row, int cx);
+int editorRowRxToCx(erow *row, int rx);
+int editorRowRenderToCx(erow *row, int offset);
+int editorRowCxToRender(erow *row, int cx);
+int editorRowColumnToIndex(erow *row, int col);
+int editorRowNextCx(erow *row, int cx);
+int editorRowPrevCx(erow *row, int cx);
+size_t editorRowDerivedBytes(erow *row);
+int editorRowWidth(erow *row);
+size_t editorRenderRowText(erow *row);
+void editorRenderRow(editorContext *ctx, erow *row);
+void editorUpdateRow(editorContext *ctx, erow *row);
+void editorRowEnsureDerived(editorContext *ctx, erow *row);
+void editorRowDropDerived(editorContext *ctx, erow *row);
+void editorEvictDerived(editorContext *ctx);
+void editorFreeRow(erow *row);
+void editorDeleteRow(editorContext *ctx, int pos);
+void editorInsertRow(editorContext *ctx, int pos, char *s, size_t len);
+void editorRowDeleteChar(editorContext *ctx, erow *row, int pos);
+void editorRowDeleteBytes(editorContext *ctx, erow *row, int pos, int len);
+void editorRowInsertChar(editorContext *ctx, erow *row, int at, int c);
+void editorRowAppendString(editorContext *ctx, erow *row, char *str, size_t len);
+int editorAppendLines(editorContext *ctx, const char *data, size_t len, int partial);
+
+/***  editor operations  ***/
+void editorInsertChar(editorContext *ctx, int c);
+void editorinsertNewLine(editorContext *ctx);
+void editorDeleteChar(editorContext *ctx);
+
+/***  range operations  ***/
+int editorInsertText(editorContext *ctx, int cy, int cx, const char *text, size_t len, int *end_cy, int *end_cx);
+void editorDeleteRange(editorContext *ctx, int cy0, int cx0, int cy1, int cx1);
+char *editorCopyRange(editorContext *ctx, int cy0, int cx0, int cy1, int cx1, size_t *len);
+void editorIndentRows(editorContext *ctx, int first, int last, int direction);
+
+/***  file I/O  ***/
+char *editorRowsToString(editorContext *ctx, int *buffrlen);
+int editorOpen(editorContext *ctx, char *filename);
+int editorWriteFile(editorContext *ctx);
+int editorMkdirParents(const char *path);
+int editorLoadMapped(editorContext *ctx, int fd);
+int editorIsGzip(int fd);
+int editorOpenGzip(editorContext *ctx, int fd);
+long long editorWriteGzip(editorContext *ctx, int fd);
+
+/***  search  ***/
+int editorFindRow(editorContext *ctx, const char *query, int from, int direction, int *match_rx);
+int editorFindForward(editorContext *ctx, const char *query, int cy, int cx, int *match_cx);
+long long editorReplaceAll(editorContext *ctx, const char *query, const char *replacement);
+int editorSetSearch(editorContext *ctx, const char *query);
+const int *editorRowMatches(editorContext *ctx, int pos, int *count);
+
+#endif
@@ -0,0 +1,510 @@
+/*** includes ***/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ascend.h"
+
+/***  bracket index  ***/
+
+// brackets are counted as one kind: an opening one adds 1 and a closing
+// one takes 1 away, so the partner of an opening bracket is the first
+// place after it where the running total drops below where it started.
+// every row keeps its total and the lowest running total inside it. rows
+// are grouped in blocks and a segment tree over the blocks combines those
+// totals, which finds the block holding the partner in O(log n) however
+// far away it is. edits only mark their block stale; a stale block is
+// summed again from its rows when a lookup first has to cross it.
+
+// +1 for an opening bracket in code at render offset `offset`, -1 for a
+// closing one, 0 for anything else. the highlight tells brackets inside
+// strings and comments apart; rows without one count as code.
+static int bracketDelta(erow *row, int offset)
+{
+    if (row->highlight)
+    {
+        int hl = row->highlight[offset];
+        if (hl == HL_COMMENT || hl == HL_MLCOMMENT || hl == HL_STRING)
+            return 0;
+    }
+
+    switch (row->render[offset])
+    {
+    case '(':
+    case '[':
+    case '{':
+        return 1;
+    case ')':
+    case ']':
+    case '}':
+        return -1;
+    default:
+        return 0;
+    }
+}
+
+// fills in the row's bracket_net and bracket_min from its render and
+// highlight. only looks at the row, so loader threads can call it.
+void editorBracketSummarize(erow *row)
+{
+    int net = 0;
+    int min = 0;
+
+    for (int cnt = 0; cnt < row->rowsize; cnt++)
+    {
+        net += bracketDelta(row, cnt);
+        if (net < min)
+            min = net;
+    }
+    row->bracket_net = net;
+    row->bracket_min = min;
+}
+
+static void bracketCombine(struct editorBracketIndex *index, int node)
+{
+    struct editorBracketNode *left = &index->node[2 * node];
+    struct editorBracketNode *right = &index->node[2 * node + 1];
+
+    index->node[node].count = left->count + right->count;
+    index->node[node].net = left->net + right->net;
+    index->node[node].min = (left->min < left->net + right->min)
+                                ? left->min
+                                : left->net + right->min;
+    index->node[node].stale = left->stale + right->stale;
+}
+
+// recombines the parents of `node` up to the root
+static void bracketFix(struct editorBracketIndex *index, int node)
+{
+    for (node /= 2; node >= 1; node /= 2)
+        bracketCombine(index, node);
+}
+
+// swaps blocks from..from + old - 1 for stale ones holding `rows` rows,
+// filled to BRACKET_BLOCK_FILL. rebuilds the tree, O(blocks).
+static int bracketReplace(struct editorBracketIndex *index, int from, int old, int rows)
+{
+    int fresh = (rows + BRACKET_BLOCK_FILL - 1) / BRACKET_BLOCK_FILL;
+    if (index->nblocks - old + fresh == 0)
+        fresh = 1;
+    int nblocks = index->nblocks - old + fresh;
+
+    int cap = index->cap ? index->cap : 16;
+    while (cap < nblocks)
+        cap *= 2;
+    if (cap != index->cap)
+    {
+        struct editorBracketNode *node = malloc(sizeof(*node) * 2 * cap);
+        if (node == NULL)
+            return -1;
+        if (index->nblocks)
+            memcpy(&node[cap], &index->node[index->cap], sizeof(*node) * index->nblocks);
+        free(index->node);
+        index->node = node;
+        index->cap = cap;
+    }
+
+    struct editorBracketNode *leaf = &index->node[index->cap];
+    memmove(&leaf[from + fresh], &leaf[from + old], sizeof(*leaf) * (index->nblocks - from - old));
+    for (int cnt = 0; cnt < fresh; cnt++)
+    {
+        leaf[from + cnt].count = (int)((long long)rows * (cnt + 1) / fresh - (long long)rows * cnt / fresh);
+        leaf[from + cnt].net = 0;
+        leaf[from + cnt].min = 0;
+        leaf[from + cnt].stale = 1;
+    }
+    memset(&leaf[nblocks], 0, sizeof(*leaf) * (index->cap - nblocks));
+    index->nblocks = nblocks;
+    for (int node = index->cap - 1; node >= 1; node--)
+        bracketCombine(index, node);
+    return 0;
+}
+
+// lays the rows out in stale blocks, O(n / BRACKET_BLOCK_FILL). nothing
+// is summed until a lookup needs it.
+static int bracketBuild(editorContext *ctx)
+{
+    struct editorBracketIndex *index = &ctx->brackets;
+
+    if (bracketReplace(index, 0, index->nblocks, ctx->numrows) == -1)
+        return -1;
+    index->size = ctx->numrows;
+    index->valid = 1;
+    return 0;
+}
+
+// the block holding row `pos` and the row it starts on, walking down by
+// row counts. `pos` equal to the size lands in the last block.
+static int bracketLocate(struct editorBracketIndex *index, int pos, int *start)
+{
+    int node = 1;
+
+    *start = 0;
+    while (node < index->cap)
+    {
+        node *= 2;
+        if (pos - *start >= index->node[node].count)
+        {
+            *start += index->node[node].count;
+            node++;
+        }
+    }
+
+    int b = node - index->cap;
+    if (b >= index->nblocks)
+    {
+        b = index->nblocks - 1;
+        *start = index->size - index->node[index->cap + b].count;
+    }
+    return b;
+}
+
+// the first row of block `b`
+static int bracketBlockStart(struct editorBracketIndex *index, int b)
+{
+    int start = 0;
+    for (int node = index->cap + b; node > 1; node /= 2)
+        if (node & 1)
+            start += index->node[node - 1].count;
+    return start;
+}
+
+static void bracketTouch(struct editorBracketIndex *index, int b)
+{
+    int node = index->cap + b;
+    if (index->node[node].stale)
+        return;
+    index->node[node].stale = 1;
+    bracketFix(index, node);
+}
+
+// row `pos` with its totals known. rows that were never highlighted, like
+// those read from the line cache, are highlighted just long enough to be
+// counted.
+static erow *bracketRow(editorContext *ctx, int pos)
+{
+    erow *row = &ctx->row[pos];
+    if (row->bracket_min > 0)
+    {
+        int had_render = (row->render != NULL);
+        editorRowEnsureDerived(ctx, row);
+        if (row->bracket_min > 0)
+            editorBracketSummarize(row);
+        if (!had_render)
+            editorRowDropDerived(ctx, row);
+    }
+    return row;
+}
+
+// sums stale block `b` from its rows
+static void bracketResolve(editorContext *ctx, int b)
+{
+    struct editorBracketIndex *index = &ctx->brackets;
+    int start = bracketBlockStart(index, b);
+    int node = index->cap + b;
+    int net = 0;
+    int min = 0;
+
+    for (int cnt = start; cnt < start + index->node[node].count; cnt++)
+    {
+        erow *row = bracketRow(ctx, cnt);
+        if (net + row->bracket_min < min)
+            min = net + row->bracket_min;
+        net += row->bracket_net;
+    }
+    index->node[node].net = net;
+    index->node[node].min = min;
+    index->node[node].stale = 0;
+    bracketFix(index, node);
+}
+
+// the row was highlighted again
+void editorBracketUpdate(editorContext *ctx, erow *row)
+{
+    struct editorBracketIndex *index = &ctx->brackets;
+    int start;
+
+    if (index->valid && row->index < index->size)
+        bracketTouch(index, bracketLocate(index, row->index, &start));
+}
+
+// rows pos..pos + removed - 1 were replaced by `added` rows: the blocks
+// they touch are cut into fresh stale ones, O(blocks)
+void editorBracketSplice(editorContext *ctx, int pos, int removed, int added)
+{
+    struct editorBracketIndex *index = &ctx->brackets;
+    if (!index->valid)
+        return;
+    if (pos + removed > index->size)
+    {
+        index->valid = 0;
+        return;
+    }
+
+    int start0, start1;
+    int b0 = bracketLocate(index, pos, &start0);
+    int b1 = bracketLocate(index, pos + removed, &start1);
+    int rows = start1 + index->node[index->cap + b1].count - start0 - removed + added;
+
+    if (bracketReplace(index, b0, b1 - b0 + 1, rows) == -1)
+        index->valid = 0;
+    else
+        index->size += added - removed;
+}
+
+// a row was added at `pos`: its block grows by one, O(log n). a full
+// block is split, or a new one started when appending.
+void editorBracketInsert(editorContext *ctx, int pos)
+{
+    struct editorBracketIndex *index = &ctx->brackets;
+    if (!index->valid)
+        return;
+
+    int start;
+    int b = bracketLocate(index, pos, &start);
+    int node = index->cap + b;
+
+    if (index->node[node].count < BRACKET_BLOCK_ROWS)
+    {
+        index->node[node].count++;
+        index->node[node].stale = 1;
+        bracketFix(index, node);
+        index->size++;
+    }
+    else if (pos != index->size)
+        editorBracketSplice(ctx, pos, 0, 1);
+    else if (bracketReplace(index, index->nblocks, 0, 1) == -1)
+        index->valid = 0;
+    else
+        index->size++;
+}
+
+void editorBracketDelete(editorContext *ctx, int pos)
+{
+    struct editorBracketIndex *index = &ctx->brackets;
+    if (!index->valid)
+        return;
+
+    int start;
+    int b = bracketLocate(index, pos, &start);
+    int node = index->cap + b;
+
+    // its last row takes the block with it
+    if (index->node[node].count == 1 && index->nblocks > 1)
+    {
+        editorBracketSplice(ctx, pos, 1, 0);
+        return;
+    }
+    index->node[node].count--;
+    index->node[node].stale = 1;
+    bracketFix(index, node);
+    index->size--;
+}
+
+void editorBracketFree(editorContext *ctx)
+{
+    free(ctx->brackets.node);
+    ctx->brackets.node = NULL;
+    ctx->brackets.nblocks = 0;
+    ctx->brackets.size = 0;
+    ctx->brackets.cap = 0;
+    ctx->brackets.valid = 0;
+}
+
+// the first block from `from` on where a running total that is `depth`
+// at the start of block `from` drops below 0, leaving the total at the
+// start of that block in `depth`, or -1. subtrees it can't drop in are
+// skipped whole; stale blocks are summed on the way, so only those the
+// walk can't skip cost anything.
+static int bracketSearchForward(editorContext *ctx, int node, int lo, int hi, int from, int *depth)
+{
+    struct editorBracketIndex *index = &ctx->brackets;
+
+    if (hi < from || lo >= index->nblocks)
+        return -1;
+    if (lo == hi && index->node[node].stale)
+        bracketResolve(ctx, lo);
+    if (lo >= from && !index->node[node].stale)
+    {
+        if (*depth + index->node[node].min >= 0)
+        {
+            *depth += index->node[node].net;
+            return -1;
+        }
+        if (lo == hi)
+            return lo;
+    }
+
+    int mid = (lo + hi) / 2;
+    int found = bracketSearchForward(ctx, 2 * node, lo, mid, from, depth);
+    if (found == -1)
+        found = bracketSearchForward(ctx, 2 * node + 1, mid + 1, hi, from, depth);
+    return found;
+}
+
+// the same walking back to the last block up to `to`, where `depth`
+// counts closing brackets minus opening ones seen from the end of block
+// `to`. a block's tails reach at most net - min, so depth drops below 0
+// inside it when depth - (net - min) < 0. gives the total at its end.
+static int bracketSearchBackward(editorContext *ctx, int node, int lo, int hi, int to, int *depth)
+{
+    struct editorBracketIndex *index = &ctx->brackets;
+
+    if (lo > to || lo >= index->nblocks)
+        return -1;
+    if (lo == hi && index->node[node].stale)
+        bracketResolve(ctx, lo);
+    if (hi <= to && !index->node[node].stale)
+    {
+        if (*depth - (index->node[node].net - index->node[node].min) >= 0)
+        {
+            *depth -= index->node[node].net;
+            return -1;
+        }
+        if (lo == hi)
+            return lo;
+    }
+
+    int mid = (lo + hi) / 2;
+    int found = bracketSearchBackward(ctx, 2 * node + 1, mid + 1, hi, to, depth);
+    if (found == -1)
+        found = bracketSearchBackward(ctx, 2 * node, lo, mid, to, depth);
+    return found;
+}
+
+// the first row from `pos` on where a running total that is `depth` at the
+// start of row pos drops below 0, and the total at the start of that row:
+// the rest of pos's block row by row, then the tree, then the rows of the
+// block it lands in
+static int bracketFindForward(editorContext *ctx, int pos, int *depth)
+{
+    struct editorBracketIndex *index = &ctx->brackets;
+    int start;
+    int b = bracketLocate(index, pos, &start);
+    int end = start + index->node[index->cap + b].count;
+
+    for (;;)
+    {
+        for (; pos < end; pos++)
+        {
+            erow *row = bracketRow(ctx, pos);
+            if (*depth + row->bracket_min < 0)
+                return pos;
+            *depth += row->bracket_net;
+        }
+
+        b = bracketSearchForward(ctx, 1, 0, index->cap - 1, b + 1, depth);
+        if (b == -1)
+            return -1;
+        pos = bracketBlockStart(index, b);
+        end = pos + index->node[index->cap + b].count;
+    }
+}
+
+// the same walking back from row `pos`, where `depth` counts closing
+// brackets minus opening ones seen from the end of row pos. gives the
+// total at the end of the row found.
+static int bracketFindBackward(editorContext *ctx, int pos, int *depth)
+{
+    struct editorBracketIndex *index = &ctx->brackets;
+    int start;
+    int b = bracketLocate(index, pos, &start);
+
+    for (;;)
+    {
+        for (; pos >= start; pos--)
+        {
+            erow *row = bracketRow(ctx, pos);
+            if (*depth - (row->bracket_net - row->bracket_min) < 0)
+                return pos;
+            *depth -= row->bracket_net;
+        }
+
+        if (b == 0)
+            return -1;
+        b = bracketSearchBackward(ctx, 1, 0, index->cap - 1, b - 1, depth);
+        if (b == -1)
+            return -1;
+        start = bracketBlockStart(index, b);
+        pos = start + index->node[index->cap + b].count - 1;
+    }
+}
+
+static int bracketPairs(char open, char close)
+{
+    return (open == '(' && close == ')') ||
+           (open == '[' && close == ']') ||
+           (open == '{' && close == '}');
+}
+
+// the bracket matching the one at (cy, cx): returns its row and puts its
+// byte offset in `match_cx`. returns -1 when there is no bracket in code
+// at (cy, cx), it is unbalanced, or its partner is a different kind.
+// text-only buffers have no highlight to tell code from strings, so
+// nothing matches there.
+int editorMatchBracket(editorContext *ctx, int cy, int cx, int *match_cx)
+{
+    if (ctx->text_only || cy < 0 || cy >= ctx->numrows)
+        return -1;
+
+    erow *row = &ctx->row[cy];
+    editorRowEnsureDerived(ctx, row);
+    int offset = editorRowCxToRender(row, cx);
+    if (offset >= row->rowsize)
+        return -1;
+
+    int direction = bracketDelta(row, offset);
+    if (direction == 0)
+        return -1;
+    if (!ctx->brackets.valid && bracketBuild(ctx) == -1)
+        return -1;
+
+    // the rest of the bracket's own row, then whichever row the index
+    // says the total runs out in, scanned from the right end
+    char bracket = row->render[offset];
+    int depth = 0;
+    int found = -1;
+    int scan = offset + direction;
+
+    for (;;)
+    {
+        for (; scan >= 0 && scan < row->rowsize; scan += direction)
+        {
+            depth += bracketDelta(row, scan) * direction;
+            if (depth < 0)
+            {
+                found = scan;
+                break;
+            }
+        }
+        if (found != -1)
+            break;
+
+        int next = (direction > 0)
+                       ? ((row->index + 1 < ctx->numrows)
+                              ? bracketFindForward(ctx, row->index + 1, &depth)
+                              : -1)
+                       : ((row->index > 0)
+                              ? bracketFindBackward(ctx, row->index - 1, &depth)
+                              : -1);
+        if (next == -1 || next >= ctx->numrows)
+            return -1;
+
+        row = &ctx->row[next];
+        editorRowEnsureDerived(ctx, row);
+        scan = (direction > 0)
+                   ? 0
+                   : row->rowsize - 1;
+    }
+
+    char partner = row->render[found];
+    if (!(direction > 0 ? bracketPairs(bracket, partner) : bracketPairs(partner, bracket)))
+        return -1;
+
+    *match_cx = editorRowRenderToCx(row, found);
+    return row->index;
+}
@@ -0,0 +1,100 @@
+/*** includes ***/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ascend.h"
+
+/***  buffers  ***/
+
+editorBufferList *editorBufferListNew(size_t budget)
+{
+    editorBufferList *bl = malloc(sizeof(editorBufferList));
+    if (bl == NULL)
+        return NULL;
+
+    bl->bufs = NULL;
+    bl->numbufs = 0;
+    bl->current = -1;
+    bl->budget = budget;
+    bl->tick = 0;
+    return bl;
+}
+
+void editorBufferListFree(editorBufferList *bl)
+{
+    if (bl == NULL)
+        return;
+
+    for (int cnt = 0; cnt < bl->numbufs; cnt++)
+        editorContextFree(bl->bufs[cnt]);
+    free(bl->bufs);
+    free(bl);
+}
+
+// takes ownership of ctx and returns its index, -1 if out of memory
+int editorBufferAdd(editorBufferList *bl, editorContext *ctx)
+{
+    editorContext **bufs = realloc(bl->bufs, sizeof(editorContext *) * (bl->numbufs + 1));
+    if (bufs == NULL)
+        return -1;
+
+    bl->bufs = bufs;
+    bl->bufs[bl->numbufs] = ctx;
+    return bl->numbufs++;
+}
+
+int editorBufferFind(editorBufferList *bl, const char *filename)
+{
+    for (int cnt = 0; cnt < bl->numbufs; cnt++)
+        if (bl->bufs[cnt]->filename && !strcmp(bl->bufs[cnt]->filename, filename))
+            return cnt;
+    return -1;
+}
+
+// makes buffer `index` current. nothing is reloaded or re-rendered here:
+// rows whose derived data was evicted are rebuilt as they're looked at.
+editorContext *editorBufferSwitch(editorBufferList *bl, int index)
+{
+    if (index < 0 || index >= bl->numbufs)
+        return NULL;
+
+    bl->current = index;
+    bl->bufs[index]->last_viewed = ++bl->tick;
+    editorBufferEnforceBudget(bl);
+    return bl->bufs[index];
+}
+
+void editorBufferEnforceBudget(editorBufferList *bl)
+{
+    if (bl->budget == 0)
+        return;
+
+    size_t total = 0;
+    for (int cnt = 0; cnt < bl->numbufs; cnt++)
+        total += editorRowHeapBytes(bl->bufs[cnt]);
+
+    while (total > bl->budget)
+    {
+        int victim = -1;
+        for (int cnt = 0; cnt < bl->numbufs; cnt++)
+        {
+            editorContext *ctx = bl->bufs[cnt];
+            if (cnt == bl->current || ctx->stats.derived_bytes == 0)
+                continue;
+            if (victim == -1 || ctx->last_viewed < bl->bufs[victim]->last_viewed)
+                victim = cnt;
+        }
+
+        // only the current buffer's data is left, chars can't be evicted
+        if (victim == -1)
+            return;
+
+        total -= bl->bufs[victim]->stats.derived_bytes;
+        editorEvictDerived(bl->bufs[victim]);
+    }
+}
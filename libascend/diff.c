@@ -0,0 +1,408 @@
+/*** includes ***/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ascend.h"
+
+/*** defines ***/
+#define DIFF_MAX_COST 1024 // edit steps searched per split before giving up on minimal
+
+/*** data ***/
+
+// the lines left after trimming: a is the saved file, b the buffer
+struct diffState
+{
+    const char *data;
+    long long *a_offset;
+    int *a_len;
+    uint64_t *a_hash;
+    erow *b;
+    uint64_t *b_hash;
+    unsigned char *a_changed;
+    unsigned char *b_changed;
+    int *v; // furthest reaching x per diagonal, forward then backward
+};
+
+/***  diff  ***/
+
+// eight bytes per step; a collision only costs a byte comparison later
+static uint64_t diffHash(const char *s, int len)
+{
+    uint64_t hash = 14695981039346656037ULL ^ (uint64_t)len;
+    uint64_t word;
+    int cnt;
+
+    for (cnt = 0; cnt + 8 <= len; cnt += 8)
+    {
+        memcpy(&word, s + cnt, 8);
+        hash = (hash ^ word) * 1099511628211ULL;
+        hash ^= hash >> 32;
+    }
+    for (; cnt < len; cnt++)
+        hash = (hash ^ (unsigned char)s[cnt]) * 1099511628211ULL;
+    return hash;
+}
+
+static int diffSame(const char *s, long long len, erow *row)
+{
+    return len == row->size && memcmp(s, row->chars, len) == 0;
+}
+
+// the hash decides almost every comparison, the bytes only confirm a match
+static int diffEqual(struct diffState *d, int a, int b)
+{
+    return d->a_hash[a] == d->b_hash[b] &&
+           diffSame(d->data + d->a_offset[a], d->a_len[a], &d->b[b]);
+}
+
+// Myers' middle snake: walks the edit graph of a0..a1 against b0..b1 from
+// both corners at once until the paths meet, and returns where to split
+// the problem. only two rows of diagonals are kept, so the space is
+// linear. returns 0 when the halves are more than DIFF_MAX_COST steps
+// apart.
+static int diffBisect(struct diffState *d, int a0, int a1, int b0, int b1, int *split_a, int *split_b)
+{
+    int n = a1 - a0;
+    int m = b1 - b0;
+    int max_d = (n + m + 1) / 2;
+    if (max_d > DIFF_MAX_COST)
+        max_d = DIFF_MAX_COST;
+
+    int offset = max_d;
+    int length = 2 * max_d + 2;
+    int *v1 = d->v;
+    int *v2 = d->v + length;
+    for (int cnt = 0; cnt < length; cnt++)
+        v1[cnt] = v2[cnt] = -1;
+    v1[offset + 1] = 0;
+    v2[offset + 1] = 0;
+
+    // with an odd difference in length the forward path is the one that
+    // reaches the overlap first
+    int delta = n - m;
+    int front = delta & 1;
+    int k1start = 0, k1end = 0, k2start = 0, k2end = 0;
+
+    for (int e = 0; e < max_d; e++)
+    {
+        for (int k1 = -e + k1start; k1 <= e - k1end; k1 += 2)
+        {
+            int k1off = offset + k1;
+            int x1 = (k1 == -e || (k1 != e && v1[k1off - 1] < v1[k1off + 1]))
+                         ? v1[k1off + 1]
+                         : v1[k1off - 1] + 1;
+            int y1 = x1 - k1;
+            while (x1 < n && y1 < m && diffEqual(d, a0 + x1, b0 + y1))
+            {
+                x1++;
+                y1++;
+            }
+            v1[k1off] = x1;
+
+            if (x1 > n)
+                k1end += 2;
+            else if (y1 > m)
+                k1start += 2;
+            else if (front)
+            {
+                int k2off = offset + delta - k1;
+                if (k2off >= 0 && k2off < length && v2[k2off] != -1 && x1 >= n - v2[k2off])
+                {
+                    *split_a = a0 + x1;
+                    *split_b = b0 + y1;
+                    return 1;
+                }
+            }
+        }
+
+        for (int k2 = -e + k2start; k2 <= e - k2end; k2 += 2)
+        {
+            int k2off = offset + k2;
+            int x2 = (k2 == -e || (k2 != e && v2[k2off - 1] < v2[k2off + 1]))
+                         ? v2[k2off + 1]
+                         : v2[k2off - 1] + 1;
+            int y2 = x2 - k2;
+            while (x2 < n && y2 < m && diffEqual(d, a1 - x2 - 1, b1 - y2 - 1))
+            {
+                x2++;
+                y2++;
+            }
+            v2[k2off] = x2;
+
+            if (x2 > n)
+                k2end += 2;
+            else if (y2 > m)
+                k2start += 2;
+            else if (!front)
+            {
+                int k1off = offset + delta - k2;
+                if (k1off >= 0 && k1off < length && v1[k1off] != -1)
+                {
+                    int x1 = v1[k1off];
+                    int y1 = offset + x1 - k1off;
+                    if (x1 >= n - x2)
+                    {
+                        *split_a = a0 + x1;
+                        *split_b = b0 + y1;
+                        return 1;
+                    }
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+static void diffMark(unsigned char *changed, int from, int to)
+{
+    memset(changed + from, 1, to - from);
+}
+
+// flags the lines of a0..a1 and b0..b1 that are not part of a longest
+// common subsequence
+static void diffCompare(struct diffState *d, int a0, int a1, int b0, int b1)
+{
+    while (a0 < a1 && b0 < b1 && diffEqual(d, a0, b0))
+    {
+        a0++;
+        b0++;
+    }
+    while (a0 < a1 && b0 < b1 && diffEqual(d, a1 - 1, b1 - 1))
+    {
+        a1--;
+        b1--;
+    }
+
+    int split_a, split_b;
+    if (a0 == a1 || b0 == b1 ||
+        !diffBisect(d, a0, a1, b0, b1, &split_a, &split_b) ||
+        (split_a == a0 && split_b == b0) || (split_a == a1 && split_b == b1))
+    {
+        // only insertions or deletions left, or too far apart to be
+        // worth a minimal answer: everything in here changed
+        diffMark(d->a_changed, a0, a1);
+        diffMark(d->b_changed, b0, b1);
+        return;
+    }
+
+    diffCompare(d, a0, split_a, b0, split_b);
+    diffCompare(d, split_a, a1, split_b, b1);
+}
+
+// turns runs of flagged lines into hunks numbered from the top of the file
+static int diffCollect(struct editorDiff *diff, struct diffState *d, int n, int m)
+{
+    int a = 0, b = 0;
+    int cap = 0;
+
+    while (a < n || b < m)
+    {
+        if (a < n && b < m && !d->a_changed[a] && !d->b_changed[b])
+        {
+            a++;
+            b++;
+            continue;
+        }
+
+        struct editorDiffHunk hunk;
+        hunk.old_start = diff->base + a;
+        hunk.new_start = diff->base + b;
+        while (a < n && d->a_changed[a])
+            a++;
+        while (b < m && d->b_changed[b])
+            b++;
+        hunk.old_count = diff->base + a - hunk.old_start;
+        hunk.new_count = diff->base + b - hunk.new_start;
+
+        if (diff->count == cap)
+        {
+            cap = cap ? cap * 2 : 16;
+            struct editorDiffHunk *grown = realloc(diff->hunk, sizeof(*grown) * cap);
+            if (grown == NULL)
+                return -1;
+            diff->hunk = grown;
+        }
+        diff->hunk[diff->count++] = hunk;
+    }
+    return 0;
+}
+
+// compares the rows with the file they were loaded from, line by line.
+// lines that match at the start and end are skipped by comparing bytes in
+// step; only what is left between them is hashed and diffed, so a few
+// edits in a large file cost about one pass over it. the file stays mapped
+// until editorDiffFree so editorDiffOldLine can show removed lines.
+// returns 0, or -1 with errno set.
+int editorDiffFile(editorContext *ctx, struct editorDiff *diff)
+{
+    struct stat st;
+
+    memset(diff, 0, sizeof(*diff));
+    if (ctx->filename == NULL || ctx->hex)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if (ctx->compressed)
+    {
+        errno = ENOTSUP;
+        return -1;
+    }
+
+    int fd = open(ctx->filename, O_RDONLY);
+    if (fd == -1)
+        return -1;
+    if (fstat(fd, &st) == -1)
+    {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    if (st.st_size > 0)
+    {
+        diff->data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (diff->data == MAP_FAILED)
+        {
+            int saved = errno;
+            diff->data = NULL;
+            close(fd);
+            errno = saved;
+            return -1;
+        }
+        diff->size = st.st_size;
+    }
+    close(fd);
+
+    const char *data = diff->data;
+    long long size = diff->size;
+
+    // common prefix, splitting lines the way the loader does
+    long long pos = 0;
+    int first = 0;
+    while (first < ctx->numrows && pos < size)
+    {
+        const char *newline = memchr(data + pos, '\n', size - pos);
+        long long len = (newline ? newline - data : size) - pos;
+        if (newline && len > 0 && data[pos + len - 1] == '\r')
+            len--;
+        if (!diffSame(data + pos, len, &ctx->row[first]))
+            break;
+        first++;
+        pos = newline ? newline - data + 1 : size;
+    }
+
+    // common suffix, walking both backwards and stopping at the prefix
+    long long end = size;
+    int last = ctx->numrows;
+    while (last > first && end > pos)
+    {
+        long long stop = (data[end - 1] == '\n')
+                             ? end - 1
+                             : end;
+        const char *newline = memrchr(data + pos, '\n', stop - pos);
+        long long start = newline
+                              ? newline - data + 1
+                              : pos;
+        long long len = stop - start;
+        if (stop != end && len > 0 && data[stop - 1] == '\r')
+            len--;
+        if (!diffSame(data + start, len, &ctx->row[last - 1]))
+            break;
+        last--;
+        end = start;
+    }
+
+    // what is left of the file, one line at a time
+    int n = 0;
+    for (long long cnt = pos; cnt < end; n++)
+    {
+        const char *newline = memchr(data + cnt, '\n', end - cnt);
+        cnt = newline ? newline - data + 1 : end;
+    }
+    int m = last - first;
+
+    diff->base = first;
+    diff->lines = n;
+    diff->old_offset = malloc(sizeof(long long) * (n + 1));
+    diff->old_len = malloc(sizeof(int) * (n + 1));
+
+    struct diffState d;
+    d.data = data;
+    d.a_offset = diff->old_offset;
+    d.a_len = diff->old_len;
+    d.a_hash = malloc(sizeof(uint64_t) * (n + 1));
+    d.b = ctx->row + first;
+    d.b_hash = malloc(sizeof(uint64_t) * (m + 1));
+    d.a_changed = calloc(n + 1, 1);
+    d.b_changed = calloc(m + 1, 1);
+    d.v = malloc(sizeof(int) * 2 * (2 * DIFF_MAX_COST + 2));
+
+    int result = -1;
+    if (diff->old_offset && diff->old_len && d.a_hash && d.b_hash &&
+        d.a_changed && d.b_changed && d.v)
+    {
+        int line = 0;
+        while (pos < end)
+        {
+            const char *newline = memchr(data + pos, '\n', end - pos);
+            long long len = (newline ? newline - data : end) - pos;
+            if (newline && len > 0 && data[pos + len - 1] == '\r')
+                len--;
+            d.a_offset[line] = pos;
+            d.a_len[line] = len;
+            d.a_hash[line] = diffHash(data + pos, len);
+            line++;
+            pos = newline ? newline - data + 1 : end;
+        }
+        for (int cnt = 0; cnt < m; cnt++)
+            d.b_hash[cnt] = diffHash(d.b[cnt].chars, d.b[cnt].size);
+
+        diffCompare(&d, 0, n, 0, m);
+        result = diffCollect(diff, &d, n, m);
+    }
+
+    free(d.a_hash);
+    free(d.b_hash);
+    free(d.a_changed);
+    free(d.b_changed);
+    free(d.v);
+    if (result == -1)
+    {
+        editorDiffFree(diff);
+        errno = ENOMEM;
+    }
+    return result;
+}
+
+// text of line `line` of the saved file, for the lines a hunk removed.
+// returns NULL for lines outside the part that was diffed
+const char *editorDiffOldLine(struct editorDiff *diff, int line, int *len)
+{
+    line -= diff->base;
+    if (line < 0 || line >= diff->lines)
+        return NULL;
+    *len = diff->old_len[line];
+    return diff->data + diff->old_offset[line];
+}
+
+void editorDiffFree(struct editorDiff *diff)
+{
+    if (diff->data)
+        munmap(diff->data, diff->size);
+    free(diff->old_offset);
+    free(diff->old_len);
+    free(diff->hunk);
+    memset(diff, 0, sizeof(*diff));
+}
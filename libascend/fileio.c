@@ -0,0 +1,189 @@
+/*** includes ***/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "ascend.h"
+
+/***  file I/O  ***/
+
+char *editorRowsToString(editorContext *ctx, int *buffrlen)
+{
+    int totlen = 0;
+    int cnt;
+    for (cnt = 0; cnt < ctx->numrows; cnt++)
+        totlen += ctx->row[cnt].size + 1;
+    *buffrlen = totlen;
+
+    char *buffer = malloc(totlen);
+    char *ptr = buffer;
+
+    for (cnt = 0; cnt < ctx->numrows; cnt++)
+    {
+        memcpy(ptr, ctx->row[cnt].chars, ctx->row[cnt].size);
+        ptr += ctx->row[cnt].size;
+        *ptr = '\n';
+        ptr++;
+    }
+    return buffer;
+}
+
+// creates the directories leading up to `path`, for cache files
+int editorMkdirParents(const char *path)
+{
+    char buf[4096];
+    snprintf(buf, sizeof(buf), "%s", path);
+
+    for (char *p = buf + 1; *p; p++)
+    {
+        if (*p != '/')
+            continue;
+        *p = '\0';
+        if (mkdir(buf, 0755) == -1 && errno != EEXIST)
+            return -1;
+        *p = '/';
+    }
+    return 0;
+}
+
+// returns 0 on success, -1 with errno set if the file can't be read
+int editorOpen(editorContext *ctx, char *filename)
+{
+    // status bar filename
+    free(ctx->filename);
+    ctx->filename = strdup(filename);
+
+    editorSelectSyntaxHighlight(ctx);
+
+    FILE *fp = fopen(filename, "r");
+    if (!fp)
+        return -1;
+    ctx->file_bytes = 0;
+
+    if (editorIsGzip(fileno(fp)))
+    {
+        ctx->compressed = 1;
+        int result = editorOpenGzip(ctx, fileno(fp));
+        int saved = errno;
+        fclose(fp);
+        ctx->dirty = 0;
+        errno = saved;
+        return result;
+    }
+
+    // regular files come from the line cache when it has them, or are
+    // mapped and split into rows in parallel; binary files are shown in
+    // hex straight from the mapping. pipes and other special files are
+    // still read a line at a time
+    struct stat st;
+    int regular = fstat(fileno(fp), &st) == 0 && S_ISREG(st.st_mode);
+    if (regular && editorIsBinary(fileno(fp)))
+    {
+        int result = editorHexMap(ctx, fileno(fp));
+        int saved = errno;
+        fclose(fp);
+        errno = saved;
+        return result;
+    }
+    if (regular)
+    {
+        int result = 0;
+        if (editorLineCacheLoad(ctx, fileno(fp)) == -1)
+        {
+            result = editorLoadMapped(ctx, fileno(fp));
+            if (result == 0)
+                editorLineCacheWrite(ctx, fileno(fp));
+        }
+        int saved = errno;
+        fclose(fp);
+        ctx->dirty = 0;
+        errno = saved;
+        return result;
+    }
+
+    char *line = NULL;
+    ssize_t linelen;
+    size_t linecap = 0;
+    while ((linelen = getline(&line, &linecap, fp)) != -1)
+    {
+        ctx->file_bytes += linelen;
+
+        while (linelen > 0 && (line[linelen - 1] == '\n' || line[linelen - 1] == '\r'))
+            linelen--;
+        editorInsertRow(ctx, ctx->numrows, line, linelen);
+    }
+    free(line);
+    fclose(fp);
+    ctx->dirty = 0;
+    return 0;
+}
+
+// names ending in .gz are written compressed, whatever the buffer was
+// loaded from
+static int editorWriteFileGzip(editorContext *ctx)
+{
+    int fdefine = open(ctx->filename, O_RDWR | O_CREAT, 0644);
+    if (fdefine == -1)
+        return -1;
+
+    long long len = editorWriteGzip(ctx, fdefine);
+    if (len == -1 || ftruncate(fdefine, len) == -1)
+    {
+        int saved = errno;
+        close(fdefine);
+        errno = saved;
+        return -1;
+    }
+
+    close(fdefine);
+    ctx->dirty = 0;
+    return len;
+}
+
+// writes the buffer to ctx->filename, returns the byte count or -1 with
+// errno set. the caller owns prompting for a name and reporting status.
+int editorWriteFile(editorContext *ctx)
+{
+    if (ctx->filename == NULL)
+        return -1;
+    if (ctx->hex)
+        return editorHexSave(ctx);
+
+    size_t namelen = strlen(ctx->filename);
+    if (namelen > 3 && !strcmp(ctx->filename + namelen - 3, ".gz"))
+        return editorWriteFileGzip(ctx);
+
+    int len;
+    char *buffer = editorRowsToString(ctx, &len);
+
+    int fdefine = open(ctx->filename, O_RDWR | O_CREAT, 0644);
+
+    if (fdefine != -1)
+    {
+
+        if (ftruncate(fdefine, len) != -1)
+        {
+            if (write(fdefine, buffer, len) == len)
+            {
+                close(fdefine);
+                free(buffer);
+                ctx->dirty = 0;
+                return len;
+            }
+        }
+        close(fdefine);
+    }
+
+    free(buffer);
+    return -1;
+}
@@ -0,0 +1,487 @@
+/*** includes ***/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ascend.h"
+
+/***  folding  ***/
+
+// folds are found only when asked for, from the row the cursor is on: a
+// multi-line comment starting there (the open-comment state the
+// highlighter keeps per row says where it ends), the brace block it
+// opens, or else the innermost block around it. the folds themselves are
+// disjoint row ranges in order, each knowing how many rows the ones before
+// it hide, so mapping between rows and screen lines is a binary search.
+
+// the last fold starting at or before `row`, or -1
+static int foldFind(struct editorFolds *folds, int row)
+{
+    int lo = 0;
+    int hi = folds->count - 1;
+    int found = -1;
+
+    while (lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (folds->fold[mid].first <= row)
+        {
+            found = mid;
+            lo = mid + 1;
+        }
+        else
+            hi = mid - 1;
+    }
+    return found;
+}
+
+static int foldSize(struct editorFold *fold)
+{
+    return fold->last - fold->first + 1;
+}
+
+// recomputes the running count of hidden rows from fold `from` on
+static void foldRecount(struct editorFolds *folds, int from)
+{
+    for (int cnt = from; cnt < folds->count; cnt++)
+        folds->fold[cnt].hidden = (cnt == 0)
+                                      ? 0
+                                      : folds->fold[cnt - 1].hidden + foldSize(&folds->fold[cnt - 1]);
+}
+
+static void foldDrop(struct editorFolds *folds, int index)
+{
+    memmove(&folds->fold[index], &folds->fold[index + 1], sizeof(struct editorFold) * (folds->count - index - 1));
+    folds->count--;
+    foldRecount(folds, index);
+}
+
+// opens a fold, putting its rows back in the wrap index
+static void foldRemove(editorContext *ctx, int index)
+{
+    struct editorFold fold = ctx->folds.fold[index];
+    foldDrop(&ctx->folds, index);
+    editorWrapIndexRefresh(ctx, fold.first, fold.last);
+}
+
+// hides rows first..last, swallowing any folds inside them
+static int foldAdd(editorContext *ctx, int first, int last)
+{
+    struct editorFolds *folds = &ctx->folds;
+
+    for (int cnt = folds->count - 1; cnt >= 0; cnt--)
+        if (folds->fold[cnt].first <= last && folds->fold[cnt].last >= first)
+            foldRemove(ctx, cnt);
+
+    if (folds->count == folds->cap)
+    {
+        int cap = folds->cap ? folds->cap * 2 : 16;
+        struct editorFold *fold = realloc(folds->fold, sizeof(struct editorFold) * cap);
+        if (fold == NULL)
+            return -1;
+        folds->fold = fold;
+        folds->cap = cap;
+    }
+
+    int index = foldFind(folds, first) + 1;
+    memmove(&folds->fold[index + 1], &folds->fold[index], sizeof(struct editorFold) * (folds->count - index));
+    folds->fold[index].first = first;
+    folds->fold[index].last = last;
+    folds->count++;
+    foldRecount(folds, index);
+    editorWrapIndexRefresh(ctx, first, last);
+    return 0;
+}
+
+static int foldStartsWith(const char *p, int len, const char *prefix)
+{
+    int plen = prefix ? strlen(prefix) : 0;
+    return plen > 0 && plen <= len && !memcmp(p, prefix, plen);
+}
+
+// the next brace at or after column `from` of `row`, skipping strings and
+// comments as the buffer's syntax spells them, or -1. `comment` says
+// whether a multi-line comment is open and is kept up to date.
+static int foldNextBrace(struct editorSyntax *syntax, erow *row, int from, int *comment)
+{
+    char *scs = syntax ? syntax->singleline_comment_start : NULL;
+    char *mcs = syntax ? syntax->multiline_comment_start : NULL;
+    char *mce = syntax ? syntax->multiline_comment_end : NULL;
+    const char *quotes = (syntax && (syntax->flags & HL_HIGHLIGHT_STRINGS))
+                             ? (syntax->string_quotes ? syntax->string_quotes : "\"'")
+                             : "";
+    char quote = 0;
+    int cnt = from;
+
+    while (cnt < row->size)
+    {
+        char *p = &row->chars[cnt];
+        int rest = row->size - cnt;
+
+        if (*comment)
+        {
+            if (foldStartsWith(p, rest, mce))
+            {
+                *comment = 0;
+                cnt += strlen(mce);
+            }
+            else
+                cnt++;
+        }
+        else if (quote)
+        {
+            if (*p == '\\')
+                cnt++;
+            else if (*p == quote)
+                quote = 0;
+            cnt++;
+        }
+        else if (foldStartsWith(p, rest, scs))
+            return -1;
+        else if (mce && foldStartsWith(p, rest, mcs))
+        {
+            *comment = 1;
+            cnt += strlen(mcs);
+        }
+        else if (*p && strchr(quotes, *p))
+        {
+            quote = *p;
+            cnt++;
+        }
+        else if (*p == '{' || *p == '}')
+            return cnt;
+        else
+            cnt++;
+    }
+    return -1;
+}
+
+// whether row `pos` starts inside a multi-line comment
+static int foldStartComment(editorContext *ctx, int pos)
+{
+    return pos > 0 && ctx->row[pos - 1].highlight_open_comment;
+}
+
+// the row holding the brace that closes the one at (row, col), or -1.
+// `comment` is the comment state just after the opening brace
+static int foldBlockEnd(editorContext *ctx, int row, int col, int comment, int *end_col)
+{
+    int depth = 1;
+    int from = col + 1;
+
+    for (int cnt = row; cnt < ctx->numrows; cnt++)
+    {
+        erow *r = &ctx->row[cnt];
+        if (cnt > row)
+        {
+            from = 0;
+            comment = foldStartComment(ctx, cnt);
+        }
+
+        int at;
+        while ((at = foldNextBrace(ctx->syntax, r, from, &comment)) != -1)
+        {
+            depth += (r->chars[at] == '{') ? 1 : -1;
+            if (depth == 0)
+            {
+                *end_col = at;
+                return cnt;
+            }
+            from = at + 1;
+        }
+    }
+    return -1;
+}
+
+// the outermost brace left open at the end of `row`, or -1
+static int foldOpenBrace(editorContext *ctx, int row, int *comment_after)
+{
+    erow *r = &ctx->row[row];
+    int comment = foldStartComment(ctx, row);
+    int open = -1;
+    int depth = 0;
+    int at = -1;
+
+    while ((at = foldNextBrace(ctx->syntax, r, at + 1, &comment)) != -1)
+    {
+        if (r->chars[at] == '{')
+        {
+            if (depth++ == 0)
+            {
+                open = at;
+                *comment_after = comment;
+            }
+        }
+        else if (depth > 0)
+            depth--;
+    }
+    return (depth > 0)
+               ? open
+               : -1;
+}
+
+// the innermost brace still open at the start of `row`, walking back over
+// the rows above it. its row goes to `open_row`; returns the column or -1
+static int foldEnclosingBrace(editorContext *ctx, int row, int *open_row, int *comment_after)
+{
+    int *braces = NULL;
+    int cap = 0;
+    int need = 0;
+
+    for (int cnt = row - 1; cnt >= 0; cnt--)
+    {
+        erow *r = &ctx->row[cnt];
+        int comment = foldStartComment(ctx, cnt);
+        int count = 0;
+        int at = -1;
+
+        // braces can only be told apart from strings going forward, so the
+        // row is listed first and then walked backwards
+        while ((at = foldNextBrace(ctx->syntax, r, at + 1, &comment)) != -1)
+        {
+            if (count == cap)
+            {
+                cap = cap ? cap * 2 : 16;
+                int *grown = realloc(braces, sizeof(int) * cap);
+                if (grown == NULL)
+                {
+                    free(braces);
+                    return -1;
+                }
+                braces = grown;
+            }
+            braces[count++] = at;
+        }
+
+        for (int i = count - 1; i >= 0; i--)
+        {
+            if (r->chars[braces[i]] == '}')
+                need++;
+            else if (need > 0)
+                need--;
+            else
+            {
+                // replay the row up to the brace for the comment state
+                int col = braces[i];
+                comment = foldStartComment(ctx, cnt);
+                at = -1;
+                while ((at = foldNextBrace(ctx->syntax, r, at + 1, &comment)) != -1 && at != col)
+                    ;
+                *comment_after = comment;
+                *open_row = cnt;
+                free(braces);
+                return col;
+            }
+        }
+    }
+    free(braces);
+    return -1;
+}
+
+// folds the block or comment at `row`, or unfolds it when `row` already
+// heads a fold. returns the row left showing the fold (the cursor belongs
+// there when it was inside the block), or -1 when there is nothing to fold.
+int editorFoldToggle(editorContext *ctx, int row)
+{
+    if (row < 0 || row >= ctx->numrows)
+        return -1;
+
+    int index = foldFind(&ctx->folds, row + 1);
+    if (index != -1 && ctx->folds.fold[index].first == row + 1)
+    {
+        foldRemove(ctx, index);
+        return row;
+    }
+
+    // a multi-line comment opened on this row runs to the first row that
+    // doesn't end inside it
+    if (ctx->row[row].highlight_open_comment && !foldStartComment(ctx, row))
+    {
+        int end = row + 1;
+        while (end < ctx->numrows - 1 && ctx->row[end].highlight_open_comment)
+            end++;
+        if (end >= ctx->numrows || foldAdd(ctx, row + 1, end) == -1)
+            return -1;
+        return row;
+    }
+
+    int header = row;
+    int comment = 0;
+    int col = foldOpenBrace(ctx, row, &comment);
+    if (col == -1)
+        col = foldEnclosingBrace(ctx, row, &header, &comment);
+    if (col == -1)
+        return -1;
+
+    int end_col;
+    int end = foldBlockEnd(ctx, header, col, comment, &end_col);
+    if (end == -1)
+        return -1;
+
+    // the closing row stays visible when more than punctuation follows the
+    // brace, as in "} else {"
+    erow *r = &ctx->row[end];
+    for (int cnt = end_col + 1; cnt < r->size; cnt++)
+    {
+        if (!strchr(" \t;,)", r->chars[cnt]))
+        {
+            end--;
+            break;
+        }
+    }
+
+    if (end <= header || foldAdd(ctx, header + 1, end) == -1)
+        return -1;
+    return header;
+}
+
+void editorUnfoldAll(editorContext *ctx)
+{
+    int count = ctx->folds.count;
+
+    ctx->folds.count = 0;
+    for (int cnt = 0; cnt < count; cnt++)
+        editorWrapIndexRefresh(ctx, ctx->folds.fold[cnt].first, ctx->folds.fold[cnt].last);
+}
+
+void editorFoldFree(editorContext *ctx)
+{
+    free(ctx->folds.fold);
+    ctx->folds.fold = NULL;
+    ctx->folds.count = 0;
+    ctx->folds.cap = 0;
+}
+
+// unfolds whatever hides `row`
+void editorFoldReveal(editorContext *ctx, int row)
+{
+    int index = foldFind(&ctx->folds, row);
+    if (index != -1 && row <= ctx->folds.fold[index].last)
+        foldRemove(ctx, index);
+}
+
+int editorRowHidden(editorContext *ctx, int row)
+{
+    if (ctx->folds.count == 0)
+        return 0;
+
+    int index = foldFind(&ctx->folds, row);
+    return index != -1 && row <= ctx->folds.fold[index].last;
+}
+
+// rows hidden behind `row`, 0 when it heads no fold
+int editorFoldedRows(editorContext *ctx, int row)
+{
+    if (ctx->folds.count == 0)
+        return 0;
+
+    int index = foldFind(&ctx->folds, row + 1);
+    return (index != -1 && ctx->folds.fold[index].first == row + 1)
+               ? foldSize(&ctx->folds.fold[index])
+               : 0;
+}
+
+// the visible row after `row`, jumping over a fold in one step
+int editorFoldNextRow(editorContext *ctx, int row)
+{
+    row++;
+    if (ctx->folds.count == 0)
+        return row;
+
+    int index = foldFind(&ctx->folds, row);
+    return (index != -1 && row <= ctx->folds.fold[index].last)
+               ? ctx->folds.fold[index].last + 1
+               : row;
+}
+
+// the visible row before `row`: a fold's own row when `row` follows it
+int editorFoldPrevRow(editorContext *ctx, int row)
+{
+    row--;
+    if (ctx->folds.count == 0 || row < 0)
+        return row;
+
+    int index = foldFind(&ctx->folds, row);
+    return (index != -1 && row <= ctx->folds.fold[index].last)
+               ? ctx->folds.fold[index].first - 1
+               : row;
+}
+
+// the screen line `row` is on with folded rows taking none. a hidden row
+// gives the line of the row heading its fold
+int editorFoldRowToLine(editorContext *ctx, int row)
+{
+    int index = foldFind(&ctx->folds, row);
+    if (index == -1)
+        return row;
+
+    struct editorFold *fold = &ctx->folds.fold[index];
+    return (row <= fold->last)
+               ? fold->first - 1 - fold->hidden
+               : row - fold->hidden - foldSize(fold);
+}
+
+// the row shown on screen line `line`
+int editorFoldLineToRow(editorContext *ctx, int line)
+{
+    struct editorFolds *folds = &ctx->folds;
+    int lo = 0;
+    int hi = folds->count - 1;
+    int found = -1;
+
+    // the first line past fold i shows row last + 1, and sits where the
+    // fold's first row would have been
+    while (lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (folds->fold[mid].first - folds->fold[mid].hidden <= line)
+        {
+            found = mid;
+            lo = mid + 1;
+        }
+        else
+            hi = mid - 1;
+    }
+
+    return (found == -1)
+               ? line
+               : line + folds->fold[found].hidden + foldSize(&folds->fold[found]);
+}
+
+// keeps folds on the same text when the `removed` rows at `pos` were
+// replaced by `added` new ones. touching any row of a fold, or the one
+// heading it, opens it; inserting right under the heading counts. the
+// rows and the line index have already moved, but the new rows were
+// measured against the folds where they were; once every fold is settled
+// the wrap index takes those rows and what is left of each opened fold.
+void editorFoldRowsReplaced(editorContext *ctx, int pos, int removed, int added)
+{
+    struct editorFolds *folds = &ctx->folds;
+    int first = pos;
+    int last = pos + added - 1;
+
+    for (int cnt = folds->count - 1; cnt >= 0; cnt--)
+    {
+        struct editorFold *fold = &folds->fold[cnt];
+        if (pos > fold->last)
+            break;
+        if (pos + removed - 1 >= fold->first - 1)
+        {
+            if (fold->first < first)
+                first = fold->first;
+            if (fold->last + added - removed > last)
+                last = fold->last + added - removed;
+            foldDrop(folds, cnt);
+        }
+        else
+        {
+            fold->first += added - removed;
+            fold->last += added - removed;
+        }
+    }
+    editorWrapIndexRefresh(ctx, first, last);
+}
@@ -0,0 +1,156 @@
+/*** includes ***/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "ascend.h"
+
+/*** defines ***/
+#define FOLLOW_CHUNK (1 << 20)
+#define FOLLOW_EVENTS (IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF)
+
+/***  follow  ***/
+
+// starts tailing ctx->filename from the point editorOpen stopped reading.
+// the caller polls follow->inotify_fd for readability and then calls
+// editorFollowPoll. returns -1 with errno set on failure.
+int editorFollowStart(editorContext *ctx)
+{
+    if (ctx->follow)
+        return 0;
+    // appended bytes of a compressed file can't be decoded on their own
+    if (ctx->filename == NULL || ctx->compressed)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    struct editorFollow *follow = malloc(sizeof(struct editorFollow));
+    if (follow == NULL)
+        return -1;
+
+    follow->fd = open(ctx->filename, O_RDONLY);
+    follow->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (follow->fd == -1 || follow->inotify_fd == -1 ||
+        (follow->watch = inotify_add_watch(follow->inotify_fd, ctx->filename, FOLLOW_EVENTS)) == -1)
+    {
+        int saved = errno;
+        if (follow->fd != -1)
+            close(follow->fd);
+        if (follow->inotify_fd != -1)
+            close(follow->inotify_fd);
+        free(follow);
+        errno = saved;
+        return -1;
+    }
+
+    // the last row is unfinished if editorOpen's final line had no newline
+    char last = '\n';
+    follow->offset = ctx->file_bytes;
+    if (follow->offset > 0 && pread(follow->fd, &last, 1, follow->offset - 1) != 1)
+        last = '\n';
+    follow->partial = (last != '\n');
+    follow->truncated = 0;
+
+    ctx->follow = follow;
+    return 0;
+}
+
+void editorFollowStop(editorContext *ctx)
+{
+    struct editorFollow *follow = ctx->follow;
+    if (follow == NULL)
+        return;
+
+    close(follow->fd);
+    close(follow->inotify_fd);
+    free(follow);
+    ctx->follow = NULL;
+}
+
+// picks up the new file after logrotate moved or deleted the old one
+static void followReopen(editorContext *ctx, struct editorFollow *follow)
+{
+    int fd = open(ctx->filename, O_RDONLY);
+    if (fd == -1)
+        return;
+
+    inotify_rm_watch(follow->inotify_fd, follow->watch);
+    follow->watch = inotify_add_watch(follow->inotify_fd, ctx->filename, FOLLOW_EVENTS);
+
+    close(follow->fd);
+    follow->fd = fd;
+    follow->offset = 0;
+    follow->partial = 0;
+    follow->truncated = 1;
+}
+
+// drains pending inotify events and appends whatever was written since the
+// last call. returns the number of rows added, -1 on a read error.
+int editorFollowPoll(editorContext *ctx)
+{
+    struct editorFollow *follow = ctx->follow;
+    if (follow == NULL)
+        return 0;
+
+    // the events only wake us up, what changed is worked out from the file
+    char events[4096];
+    while (read(follow->inotify_fd, events, sizeof(events)) > 0)
+        ;
+
+    struct stat st;
+    struct stat path_st;
+    if (fstat(follow->fd, &st) == -1)
+        return -1;
+
+    // a different file at our path means it was rotated away underneath us
+    int replaced = stat(ctx->filename, &path_st) == 0 &&
+                   (st.st_ino != path_st.st_ino || st.st_dev != path_st.st_dev);
+
+    // copytruncate style rotation: start over from the top of the file
+    if (st.st_size < follow->offset)
+    {
+        follow->offset = 0;
+        follow->partial = 0;
+        follow->truncated = 1;
+    }
+
+    int numrows = ctx->numrows;
+    ssize_t nread;
+    char *buf = malloc(FOLLOW_CHUNK);
+    if (buf == NULL)
+        return -1;
+
+    // read the old file to its end before switching to a replacement
+    for (int pass = 0; pass < 2; pass++)
+    {
+        while ((nread = pread(follow->fd, buf, FOLLOW_CHUNK, follow->offset)) > 0)
+        {
+            follow->partial = editorAppendLines(ctx, buf, nread, follow->partial);
+            follow->offset += nread;
+            ctx->file_bytes = follow->offset;
+        }
+        if (nread == -1)
+        {
+            free(buf);
+            return -1;
+        }
+
+        if (!replaced)
+            break;
+        followReopen(ctx, follow);
+        replaced = 0;
+    }
+
+    free(buf);
+    return ctx->numrows - numrows;
+}
@@ -0,0 +1,177 @@
+/*** includes ***/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "ascend.h"
+
+/*** defines ***/
+#define GZIP_IN_CHUNK (256 * 1024)
+#define GZIP_OUT_CHUNK (1024 * 1024)
+#define GZIP_WINDOW_BITS (15 + 16) // zlib window, +16 selects the gzip wrapper
+
+/***  gzip  ***/
+
+int editorIsGzip(int fd)
+{
+    unsigned char magic[2];
+    return pread(fd, magic, 2, 0) == 2 && magic[0] == 0x1f && magic[1] == 0x8b;
+}
+
+// inflates fd chunk by chunk straight into rows, without ever holding the
+// whole decompressed file. concatenated gzip members are read back to
+// back like gunzip does. returns 0 or -1 with errno set.
+int editorOpenGzip(editorContext *ctx, int fd)
+{
+    struct stat st;
+    long long total = fstat(fd, &st) == 0
+                          ? (long long)st.st_size
+                          : 0;
+    long long done = 0;
+
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    if (inflateInit2(&strm, GZIP_WINDOW_BITS) != Z_OK)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    unsigned char *in = malloc(GZIP_IN_CHUNK);
+    unsigned char *out = malloc(GZIP_OUT_CHUNK);
+    int partial = 0;
+    int ret = Z_OK;
+    int result = 0;
+
+    if (in == NULL || out == NULL)
+    {
+        errno = ENOMEM;
+        result = -1;
+        goto done;
+    }
+
+    while (1)
+    {
+        if (strm.avail_in == 0)
+        {
+            ssize_t nread = read(fd, in, GZIP_IN_CHUNK);
+            if (nread == -1)
+            {
+                result = -1;
+                goto done;
+            }
+            if (nread == 0)
+                break;
+
+            strm.next_in = in;
+            strm.avail_in = nread;
+            done += nread;
+            if (ctx->progress)
+                ctx->progress(ctx, done, total);
+        }
+
+        // a finished member followed by more input starts the next member
+        if (ret == Z_STREAM_END)
+            inflateReset(&strm);
+
+        do
+        {
+            strm.next_out = out;
+            strm.avail_out = GZIP_OUT_CHUNK;
+            ret = inflate(&strm, Z_NO_FLUSH);
+            if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR)
+            {
+                errno = EBADMSG;
+                result = -1;
+                goto done;
+            }
+            partial = editorAppendLines(ctx, (char *)out, GZIP_OUT_CHUNK - strm.avail_out, partial);
+        } while (strm.avail_out == 0 && ret != Z_STREAM_END);
+    }
+
+    // the input ran out in the middle of a member
+    if (ret != Z_STREAM_END)
+    {
+        errno = EBADMSG;
+        result = -1;
+    }
+
+done:
+    inflateEnd(&strm);
+    free(in);
+    free(out);
+    return result;
+}
+
+static int gzipFlush(int fd, z_stream *strm, unsigned char *out, int flush, long long *written)
+{
+    do
+    {
+        strm->next_out = out;
+        strm->avail_out = GZIP_OUT_CHUNK;
+        if (deflate(strm, flush) == Z_STREAM_ERROR)
+        {
+            errno = EIO;
+            return -1;
+        }
+
+        size_t have = GZIP_OUT_CHUNK - strm->avail_out;
+        if (have && write(fd, out, have) != (ssize_t)have)
+            return -1;
+        *written += have;
+    } while (strm->avail_out == 0);
+    return 0;
+}
+
+// compresses the rows into fd as one gzip member, feeding deflate a row
+// at a time. returns the compressed size or -1 with errno set.
+long long editorWriteGzip(editorContext *ctx, int fd)
+{
+    z_stream strm;
+    memset(&strm, 0, sizeof(strm));
+    if (deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, GZIP_WINDOW_BITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+
+    unsigned char *out = malloc(GZIP_OUT_CHUNK);
+    long long written = 0;
+    long long result = -1;
+    if (out == NULL)
+    {
+        errno = ENOMEM;
+        goto done;
+    }
+
+    for (int cnt = 0; cnt < ctx->numrows; cnt++)
+    {
+        strm.next_in = (unsigned char *)ctx->row[cnt].chars;
+        strm.avail_in = ctx->row[cnt].size;
+        if (gzipFlush(fd, &strm, out, Z_NO_FLUSH, &written) == -1)
+            goto done;
+
+        strm.next_in = (unsigned char *)"\n";
+        strm.avail_in = 1;
+        if (gzipFlush(fd, &strm, out, Z_NO_FLUSH, &written) == -1)
+            goto done;
+    }
+
+    if (gzipFlush(fd, &strm, out, Z_FINISH, &written) == -1)
+        goto done;
+    result = written;
+
+done:
+    deflateEnd(&strm);
+    free(out);
+    return result;
+}
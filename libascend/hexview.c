@@ -0,0 +1,187 @@
+/*** includes ***/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ascend.h"
+
+/*** defines ***/
+#define HEX_SNIFF_BYTES 8192 // a NUL in here makes a file binary
+
+/***  hex view  ***/
+
+// text files don't contain NUL bytes; core dumps and most binaries have
+// plenty near the start
+int editorIsBinary(int fd)
+{
+    char buf[HEX_SNIFF_BYTES];
+    ssize_t len = pread(fd, buf, sizeof(buf), 0);
+    return len > 0 && memchr(buf, '\0', len) != NULL;
+}
+
+// shows the regular file `fd` as a hex view instead of rows. the file is
+// mapped copy-on-write, so patches stay private to the process until
+// editorHexSave writes the touched pages back. nothing is read up front
+// and no rows are built. returns 0, or -1 with errno set.
+int editorHexMap(editorContext *ctx, int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+        return -1;
+
+    struct editorHexView *hv = calloc(1, sizeof(*hv));
+    if (hv == NULL)
+        return -1;
+
+    hv->size = st.st_size;
+    hv->pagesize = sysconf(_SC_PAGESIZE);
+    if (hv->size > 0)
+    {
+        hv->data = mmap(NULL, hv->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        if (hv->data == MAP_FAILED)
+        {
+            free(hv);
+            return -1;
+        }
+
+        long long pages = (hv->size + hv->pagesize - 1) / hv->pagesize;
+        hv->dirty = calloc((pages + 7) / 8, 1);
+        if (hv->dirty == NULL)
+        {
+            munmap(hv->data, hv->size);
+            free(hv);
+            errno = ENOMEM;
+            return -1;
+        }
+    }
+
+    editorHexClose(ctx);
+    ctx->hex = hv;
+    ctx->file_bytes = hv->size;
+    ctx->dirty = 0;
+    return 0;
+}
+
+// opens `filename` in hex view whatever it contains
+int editorOpenHex(editorContext *ctx, char *filename)
+{
+    free(ctx->filename);
+    ctx->filename = strdup(filename);
+
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1)
+        return -1;
+
+    int result = editorHexMap(ctx, fd);
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return result;
+}
+
+void editorHexClose(editorContext *ctx)
+{
+    struct editorHexView *hv = ctx->hex;
+    if (hv == NULL)
+        return;
+
+    if (hv->size > 0)
+        munmap(hv->data, hv->size);
+    free(hv->dirty);
+    free(hv);
+    ctx->hex = NULL;
+}
+
+// overwrites the byte at `offset`. only the page holding it is marked for
+// writing back.
+int editorHexPatch(editorContext *ctx, long long offset, unsigned char value)
+{
+    struct editorHexView *hv = ctx->hex;
+    if (hv == NULL || offset < 0 || offset >= hv->size)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    long long page = offset / hv->pagesize;
+    if (!(hv->dirty[page / 8] & (1 << (page % 8))))
+    {
+        hv->dirty[page / 8] |= 1 << (page % 8);
+        hv->dirty_pages++;
+    }
+    hv->data[offset] = value;
+    ctx->dirty++;
+    return 0;
+}
+
+static int hexPageDirty(struct editorHexView *hv, long long page)
+{
+    return hv->dirty[page / 8] & (1 << (page % 8));
+}
+
+// writes runs of patched pages back to ctx->filename, leaving the rest of
+// the file alone. returns the bytes written, or -1 with errno set.
+long long editorHexSave(editorContext *ctx)
+{
+    struct editorHexView *hv = ctx->hex;
+    if (hv == NULL || ctx->filename == NULL)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if (hv->dirty_pages == 0)
+        return 0;
+
+    int fd = open(ctx->filename, O_WRONLY);
+    if (fd == -1)
+        return -1;
+
+    long long pages = (hv->size + hv->pagesize - 1) / hv->pagesize;
+    long long written = 0;
+    for (long long page = 0; page < pages; page++)
+    {
+        if (!hexPageDirty(hv, page))
+            continue;
+
+        long long first = page;
+        while (page + 1 < pages && hexPageDirty(hv, page + 1))
+            page++;
+
+        long long start = first * hv->pagesize;
+        long long end = (page + 1) * hv->pagesize;
+        if (end > hv->size)
+            end = hv->size;
+
+        while (start < end)
+        {
+            ssize_t len = pwrite(fd, hv->data + start, end - start, start);
+            if (len == -1)
+            {
+                int saved = errno;
+                close(fd);
+                errno = saved;
+                return -1;
+            }
+            start += len;
+            written += len;
+        }
+    }
+
+    if (close(fd) == -1)
+        return -1;
+
+    long long bytes = (pages + 7) / 8;
+    memset(hv->dirty, 0, bytes);
+    hv->dirty_pages = 0;
+    ctx->dirty = 0;
+    return written;
+}
@@ -0,0 +1,708 @@
+/*** includes ***/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "ascend.h"
+
+/*** defines ***/
+#define LEX_CACHE_MAGIC "ASCLEX02"
+#define LEX_CACHE_NULL 0xffffffffu // string length standing for a missing string
+#define LEX_DEFAULT_QUOTES "\"'"
+#define LEX_DEFAULT_SEPARATORS ",.()+-/*=~%<>[];"
+#define LEX_SYNTAX_SUFFIX ".syntax"
+
+/***  lexer compiler  ***/
+
+struct lexToken
+{
+    const char *text;
+    int len;
+    int kind;
+    int root;
+};
+
+static int lexFold(struct editorSyntax *syntax, int c)
+{
+    return (syntax->flags & HL_IGNORE_CASE)
+               ? tolower(c)
+               : c;
+}
+
+static void lexAddToken(struct lexToken **tokens, int *ntokens, const char *text, int len, int kind, int root)
+{
+    if (text == NULL || len <= 0)
+        return;
+
+    *tokens = realloc(*tokens, sizeof(struct lexToken) * (*ntokens + 1));
+    (*tokens)[*ntokens].text = text;
+    (*tokens)[*ntokens].len = len;
+    (*tokens)[*ntokens].kind = kind;
+    (*tokens)[*ntokens].root = root;
+    (*ntokens)++;
+}
+
+// builds the character class table and the keyword/comment trie for a
+// syntax definition. keywords ending in '|' are secondary keywords, as in
+// HLDB. returns NULL if out of memory.
+struct editorLexer *editorCompileSyntax(struct editorSyntax *syntax)
+{
+    struct lexToken *tokens = NULL;
+    int ntokens = 0;
+    int cnt;
+
+    for (cnt = 0; syntax->keywords && syntax->keywords[cnt]; cnt++)
+    {
+        char *kw = syntax->keywords[cnt];
+        int klen = strlen(kw);
+        int kw2 = klen > 0 && kw[klen - 1] == '|';
+
+        lexAddToken(&tokens, &ntokens, kw, kw2 ? klen - 1 : klen,
+                    kw2 ? LEX_KEYWORD2 : LEX_KEYWORD1, LEX_ROOT);
+    }
+
+    char *scs = syntax->singleline_comment_start;
+    char *mcs = syntax->multiline_comment_start;
+    char *mce = syntax->multiline_comment_end;
+
+    if (scs)
+        lexAddToken(&tokens, &ntokens, scs, strlen(scs), LEX_COMMENT, LEX_ROOT);
+    if (mcs && mce && *mcs && *mce)
+    {
+        lexAddToken(&tokens, &ntokens, mcs, strlen(mcs), LEX_MLCOMMENT_START, LEX_ROOT);
+        lexAddToken(&tokens, &ntokens, mce, strlen(mce), LEX_MLCOMMENT_END, LEX_ROOT_COMMENT);
+    }
+
+    struct editorLexer *lex = calloc(1, sizeof(struct editorLexer));
+    if (lex == NULL)
+    {
+        free(tokens);
+        return NULL;
+    }
+
+    const char *separators = syntax->separators
+                                 ? syntax->separators
+                                 : LEX_DEFAULT_SEPARATORS;
+    const char *quotes = syntax->string_quotes
+                             ? syntax->string_quotes
+                             : LEX_DEFAULT_QUOTES;
+
+    for (cnt = 0; cnt < 256; cnt++)
+    {
+        if (cnt == 0 || isspace(cnt) || strchr(separators, cnt))
+            lex->cls[cnt] |= LEX_SEPARATOR;
+        if (isdigit(cnt))
+            lex->cls[cnt] |= LEX_DIGIT;
+    }
+    for (cnt = 0; quotes[cnt]; cnt++)
+        lex->cls[(unsigned char)quotes[cnt]] |= LEX_QUOTE;
+
+    // one column per distinct byte used by any token; with HL_IGNORE_CASE
+    // both cases share a column so matching needs no folding at run time
+    int chars = 0;
+    lex->nsyms = 1;
+    for (cnt = 0; cnt < ntokens; cnt++)
+    {
+        for (int i = 0; i < tokens[cnt].len; i++)
+        {
+            int c = lexFold(syntax, (unsigned char)tokens[cnt].text[i]);
+            if (lex->sym[c] == 0)
+            {
+                lex->sym[c] = lex->nsyms++;
+                if (syntax->flags & HL_IGNORE_CASE)
+                    lex->sym[toupper(c)] = lex->sym[c];
+            }
+        }
+        chars += tokens[cnt].len;
+    }
+
+    int maxstates = 2 + chars;
+    lex->next = calloc((size_t)maxstates * lex->nsyms, sizeof(int));
+    lex->accept = calloc(maxstates, 1);
+    if (lex->next == NULL || lex->accept == NULL)
+    {
+        free(lex->next);
+        free(lex->accept);
+        free(lex);
+        free(tokens);
+        return NULL;
+    }
+
+    lex->nstates = 2;
+    for (cnt = 0; cnt < ntokens; cnt++)
+    {
+        int state = tokens[cnt].root;
+        for (int i = 0; i < tokens[cnt].len; i++)
+        {
+            int sym = lex->sym[lexFold(syntax, (unsigned char)tokens[cnt].text[i])];
+            int *edge = &lex->next[state * lex->nsyms + sym];
+            if (*edge == 0)
+                *edge = lex->nstates++;
+            state = *edge;
+        }
+        if (lex->accept[state] == LEX_NONE)
+            lex->accept[state] = tokens[cnt].kind;
+    }
+
+    lex->next = realloc(lex->next, sizeof(int) * lex->nstates * lex->nsyms);
+    lex->accept = realloc(lex->accept, lex->nstates);
+    free(tokens);
+    return lex;
+}
+
+// runs the trie from `root` over s and returns the length of the longest
+// token that may start here (0 if none), storing its kind. keywords only
+// count when they are delimited by separators on both sides.
+int editorLexMatch(struct editorLexer *lex, int root, const char *s, int len, int prev_separator, int *kind)
+{
+    int state = root;
+    int best = 0;
+    *kind = LEX_NONE;
+
+    for (int cnt = 0; cnt < len; cnt++)
+    {
+        int sym = lex->sym[(unsigned char)s[cnt]];
+        if (sym == 0)
+            break;
+
+        state = lex->next[state * lex->nsyms + sym];
+        if (state == 0)
+            break;
+
+        int accept = lex->accept[state];
+        if (accept == LEX_NONE)
+            continue;
+
+        if ((accept == LEX_KEYWORD1 || accept == LEX_KEYWORD2) &&
+            (!prev_separator ||
+             (cnt + 1 < len && !(lex->cls[(unsigned char)s[cnt + 1]] & LEX_SEPARATOR))))
+            continue;
+
+        best = cnt + 1;
+        *kind = accept;
+    }
+    return best;
+}
+
+/***  syntax files  ***/
+
+static void lexFreeList(char **list)
+{
+    for (int cnt = 0; list && list[cnt]; cnt++)
+        free(list[cnt]);
+    free(list);
+}
+
+static void lexFreeSyntax(struct editorSyntax *syntax)
+{
+    if (syntax == NULL)
+        return;
+
+    free(syntax->filetype);
+    lexFreeList(syntax->filematch);
+    lexFreeList(syntax->keywords);
+    free(syntax->singleline_comment_start);
+    free(syntax->multiline_comment_start);
+    free(syntax->multiline_comment_end);
+    free(syntax->string_quotes);
+    free(syntax->separators);
+    if (syntax->lexer)
+    {
+        free(syntax->lexer->next);
+        free(syntax->lexer->accept);
+        free(syntax->lexer);
+    }
+    free(syntax);
+}
+
+static char **syntaxAppendWord(char **list, int *len, const char *word)
+{
+    list = realloc(list, sizeof(char *) * (*len + 2));
+    list[(*len)++] = strdup(word);
+    list[*len] = NULL;
+    return list;
+}
+
+// parses one definition file. each line is a key followed by
+// whitespace separated values, lines starting with '#' are ignored:
+//
+//   filetype go
+//   extensions .go
+//   match Makefile
+//   keywords func if else
+//   types int string
+//   comment //
+//   multiline /* */
+//   strings "'`
+//   separators ,.()+-/*=~%<>[];:
+//   numbers
+//   ignorecase
+//
+// returns NULL with errno set (EINVAL for a malformed file)
+struct editorSyntax *editorParseSyntaxFile(const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    if (!fp)
+        return NULL;
+
+    struct editorSyntax *syntax = calloc(1, sizeof(struct editorSyntax));
+    int nmatch = 0;
+    int nkeywords = 0;
+
+    char *line = NULL;
+    size_t linecap = 0;
+    while (getline(&line, &linecap, fp) != -1)
+    {
+        char *save;
+        char *key = strtok_r(line, " \t\r\n", &save);
+        if (key == NULL || key[0] == '#')
+            continue;
+
+        char *word;
+        if (!strcmp(key, "filetype") && (word = strtok_r(NULL, " \t\r\n", &save)))
+        {
+            free(syntax->filetype);
+            syntax->filetype = strdup(word);
+        }
+        else if (!strcmp(key, "extensions") || !strcmp(key, "match"))
+        {
+            while ((word = strtok_r(NULL, " \t\r\n", &save)))
+                syntax->filematch = syntaxAppendWord(syntax->filematch, &nmatch, word);
+        }
+        else if (!strcmp(key, "keywords") || !strcmp(key, "types"))
+        {
+            int types = !strcmp(key, "types");
+            while ((word = strtok_r(NULL, " \t\r\n", &save)))
+            {
+                char buf[128];
+                snprintf(buf, sizeof(buf), "%s%s", word, types ? "|" : "");
+                syntax->keywords = syntaxAppendWord(syntax->keywords, &nkeywords, buf);
+            }
+        }
+        else if (!strcmp(key, "comment") && (word = strtok_r(NULL, " \t\r\n", &save)))
+        {
+            free(syntax->singleline_comment_start);
+            syntax->singleline_comment_start = strdup(word);
+        }
+        else if (!strcmp(key, "multiline"))
+        {
+            char *start = strtok_r(NULL, " \t\r\n", &save);
+            char *end = strtok_r(NULL, " \t\r\n", &save);
+            if (start && end)
+            {
+                free(syntax->multiline_comment_start);
+                free(syntax->multiline_comment_end);
+                syntax->multiline_comment_start = strdup(start);
+                syntax->multiline_comment_end = strdup(end);
+            }
+        }
+        else if (!strcmp(key, "strings"))
+        {
+            syntax->flags |= HL_HIGHLIGHT_STRINGS;
+            if ((word = strtok_r(NULL, " \t\r\n", &save)))
+            {
+                free(syntax->string_quotes);
+                syntax->string_quotes = strdup(word);
+            }
+        }
+        else if (!strcmp(key, "separators") && (word = strtok_r(NULL, " \t\r\n", &save)))
+        {
+            free(syntax->separators);
+            syntax->separators = strdup(word);
+        }
+        else if (!strcmp(key, "numbers"))
+            syntax->flags |= HL_HIGHLIGHT_NUMBERS;
+        else if (!strcmp(key, "ignorecase"))
+            syntax->flags |= HL_IGNORE_CASE;
+    }
+    free(line);
+    fclose(fp);
+
+    if (syntax->filetype == NULL || syntax->filematch == NULL)
+    {
+        lexFreeSyntax(syntax);
+        errno = EINVAL;
+        return NULL;
+    }
+    return syntax;
+}
+
+/***  compiled syntax cache  ***/
+
+// the cache holds every definition in a directory along with its compiled
+// tables. it's only trusted when the fingerprint of the directory path and listing
+// (name, size, mtime and inode of each definition) matches the one it was
+// written for, so editing or adding a definition rebuilds it.
+
+struct lexCacheReader
+{
+    char *data;
+    size_t len;
+    size_t pos;
+};
+
+static uint64_t lexFnv(uint64_t hash, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    for (size_t cnt = 0; cnt < len; cnt++)
+    {
+        hash ^= p[cnt];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static int lexCompareNames(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static char **lexListDir(const char *dir, int *count, uint64_t *fingerprint)
+{
+    DIR *dp = opendir(dir);
+    if (dp == NULL)
+        return NULL;
+
+    char **names = NULL;
+    int len = 0;
+    struct dirent *ent;
+    size_t suffix = strlen(LEX_SYNTAX_SUFFIX);
+
+    while ((ent = readdir(dp)))
+    {
+        size_t nlen = strlen(ent->d_name);
+        if (nlen > suffix && !strcmp(ent->d_name + nlen - suffix, LEX_SYNTAX_SUFFIX))
+            names = syntaxAppendWord(names, &len, ent->d_name);
+    }
+    closedir(dp);
+
+    if (len)
+        qsort(names, len, sizeof(char *), lexCompareNames);
+
+    uint64_t hash = lexFnv(14695981039346656037ULL, LEX_CACHE_MAGIC, 8);
+    hash = lexFnv(hash, dir, strlen(dir) + 1);
+    for (int cnt = 0; cnt < len; cnt++)
+    {
+        char path[4096];
+        struct stat st;
+        snprintf(path, sizeof(path), "%s/%s", dir, names[cnt]);
+        if (stat(path, &st) == -1)
+            continue;
+
+        long long meta[4] = {st.st_size, st.st_mtim.tv_sec, st.st_mtim.tv_nsec, st.st_ino};
+        hash = lexFnv(hash, names[cnt], strlen(names[cnt]) + 1);
+        hash = lexFnv(hash, meta, sizeof(meta));
+    }
+
+    *count = len;
+    *fingerprint = hash;
+    return names;
+}
+
+// writes a length and the bytes, or LEX_CACHE_NULL for a NULL string
+static void lexWriteString(FILE *fp, const char *s)
+{
+    uint32_t len = s
+                       ? strlen(s)
+                       : LEX_CACHE_NULL;
+    fwrite(&len, sizeof(len), 1, fp);
+    if (s)
+        fwrite(s, 1, len, fp);
+}
+
+// a count followed by the strings of a NULL-terminated list
+static void lexWriteList(FILE *fp, char **list)
+{
+    uint32_t n = 0;
+    while (list && list[n])
+        n++;
+    fwrite(&n, sizeof(n), 1, fp);
+    for (uint32_t cnt = 0; cnt < n; cnt++)
+        lexWriteString(fp, list[cnt]);
+}
+
+static void lexWriteCache(const char *cachefile, uint64_t fingerprint, struct editorSyntax **syntaxes, int count)
+{
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.%d", cachefile, (int)getpid());
+
+    if (editorMkdirParents(cachefile) == -1)
+        return;
+
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp)
+        return;
+
+    uint32_t n = count;
+    fwrite(LEX_CACHE_MAGIC, 1, 8, fp);
+    fwrite(&fingerprint, sizeof(fingerprint), 1, fp);
+    fwrite(&n, sizeof(n), 1, fp);
+
+    for (int cnt = 0; cnt < count; cnt++)
+    {
+        struct editorSyntax *syntax = syntaxes[cnt];
+        struct editorLexer *lex = syntax->lexer;
+
+        lexWriteString(fp, syntax->filetype);
+        lexWriteList(fp, syntax->filematch);
+        lexWriteList(fp, syntax->keywords);
+        lexWriteString(fp, syntax->singleline_comment_start);
+        lexWriteString(fp, syntax->multiline_comment_start);
+        lexWriteString(fp, syntax->multiline_comment_end);
+        lexWriteString(fp, syntax->string_quotes);
+        lexWriteString(fp, syntax->separators);
+
+        int32_t header[3] = {syntax->flags, lex->nsyms, lex->nstates};
+        fwrite(header, sizeof(header), 1, fp);
+        fwrite(lex->cls, 1, 256, fp);
+        fwrite(lex->sym, 1, 256, fp);
+        fwrite(lex->next, sizeof(int), (size_t)lex->nstates * lex->nsyms, fp);
+        fwrite(lex->accept, 1, lex->nstates, fp);
+    }
+
+    if (fclose(fp) == 0)
+        rename(tmp, cachefile);
+    else
+        unlink(tmp);
+}
+
+static void *lexRead(struct lexCacheReader *r, size_t len)
+{
+    if (r->len - r->pos < len)
+        return NULL;
+    void *p = r->data + r->pos;
+    r->pos += len;
+    return p;
+}
+
+// reads a string written by lexWriteString. returns 0, or -1 when the
+// cache is damaged or memory ran out
+static int lexReadString(struct lexCacheReader *r, char **out)
+{
+    uint32_t len;
+    void *p = lexRead(r, sizeof(len));
+    if (p == NULL)
+        return -1;
+    memcpy(&len, p, sizeof(len));
+
+    *out = NULL;
+    if (len == LEX_CACHE_NULL)
+        return 0;
+
+    char *s = lexRead(r, len);
+    if (s == NULL || memchr(s, '\0', len))
+        return -1;
+    *out = strndup(s, len);
+    return *out
+               ? 0
+               : -1;
+}
+
+static int lexReadList(struct lexCacheReader *r, char ***out)
+{
+    uint32_t n;
+    void *p = lexRead(r, sizeof(n));
+    if (p == NULL)
+        return -1;
+    memcpy(&n, p, sizeof(n));
+
+    // every entry takes at least its length, which bounds the count
+    *out = NULL;
+    if (n > (r->len - r->pos) / sizeof(uint32_t))
+        return -1;
+    if ((*out = calloc((size_t)n + 1, sizeof(char *))) == NULL)
+        return -1;
+    for (uint32_t cnt = 0; cnt < n; cnt++)
+        if (lexReadString(r, &(*out)[cnt]) == -1 || (*out)[cnt] == NULL)
+            return -1;
+    return 0;
+}
+
+// decodes one definition into `syntax`, checking every table entry so a
+// damaged cache can't send editorLexMatch outside its tables. returns 0,
+// or -1 when the entry is damaged or memory ran out
+static int lexReadSyntax(struct lexCacheReader *r, struct editorSyntax *syntax)
+{
+    int32_t header[3];
+    void *p;
+
+    if (lexReadString(r, &syntax->filetype) == -1 || syntax->filetype == NULL ||
+        lexReadList(r, &syntax->filematch) == -1 || syntax->filematch[0] == NULL ||
+        lexReadList(r, &syntax->keywords) == -1 ||
+        lexReadString(r, &syntax->singleline_comment_start) == -1 ||
+        lexReadString(r, &syntax->multiline_comment_start) == -1 ||
+        lexReadString(r, &syntax->multiline_comment_end) == -1 ||
+        lexReadString(r, &syntax->string_quotes) == -1 ||
+        lexReadString(r, &syntax->separators) == -1 ||
+        (p = lexRead(r, sizeof(header))) == NULL)
+        return -1;
+    memcpy(header, p, sizeof(header));
+
+    struct editorLexer *lex = calloc(1, sizeof(struct editorLexer));
+    if (lex == NULL)
+        return -1;
+    syntax->lexer = lex;
+    syntax->flags = header[0];
+    lex->nsyms = header[1];
+    lex->nstates = header[2];
+    if (lex->nsyms < 1 || lex->nsyms > 256 || lex->nstates < 2 || lex->nstates > INT32_MAX / 256)
+        return -1;
+
+    size_t cells = (size_t)lex->nstates * lex->nsyms;
+    void *cls = lexRead(r, 256);
+    void *sym = lexRead(r, 256);
+    void *next = lexRead(r, sizeof(int) * cells);
+    void *accept = lexRead(r, lex->nstates);
+    if (!cls || !sym || !next || !accept)
+        return -1;
+
+    lex->next = malloc(sizeof(int) * cells);
+    lex->accept = malloc(lex->nstates);
+    if (lex->next == NULL || lex->accept == NULL)
+        return -1;
+    memcpy(lex->cls, cls, 256);
+    memcpy(lex->sym, sym, 256);
+    memcpy(lex->next, next, sizeof(int) * cells);
+    memcpy(lex->accept, accept, lex->nstates);
+
+    for (int cnt = 0; cnt < 256; cnt++)
+        if (lex->sym[cnt] >= lex->nsyms)
+            return -1;
+    for (size_t cnt = 0; cnt < cells; cnt++)
+        if (lex->next[cnt] < 0 || lex->next[cnt] >= lex->nstates)
+            return -1;
+    for (int cnt = 0; cnt < lex->nstates; cnt++)
+        if (lex->accept[cnt] > LEX_MLCOMMENT_END)
+            return -1;
+    return 0;
+}
+
+// registers every syntax in the cache, returns the count or -1 if the
+// cache is missing, stale or damaged
+static int lexReadCache(const char *cachefile, uint64_t fingerprint)
+{
+    FILE *fp = fopen(cachefile, "rb");
+    if (!fp)
+        return -1;
+
+    struct lexCacheReader r = {NULL, 0, 0};
+    struct stat st;
+    if (fstat(fileno(fp), &st) == -1 || (r.data = malloc(st.st_size)) == NULL ||
+        fread(r.data, 1, st.st_size, fp) != (size_t)st.st_size)
+    {
+        free(r.data);
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+    r.len = st.st_size;
+
+    uint64_t cached_fingerprint;
+    uint32_t count;
+    char *magic = lexRead(&r, 8);
+    void *p = lexRead(&r, sizeof(cached_fingerprint));
+    void *q = lexRead(&r, sizeof(count));
+    if (!magic || !p || !q || memcmp(magic, LEX_CACHE_MAGIC, 8))
+    {
+        free(r.data);
+        return -1;
+    }
+    memcpy(&cached_fingerprint, p, sizeof(cached_fingerprint));
+    memcpy(&count, q, sizeof(count));
+
+    // an entry takes far more than a byte, so a count past the bytes left
+    // can only come from a damaged file
+    struct editorSyntax **syntaxes = NULL;
+    if (cached_fingerprint != fingerprint || count > r.len - r.pos ||
+        (syntaxes = calloc((size_t)count + 1, sizeof(struct editorSyntax *))) == NULL)
+    {
+        free(r.data);
+        return -1;
+    }
+
+    // decode everything before registering anything so a damaged cache
+    // doesn't leave half the languages registered
+    uint32_t cnt;
+    for (cnt = 0; cnt < count; cnt++)
+    {
+        if ((syntaxes[cnt] = calloc(1, sizeof(struct editorSyntax))) == NULL ||
+            lexReadSyntax(&r, syntaxes[cnt]) == -1)
+            break;
+    }
+    free(r.data);
+
+    if (cnt < count)
+    {
+        for (cnt = 0; cnt < count; cnt++)
+            lexFreeSyntax(syntaxes[cnt]);
+        free(syntaxes);
+        return -1;
+    }
+
+    for (cnt = 0; cnt < count; cnt++)
+        editorRegisterSyntax(syntaxes[cnt]);
+    free(syntaxes);
+    return count;
+}
+
+// loads every *.syntax definition in `dir`. compiled tables come from
+// `cachefile` when it's current, otherwise the definitions are parsed and
+// compiled and the cache is rewritten. cachefile may be NULL. returns the
+// number of syntaxes registered, -1 if the directory can't be read.
+int editorLoadSyntaxDir(const char *dir, const char *cachefile)
+{
+    int count;
+    uint64_t fingerprint;
+    char **names = lexListDir(dir, &count, &fingerprint);
+    if (names == NULL)
+        return -1;
+
+    int loaded = -1;
+    if (cachefile)
+        loaded = lexReadCache(cachefile, fingerprint);
+
+    if (loaded == -1)
+    {
+        struct editorSyntax **syntaxes = malloc(sizeof(struct editorSyntax *) * (count + 1));
+        loaded = 0;
+
+        for (int cnt = 0; cnt < count; cnt++)
+        {
+            char path[4096];
+            snprintf(path, sizeof(path), "%s/%s", dir, names[cnt]);
+
+            struct editorSyntax *syntax = editorParseSyntaxFile(path);
+            if (syntax == NULL)
+                continue;
+            if ((syntax->lexer = editorCompileSyntax(syntax)) == NULL)
+            {
+                lexFreeSyntax(syntax);
+                continue;
+            }
+
+            editorRegisterSyntax(syntax);
+            syntaxes[loaded++] = syntax;
+        }
+
+        if (cachefile)
+            lexWriteCache(cachefile, fingerprint, syntaxes, loaded);
+        free(syntaxes);
+    }
+
+    for (int cnt = 0; cnt < count; cnt++)
+        free(names[cnt]);
+    free(names);
+    return loaded;
+}
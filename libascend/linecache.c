@@ -0,0 +1,304 @@
+/*** includes ***/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ascend.h"
+
+/*** defines ***/
+#define LINE_CACHE_MAGIC "ASCLIN01"
+#define LINE_CACHE_MIN_BYTES (1 << 20) // smaller files load fast enough
+
+/*** data ***/
+
+// a cache entry is this header, the byte offset where each row starts and
+// one open-comment bit per row. the bits cost less than the offsets do,
+// so every row gets one instead of keeping checkpoints and replaying the
+// highlighter between them.
+struct lineCacheHeader
+{
+    char magic[8];
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint64_t ino;
+    uint64_t dev;
+    uint64_t syntax;
+    uint64_t numrows;
+};
+
+static char line_cache_dir[PATH_MAX];
+
+/***  line cache  ***/
+
+// entries are kept in `dir`, one file per path. NULL turns the cache off
+void editorSetLineCacheDir(const char *dir)
+{
+    snprintf(line_cache_dir, sizeof(line_cache_dir), "%s", dir ? dir : "");
+}
+
+static uint64_t lineCacheFnv(uint64_t hash, const void *data, size_t len)
+{
+    const unsigned char *p = data;
+    for (size_t cnt = 0; cnt < len; cnt++)
+    {
+        hash ^= p[cnt];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static uint64_t lineCacheHashString(uint64_t hash, const char *s)
+{
+    return s
+               ? lineCacheFnv(hash, s, strlen(s) + 1)
+               : lineCacheFnv(hash, "", 1);
+}
+
+// the comment state of a row depends on how the syntax spells comments
+// and strings, so a cache written under another definition is stale
+static uint64_t lineCacheSyntaxHash(struct editorSyntax *syntax)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    if (syntax == NULL)
+        return hash;
+
+    hash = lineCacheHashString(hash, syntax->filetype);
+    hash = lineCacheHashString(hash, syntax->singleline_comment_start);
+    hash = lineCacheHashString(hash, syntax->multiline_comment_start);
+    hash = lineCacheHashString(hash, syntax->multiline_comment_end);
+    hash = lineCacheHashString(hash, syntax->string_quotes);
+    return lineCacheFnv(hash, &syntax->flags, sizeof(syntax->flags));
+}
+
+static int lineCachePath(editorContext *ctx, char *buf, size_t bufsize)
+{
+    char real[PATH_MAX];
+
+    if (line_cache_dir[0] == '\0' || ctx->filename == NULL)
+        return -1;
+    if (realpath(ctx->filename, real) == NULL)
+        return -1;
+
+    uint64_t hash = lineCacheHashString(14695981039346656037ULL, real);
+    snprintf(buf, bufsize, "%s/%016llx.lines", line_cache_dir, (unsigned long long)hash);
+    return 0;
+}
+
+static void lineCacheFillHeader(editorContext *ctx, struct stat *st, struct lineCacheHeader *hdr)
+{
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->magic, LINE_CACHE_MAGIC, 8);
+    hdr->size = st->st_size;
+    hdr->mtime_sec = st->st_mtim.tv_sec;
+    hdr->mtime_nsec = st->st_mtim.tv_nsec;
+    hdr->ino = st->st_ino;
+    hdr->dev = st->st_dev;
+    hdr->syntax = lineCacheSyntaxHash(ctx->syntax);
+}
+
+// fills an empty buffer from the cache entry for the open file `fd`. rows
+// get their chars and comment state but are rendered and highlighted only
+// when something looks at them. returns -1 when there is no usable entry.
+int editorLineCacheLoad(editorContext *ctx, int fd)
+{
+    char path[PATH_MAX + 32];
+    struct stat st;
+    struct stat cst;
+    struct lineCacheHeader want;
+    struct lineCacheHeader *hdr;
+
+    if (ctx->numrows != 0 || fstat(fd, &st) == -1 || st.st_size < LINE_CACHE_MIN_BYTES)
+        return -1;
+    if (lineCachePath(ctx, path, sizeof(path)) == -1)
+        return -1;
+
+    int cfd = open(path, O_RDONLY);
+    if (cfd == -1)
+        return -1;
+    if (fstat(cfd, &cst) == -1 || (size_t)cst.st_size < sizeof(*hdr))
+    {
+        close(cfd);
+        return -1;
+    }
+
+    void *cache = mmap(NULL, cst.st_size, PROT_READ, MAP_PRIVATE, cfd, 0);
+    close(cfd);
+    if (cache == MAP_FAILED)
+        return -1;
+
+    hdr = cache;
+    lineCacheFillHeader(ctx, &st, &want);
+    want.numrows = hdr->numrows;
+
+    uint64_t n = hdr->numrows;
+    size_t words = (n + 63) / 64;
+    if (memcmp(hdr, &want, sizeof(want)) != 0 ||
+        n == 0 || n > INT_MAX ||
+        (size_t)cst.st_size != sizeof(*hdr) + n * sizeof(uint64_t) + words * sizeof(uint64_t))
+    {
+        munmap(cache, cst.st_size);
+        return -1;
+    }
+
+    const uint64_t *offsets = (const uint64_t *)(hdr + 1);
+    const uint64_t *comments = offsets + n;
+    const char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    erow *rows = malloc(sizeof(erow) * n);
+    int valid = (data != MAP_FAILED && rows && offsets[0] == 0);
+
+    for (uint64_t cnt = 1; valid && cnt < n; cnt++)
+        valid = offsets[cnt] > offsets[cnt - 1] && offsets[cnt] <= (uint64_t)st.st_size;
+
+    if (!valid)
+    {
+        free(rows);
+        if (data != MAP_FAILED)
+            munmap((void *)data, st.st_size);
+        munmap(cache, cst.st_size);
+        return -1;
+    }
+
+    for (uint64_t cnt = 0; cnt < n; cnt++)
+    {
+        size_t start = offsets[cnt];
+        size_t end = (cnt + 1 < n)
+                         ? offsets[cnt + 1]
+                         : (size_t)st.st_size;
+        size_t len = end - start;
+        if (len > 0 && data[end - 1] == '\n')
+        {
+            len--;
+            if (len > 0 && data[start + len - 1] == '\r')
+                len--;
+        }
+
+        erow *row = &rows[cnt];
+        row->index = cnt;
+        row->size = len;
+        row->chars = malloc(len + 1);
+        if (row->chars == NULL)
+        {
+            // out of memory: drop what was built and let the caller load
+            // the file itself
+            for (uint64_t done = 0; done < cnt; done++)
+            {
+                ctx->stats.row_bytes -= rows[done].size + 1;
+                free(rows[done].chars);
+            }
+            free(rows);
+            munmap((void *)data, st.st_size);
+            munmap(cache, cst.st_size);
+            return -1;
+        }
+        memcpy(row->chars, &data[start], len);
+        row->chars[len] = '\0';
+        row->rowsize = 0;
+        row->render = NULL;
+        row->highlight = NULL;
+        row->highlight_open_comment = (comments[cnt / 64] >> (cnt % 64)) & 1;
+        row->width = 0;
+        row->ncp = 0;
+        row->match_stamp = 0;
+        row->cp = NULL;
+        row->bracket_net = 0;
+        row->bracket_min = 1;
+        ctx->stats.row_bytes += len + 1;
+    }
+
+    munmap((void *)data, st.st_size);
+    munmap(cache, cst.st_size);
+
+    free(ctx->row);
+    ctx->row = rows;
+    ctx->numrows = n;
+    ctx->lines.valid = 0;
+    ctx->wrap.valid = 0;
+    ctx->brackets.valid = 0;
+    ctx->file_bytes = st.st_size;
+    return 0;
+}
+
+// records where each row of a freshly loaded buffer starts in `fd`, and
+// its comment state, for the next time the same file is opened
+void editorLineCacheWrite(editorContext *ctx, int fd)
+{
+    char path[PATH_MAX + 32];
+    char tmp[PATH_MAX + 48];
+    struct stat st;
+    struct lineCacheHeader hdr;
+
+    if (ctx->numrows == 0 || fstat(fd, &st) == -1 || st.st_size < LINE_CACHE_MIN_BYTES)
+        return;
+    if (lineCachePath(ctx, path, sizeof(path)) == -1)
+        return;
+
+    const char *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+        return;
+
+    size_t words = (ctx->numrows + 63) / 64;
+    uint64_t *offsets = malloc(sizeof(uint64_t) * (ctx->numrows + words));
+    if (offsets == NULL)
+    {
+        munmap((void *)data, st.st_size);
+        return;
+    }
+    uint64_t *comments = offsets + ctx->numrows;
+    memset(comments, 0, sizeof(uint64_t) * words);
+
+    // rows lost their newline and any \r before it, so walk the file
+    // alongside them to find where each one really started
+    size_t pos = 0;
+    size_t size = st.st_size;
+    for (int cnt = 0; cnt < ctx->numrows && pos <= size; cnt++)
+    {
+        offsets[cnt] = pos;
+        pos += ctx->row[cnt].size;
+        if (pos < size && data[pos] == '\r')
+            pos++;
+        if (pos < size && data[pos] == '\n')
+            pos++;
+        if (ctx->row[cnt].highlight_open_comment)
+            comments[cnt / 64] |= 1ULL << (cnt % 64);
+    }
+    munmap((void *)data, st.st_size);
+
+    // the rows no longer match the file, e.g. it changed during the load
+    if (pos != size)
+    {
+        free(offsets);
+        return;
+    }
+
+    lineCacheFillHeader(ctx, &st, &hdr);
+    hdr.numrows = ctx->numrows;
+
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+    FILE *fp = (editorMkdirParents(path) == 0)
+                   ? fopen(tmp, "wb")
+                   : NULL;
+    if (fp == NULL)
+    {
+        free(offsets);
+        return;
+    }
+
+    int ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1 &&
+             fwrite(offsets, sizeof(uint64_t), ctx->numrows + words, fp) == ctx->numrows + words;
+    ok &= (fclose(fp) == 0);
+    if (!ok || rename(tmp, path) == -1)
+        unlink(tmp);
+    free(offsets);
+}
@@ -0,0 +1,554 @@
+/*** includes ***/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ascend.h"
+
+/***  line index  ***/
+
+// screen lines a row takes when wrapped at `width` columns. an empty row
+// still takes one.
+int editorRowWrapCount(erow *row, int width)
+{
+    int cols = editorRowWidth(row);
+    return (cols <= width)
+               ? 1
+               : (cols + width - 1) / width;
+}
+
+// what the index sums for a row: bytes it takes in the file, its newline
+// included, or screen lines for the wrap index, where folded rows take none
+static int lineIndexValue(editorContext *ctx, struct editorLineIndex *index, int pos)
+{
+    if (index->width == 0)
+        return ctx->row[pos].size + 1;
+    return editorRowHidden(ctx, pos)
+               ? 0
+               : editorRowWrapCount(&ctx->row[pos], index->width);
+}
+
+// sum of the first `count` blocks
+static long long lineIndexBlockPrefix(struct editorLineIndex *index, int count)
+{
+    long long sum = 0;
+    for (int i = count; i > 0; i -= i & -i)
+        sum += index->sums[i];
+    return sum;
+}
+
+static void lineIndexBlockAdd(struct editorLineIndex *index, int b, int rows, long long delta)
+{
+    for (int i = b + 1; i <= index->nblocks; i += i & -i)
+    {
+        index->counts[i] += rows;
+        index->sums[i] += delta;
+    }
+}
+
+// O(blocks), after blocks were added or removed
+static void lineIndexTrees(struct editorLineIndex *index)
+{
+    for (int i = 1; i <= index->nblocks; i++)
+    {
+        index->counts[i] = index->block[i - 1].count;
+        index->sums[i] = index->block[i - 1].sum;
+    }
+    for (int i = 1; i <= index->nblocks; i++)
+    {
+        int parent = i + (i & -i);
+        if (parent <= index->nblocks)
+        {
+            index->counts[parent] += index->counts[i];
+            index->sums[parent] += index->sums[i];
+        }
+    }
+}
+
+static int lineIndexReserve(struct editorLineIndex *index, int nblocks)
+{
+    if (nblocks <= index->cap)
+        return 0;
+
+    int cap = index->cap ? index->cap : 16;
+    while (cap < nblocks)
+        cap *= 2;
+
+    struct editorLineBlock *block = realloc(index->block, sizeof(struct editorLineBlock) * cap);
+    if (block == NULL)
+        return -1;
+    index->block = block;
+    long long *sums = realloc(index->sums, sizeof(long long) * (cap + 1));
+    if (sums == NULL)
+        return -1;
+    index->sums = sums;
+    int *counts = realloc(index->counts, sizeof(int) * (cap + 1));
+    if (counts == NULL)
+        return -1;
+    index->counts = counts;
+    index->cap = cap;
+    return 0;
+}
+
+// the block holding row `pos` and where in it the row is, walking down the
+// tree of counts. `pos` equal to the size lands after the last row.
+static int lineIndexLocate(struct editorLineIndex *index, int pos, int *off)
+{
+    int b = 0;
+    int step = 1;
+
+    while (step * 2 <= index->nblocks)
+        step *= 2;
+
+    for (; step > 0; step /= 2)
+    {
+        if (b + step <= index->nblocks && index->counts[b + step] <= pos)
+        {
+            b += step;
+            pos -= index->counts[b];
+        }
+    }
+
+    if (b == index->nblocks)
+    {
+        b--;
+        pos += index->block[b].count;
+    }
+    *off = pos;
+    return b;
+}
+
+// swaps blocks from..from + old - 1 for new ones holding `values`, filled
+// to LINE_BLOCK_FILL so the next inserts find room
+static int lineIndexReplace(struct editorLineIndex *index, int from, int old, const int *values, int count)
+{
+    int fresh = (count + LINE_BLOCK_FILL - 1) / LINE_BLOCK_FILL;
+    if (index->nblocks - old + fresh == 0)
+        fresh = 1;
+
+    if (lineIndexReserve(index, index->nblocks - old + fresh) == -1)
+        return -1;
+    int **arrays = malloc(sizeof(int *) * fresh);
+    if (arrays == NULL)
+        return -1;
+    for (int cnt = 0; cnt < fresh; cnt++)
+    {
+        arrays[cnt] = malloc(sizeof(int) * LINE_BLOCK_ROWS);
+        if (arrays[cnt] == NULL)
+        {
+            for (int i = 0; i < cnt; i++)
+                free(arrays[i]);
+            free(arrays);
+            return -1;
+        }
+    }
+
+    for (int cnt = from; cnt < from + old; cnt++)
+        free(index->block[cnt].value);
+    memmove(&index->block[from + fresh], &index->block[from + old],
+            sizeof(struct editorLineBlock) * (index->nblocks - from - old));
+    index->nblocks += fresh - old;
+
+    for (int cnt = 0; cnt < fresh; cnt++)
+    {
+        struct editorLineBlock *block = &index->block[from + cnt];
+        int lo = (int)((long long)count * cnt / fresh);
+        int hi = (int)((long long)count * (cnt + 1) / fresh);
+        block->value = arrays[cnt];
+        block->count = hi - lo;
+        block->sum = 0;
+        memcpy(block->value, &values[lo], sizeof(int) * (hi - lo));
+        for (int i = 0; i < block->count; i++)
+            block->sum += block->value[i];
+    }
+    free(arrays);
+    lineIndexTrees(index);
+    return 0;
+}
+
+static void lineIndexClear(struct editorLineIndex *index)
+{
+    for (int cnt = 0; cnt < index->nblocks; cnt++)
+        free(index->block[cnt].value);
+    index->nblocks = 0;
+    index->size = 0;
+    index->valid = 0;
+}
+
+// O(n) rebuild, only needed after a load or when the wrap width changed
+static int lineIndexBuild(editorContext *ctx, struct editorLineIndex *index)
+{
+    int *values = malloc(sizeof(int) * (ctx->numrows ? ctx->numrows : 1));
+    if (values == NULL)
+        return -1;
+    for (int cnt = 0; cnt < ctx->numrows; cnt++)
+        values[cnt] = lineIndexValue(ctx, index, cnt);
+
+    lineIndexClear(index);
+    int ret = lineIndexReplace(index, 0, 0, values, ctx->numrows);
+    free(values);
+    if (ret == -1)
+        return -1;
+    index->size = ctx->numrows;
+    index->valid = 1;
+    return 0;
+}
+
+// sum of the first `pos` rows: the blocks before its own, then whichever
+// side of it within the block is shorter
+static long long lineIndexPrefix(struct editorLineIndex *index, int pos)
+{
+    if (pos >= index->size)
+        return lineIndexBlockPrefix(index, index->nblocks);
+
+    int off;
+    int b = lineIndexLocate(index, pos, &off);
+    struct editorLineBlock *block = &index->block[b];
+    long long sum;
+
+    if (off <= block->count / 2)
+    {
+        sum = lineIndexBlockPrefix(index, b);
+        for (int cnt = 0; cnt < off; cnt++)
+            sum += block->value[cnt];
+    }
+    else
+    {
+        sum = lineIndexBlockPrefix(index, b + 1);
+        for (int cnt = off; cnt < block->count; cnt++)
+            sum -= block->value[cnt];
+    }
+    return sum;
+}
+
+// the row whose span holds `value`: down the tree to its block, then along
+// the block. what is left of `value` inside that row goes to `rest`.
+// values past the end land on the last row.
+static int lineIndexFind(struct editorLineIndex *index, long long value, long long *rest)
+{
+    int b = 0;
+    int pos = 0;
+    int step = 1;
+
+    while (step * 2 <= index->nblocks)
+        step *= 2;
+
+    for (; step > 0; step /= 2)
+    {
+        if (b + step <= index->nblocks && index->sums[b + step] <= value)
+        {
+            b += step;
+            value -= index->sums[b];
+            pos += index->counts[b];
+        }
+    }
+
+    if (b >= index->nblocks)
+    {
+        pos = index->size - 1;
+        if (pos >= 0)
+        {
+            int off;
+            struct editorLineBlock *block = &index->block[lineIndexLocate(index, pos, &off)];
+            value += block->value[off];
+        }
+        else
+            value = 0;
+    }
+    else
+    {
+        struct editorLineBlock *block = &index->block[b];
+        int off = 0;
+        while (off < block->count - 1 && value >= block->value[off])
+            value -= block->value[off++];
+        pos += off;
+    }
+    if (rest)
+        *rest = value;
+    return pos;
+}
+
+// rows pos..pos + removed - 1 were replaced by `added` rows: the blocks
+// they touch are cut and refilled, O(removed + added + blocks)
+static void lineIndexSplice(editorContext *ctx, struct editorLineIndex *index, int pos, int removed, int added)
+{
+    if (!index->valid)
+        return;
+    if (pos + removed > index->size)
+    {
+        index->valid = 0;
+        return;
+    }
+
+    int off0, off1;
+    int b0 = lineIndexLocate(index, pos, &off0);
+    int b1 = lineIndexLocate(index, pos + removed, &off1);
+    int tail = index->block[b1].count - off1;
+    int count = off0 + added + tail;
+    int *values = malloc(sizeof(int) * (count ? count : 1));
+
+    if (values == NULL)
+    {
+        index->valid = 0;
+        return;
+    }
+    memcpy(values, index->block[b0].value, sizeof(int) * off0);
+    for (int cnt = 0; cnt < added; cnt++)
+        values[off0 + cnt] = lineIndexValue(ctx, index, pos + cnt);
+    memcpy(&values[off0 + added], &index->block[b1].value[off1], sizeof(int) * tail);
+
+    if (lineIndexReplace(index, b0, b1 - b0 + 1, values, count) == -1)
+        index->valid = 0;
+    else
+        index->size += added - removed;
+    free(values);
+}
+
+// rows first..last took new values without moving, one pass along the
+// blocks they sit in
+static void lineIndexRefresh(editorContext *ctx, struct editorLineIndex *index, int first, int last)
+{
+    if (!index->valid)
+        return;
+    if (first < 0)
+        first = 0;
+    if (last >= index->size)
+        last = index->size - 1;
+    if (first > last)
+        return;
+
+    int off;
+    int b = lineIndexLocate(index, first, &off);
+    long long delta = 0;
+
+    for (int pos = first; pos <= last; pos++)
+    {
+        struct editorLineBlock *block = &index->block[b];
+        int value = lineIndexValue(ctx, index, pos);
+        delta += value - block->value[off];
+        block->value[off] = value;
+        if (++off == block->count || pos == last)
+        {
+            block->sum += delta;
+            lineIndexBlockAdd(index, b, 0, delta);
+            delta = 0;
+            off = 0;
+            b++;
+        }
+    }
+}
+
+static void lineIndexUpdate(editorContext *ctx, struct editorLineIndex *index, int pos)
+{
+    if (!index->valid || pos >= index->size)
+        return;
+
+    int off;
+    int b = lineIndexLocate(index, pos, &off);
+    struct editorLineBlock *block = &index->block[b];
+    int delta = lineIndexValue(ctx, index, pos) - block->value[off];
+    if (delta)
+    {
+        block->value[off] += delta;
+        block->sum += delta;
+        lineIndexBlockAdd(index, b, 0, delta);
+    }
+}
+
+// O(log n) plus moving the rest of one block along; a full block is split
+static void lineIndexInsert(editorContext *ctx, struct editorLineIndex *index, int pos)
+{
+    if (!index->valid)
+        return;
+
+    int off;
+    int b = lineIndexLocate(index, pos, &off);
+    struct editorLineBlock *block = &index->block[b];
+    int value = lineIndexValue(ctx, index, pos);
+
+    if (block->count == LINE_BLOCK_ROWS)
+    {
+        // appending starts a new block rather than leaving two half full
+        if (pos == index->size)
+        {
+            if (lineIndexReplace(index, index->nblocks, 0, &value, 1) == -1)
+                index->valid = 0;
+            else
+                index->size++;
+        }
+        else
+            lineIndexSplice(ctx, index, pos, 0, 1);
+        return;
+    }
+
+    memmove(&block->value[off + 1], &block->value[off], sizeof(int) * (block->count - off));
+    block->value[off] = value;
+    block->count++;
+    block->sum += value;
+    lineIndexBlockAdd(index, b, 1, value);
+    index->size++;
+}
+
+static void lineIndexDelete(editorContext *ctx, struct editorLineIndex *index, int pos)
+{
+    if (!index->valid)
+        return;
+
+    int off;
+    int b = lineIndexLocate(index, pos, &off);
+    struct editorLineBlock *block = &index->block[b];
+
+    // its last row takes the block with it
+    if (block->count == 1 && index->nblocks > 1)
+    {
+        lineIndexSplice(ctx, index, pos, 1, 0);
+        return;
+    }
+
+    int value = block->value[off];
+    memmove(&block->value[off], &block->value[off + 1], sizeof(int) * (block->count - off - 1));
+    block->count--;
+    block->sum -= value;
+    lineIndexBlockAdd(index, b, -1, -value);
+    index->size--;
+}
+
+static void lineIndexFree(struct editorLineIndex *index)
+{
+    lineIndexClear(index);
+    free(index->block);
+    free(index->sums);
+    free(index->counts);
+    index->block = NULL;
+    index->sums = NULL;
+    index->counts = NULL;
+    index->cap = 0;
+}
+
+void editorLineIndexFree(editorContext *ctx)
+{
+    lineIndexFree(&ctx->lines);
+    lineIndexFree(&ctx->wrap);
+}
+
+// the row's length changed
+void editorLineIndexUpdate(editorContext *ctx, erow *row)
+{
+    lineIndexUpdate(ctx, &ctx->lines, row->index);
+    if (ctx->wrap.width)
+        lineIndexUpdate(ctx, &ctx->wrap, row->index);
+}
+
+// a row was added at `pos`
+void editorLineIndexInsert(editorContext *ctx, int pos)
+{
+    lineIndexInsert(ctx, &ctx->lines, pos);
+    if (ctx->wrap.width)
+        lineIndexInsert(ctx, &ctx->wrap, pos);
+}
+
+void editorLineIndexDelete(editorContext *ctx, int pos)
+{
+    lineIndexDelete(ctx, &ctx->lines, pos);
+    lineIndexDelete(ctx, &ctx->wrap, pos);
+}
+
+// rows pos..pos + removed - 1 were replaced by the `added` rows now there
+void editorLineIndexSplice(editorContext *ctx, int pos, int removed, int added)
+{
+    lineIndexSplice(ctx, &ctx->lines, pos, removed, added);
+    if (ctx->wrap.width)
+        lineIndexSplice(ctx, &ctx->wrap, pos, removed, added);
+}
+
+// byte offset of the start of row `pos` in the saved file
+long long editorRowOffset(editorContext *ctx, int pos)
+{
+    if (!ctx->lines.valid && lineIndexBuild(ctx, &ctx->lines) == -1)
+        return -1;
+
+    if (pos > ctx->lines.size)
+        pos = ctx->lines.size;
+    return lineIndexPrefix(&ctx->lines, pos);
+}
+
+// the row holding byte `offset`. offsets past the end land on the last row.
+int editorOffsetToRow(editorContext *ctx, long long offset)
+{
+    if (!ctx->lines.valid && lineIndexBuild(ctx, &ctx->lines) == -1)
+        return -1;
+
+    return lineIndexFind(&ctx->lines, offset, NULL);
+}
+
+/***  wrap index  ***/
+
+// soft wrap: rows are cut every `width` screen columns. a second index over
+// the same rows counts the screen lines each one takes, kept current by the
+// row operations like the byte index and by folds opening and closing.
+// changing the width only marks it for a rebuild, which measures rows from
+// chars and renders nothing. 0 turns wrapping off and frees the index.
+void editorSetWrapWidth(editorContext *ctx, int width)
+{
+    if (width <= 0)
+    {
+        lineIndexFree(&ctx->wrap);
+        ctx->wrap.width = 0;
+        return;
+    }
+    if (width != ctx->wrap.width)
+    {
+        ctx->wrap.width = width;
+        ctx->wrap.valid = 0;
+    }
+}
+
+// rows first..last were hidden or shown by a fold
+void editorWrapIndexRefresh(editorContext *ctx, int first, int last)
+{
+    if (ctx->wrap.width)
+        lineIndexRefresh(ctx, &ctx->wrap, first, last);
+}
+
+// the first screen line of row `pos`; `pos` may be numrows for the line
+// after the last row
+long long editorWrapRowLine(editorContext *ctx, int pos)
+{
+    if (ctx->wrap.width == 0)
+        return pos;
+    if (!ctx->wrap.valid && lineIndexBuild(ctx, &ctx->wrap) == -1)
+        return -1;
+
+    if (pos > ctx->wrap.size)
+        pos = ctx->wrap.size;
+    return lineIndexPrefix(&ctx->wrap, pos);
+}
+
+// the row shown on screen line `line` and which of its wrapped segments
+// that is. lines past the end land on the last row, or on numrows when
+// the buffer is empty.
+int editorWrapLineToRow(editorContext *ctx, long long line, int *segment)
+{
+    long long rest = 0;
+    int pos;
+
+    if (ctx->wrap.width == 0 || ctx->numrows == 0)
+    {
+        if (segment)
+            *segment = 0;
+        return (line < ctx->numrows)
+                   ? (int)line
+                   : ctx->numrows;
+    }
+    if (!ctx->wrap.valid && lineIndexBuild(ctx, &ctx->wrap) == -1)
+        return -1;
+
+    pos = lineIndexFind(&ctx->wrap, line, &rest);
+    if (segment)
+        *segment = (int)rest;
+    return pos;
+}
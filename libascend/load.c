@@ -0,0 +1,261 @@
+/*** includes ***/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ascend.h"
+
+/*** defines ***/
+#define LOAD_MIN_CHUNK (4 << 20) // smaller pieces aren't worth a thread
+#define LOAD_MAX_THREADS 64
+#define LOAD_PROGRESS_STEP (8 << 20)
+#define LOAD_PROGRESS_INTERVAL_NS 50000000
+
+/*** data ***/
+
+// one slice of the mapped file, cut on line boundaries. each loader thread
+// turns its slice into a private row table that is rendered and
+// highlighted, then the tables are stitched into ctx->row in order.
+struct loadChunk
+{
+    editorContext *ctx;
+    const char *start;
+    const char *end;
+    erow *rows;
+    int numrows;
+    size_t row_bytes;
+    size_t derived_bytes;
+    int failed;
+    long long *done; // bytes scanned by all threads, for progress
+    int *finished;   // slices done
+    pthread_t thread;
+};
+
+/***  parallel load  ***/
+
+static void loadChunkRun(struct loadChunk *chunk)
+{
+    const char *ptr = chunk->start;
+    const char *end = chunk->end;
+    const char *reported = ptr;
+    int cap = (end - ptr) / 64 + 16;
+
+    chunk->rows = malloc(sizeof(erow) * cap);
+    if (chunk->rows == NULL)
+    {
+        chunk->failed = 1;
+        return;
+    }
+
+    // glibc's memchr compares a vector register of bytes at a time, so the
+    // newline scan runs at close to memory speed
+    while (ptr < end)
+    {
+        const char *newline = memchr(ptr, '\n', end - ptr);
+        size_t linelen = (newline ? newline : end) - ptr;
+        if (newline && linelen > 0 && ptr[linelen - 1] == '\r')
+            linelen--;
+
+        if (chunk->numrows == cap)
+        {
+            erow *rows = realloc(chunk->rows, sizeof(erow) * cap * 2);
+            if (rows == NULL)
+            {
+                chunk->failed = 1;
+                return;
+            }
+            chunk->rows = rows;
+            cap *= 2;
+        }
+
+        erow *row = &chunk->rows[chunk->numrows];
+        row->index = chunk->numrows;
+        row->size = linelen;
+        row->chars = malloc(linelen + 1);
+        if (row->chars == NULL)
+        {
+            chunk->failed = 1;
+            return;
+        }
+        memcpy(row->chars, ptr, linelen);
+        row->chars[linelen] = '\0';
+        row->rowsize = 0;
+        row->render = NULL;
+        row->highlight = NULL;
+        row->highlight_open_comment = 0;
+        row->width = 0;
+        row->ncp = 0;
+        row->match_stamp = 0;
+        row->cp = NULL;
+        row->bracket_net = 0;
+        row->bracket_min = 1;
+
+        chunk->row_bytes += linelen + 1;
+        if (!chunk->ctx->text_only)
+            chunk->derived_bytes += editorRenderRowText(row);
+        chunk->numrows++;
+
+        ptr = newline ? newline + 1 : end;
+        if (ptr - reported >= LOAD_PROGRESS_STEP)
+        {
+            __atomic_add_fetch(chunk->done, ptr - reported, __ATOMIC_RELAXED);
+            reported = ptr;
+        }
+    }
+    __atomic_add_fetch(chunk->done, ptr - reported, __ATOMIC_RELAXED);
+
+    if (!chunk->ctx->text_only)
+        editorHighlightRows(chunk->ctx, chunk->rows, chunk->numrows);
+}
+
+static void *loadChunkMain(void *arg)
+{
+    struct loadChunk *chunk = arg;
+
+    loadChunkRun(chunk);
+    __atomic_add_fetch(chunk->finished, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+static void loadChunkFree(struct loadChunk *chunk)
+{
+    for (int cnt = 0; cnt < chunk->numrows; cnt++)
+        editorFreeRow(&chunk->rows[cnt]);
+    free(chunk->rows);
+}
+
+// appends the rows of the regular file `fd` to the buffer. the file is
+// mapped and cut into one slice per core at newline boundaries; the
+// slices are split into rows, rendered and highlighted concurrently.
+// highlighting assumes each slice starts outside a comment, so only the
+// rows after a slice boundary that falls inside a multi-line comment are
+// highlighted again once the slices are stitched together.
+int editorLoadMapped(editorContext *ctx, int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+        return -1;
+    if (st.st_size == 0)
+        return 0;
+
+    size_t size = st.st_size;
+    const char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+        return -1;
+    madvise((void *)data, size, MADV_SEQUENTIAL);
+
+    long nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads > (long)(size / LOAD_MIN_CHUNK))
+        nthreads = size / LOAD_MIN_CHUNK;
+    if (nthreads > LOAD_MAX_THREADS)
+        nthreads = LOAD_MAX_THREADS;
+    if (nthreads < 1)
+        nthreads = 1;
+
+    struct loadChunk chunks[LOAD_MAX_THREADS];
+    long long done = 0;
+    int finished = 0;
+    const char *end = data + size;
+    const char *start = data;
+    int nchunks = 0;
+
+    for (long cnt = 0; cnt < nthreads && start < end; cnt++)
+    {
+        const char *cut = (cnt == nthreads - 1)
+                              ? end
+                              : data + size / nthreads * (cnt + 1);
+        if (cut < start)
+            cut = start;
+        if (cut < end)
+        {
+            const char *newline = memchr(cut, '\n', end - cut);
+            cut = newline ? newline + 1 : end;
+        }
+
+        struct loadChunk *chunk = &chunks[nchunks++];
+        memset(chunk, 0, sizeof(*chunk));
+        chunk->ctx = ctx;
+        chunk->start = start;
+        chunk->end = cut;
+        chunk->done = &done;
+        chunk->finished = &finished;
+        start = cut;
+    }
+
+    // a single slice is loaded on the calling thread. otherwise it only
+    // reports progress until the loader threads are done
+    int started = 0;
+    if (nchunks > 1)
+        while (started < nchunks && pthread_create(&chunks[started].thread, NULL, loadChunkMain, &chunks[started]) == 0)
+            started++;
+    for (int cnt = started; cnt < nchunks; cnt++)
+        loadChunkMain(&chunks[cnt]);
+
+    struct timespec interval = {0, LOAD_PROGRESS_INTERVAL_NS};
+    while (ctx->progress && __atomic_load_n(&finished, __ATOMIC_ACQUIRE) < nchunks)
+    {
+        ctx->progress(ctx, __atomic_load_n(&done, __ATOMIC_RELAXED), size);
+        nanosleep(&interval, NULL);
+    }
+    for (int cnt = 0; cnt < started; cnt++)
+        pthread_join(chunks[cnt].thread, NULL);
+    munmap((void *)data, size);
+
+    int failed = 0;
+    long long total = 0;
+    for (int cnt = 0; cnt < nchunks; cnt++)
+    {
+        failed |= chunks[cnt].failed;
+        total += chunks[cnt].numrows;
+    }
+
+    erow *rows = (failed || total > 0x7fffffff - ctx->numrows)
+                     ? NULL
+                     : realloc(ctx->row, sizeof(erow) * (ctx->numrows + total));
+    if (rows == NULL)
+    {
+        for (int cnt = 0; cnt < nchunks; cnt++)
+            loadChunkFree(&chunks[cnt]);
+        errno = ENOMEM;
+        return -1;
+    }
+    ctx->row = rows;
+
+    int first = ctx->numrows;
+    for (int cnt = 0; cnt < nchunks; cnt++)
+    {
+        struct loadChunk *chunk = &chunks[cnt];
+        int base = ctx->numrows;
+
+        memcpy(&ctx->row[base], chunk->rows, sizeof(erow) * chunk->numrows);
+        for (int i = 0; i < chunk->numrows; i++)
+            ctx->row[base + i].index = base + i;
+        ctx->numrows += chunk->numrows;
+        ctx->stats.row_bytes += chunk->row_bytes + chunk->derived_bytes;
+        ctx->stats.derived_bytes += chunk->derived_bytes;
+        free(chunk->rows);
+    }
+
+    // slices (and the existing rows) were highlighted as if each started
+    // outside a comment; rehighlight from every boundary where that's wrong
+    for (int cnt = 0, base = first; cnt < nchunks; base += chunks[cnt].numrows, cnt++)
+        if (base > 0 && base < ctx->numrows && ctx->row[base - 1].highlight_open_comment)
+            editorUpdateSyntax(ctx, &ctx->row[base]);
+
+    editorLineIndexSplice(ctx, first, 0, ctx->numrows - first);
+    editorBracketSplice(ctx, first, 0, ctx->numrows - first);
+    ctx->file_bytes += size;
+    if (ctx->progress)
+        ctx->progress(ctx, size, size);
+    return 0;
+}
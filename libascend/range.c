@@ -0,0 +1,362 @@
+/*** includes ***/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ascend.h"
+
+/***  range operations  ***/
+
+// multi-line edits. each touched row is rebuilt with one allocation, rows
+// are added or removed with a single move of the row array, and syntax is
+// updated once for the whole span afterwards.
+
+static void rangeInitRow(erow *row, int index, char *chars, int size)
+{
+    row->index = index;
+    row->size = size;
+    row->chars = chars;
+    row->rowsize = 0;
+    row->render = NULL;
+    row->highlight = NULL;
+    row->highlight_open_comment = 0;
+    row->width = 0;
+    row->ncp = 0;
+    row->match_stamp = 0;
+    row->cp = NULL;
+    row->bracket_net = 0;
+    row->bracket_min = 1;
+}
+
+// renders rows first..last and rehighlights them in one pass
+static void rangeRefresh(editorContext *ctx, int first, int last)
+{
+    for (int cnt = first; cnt <= last; cnt++)
+        editorRenderRow(ctx, &ctx->row[cnt]);
+    editorUpdateSyntaxRange(ctx, first, last);
+}
+
+// clamps a position to the buffer. the row after the last one is valid and
+// stands for the empty line the cursor can sit on.
+static void rangeClamp(editorContext *ctx, int *cy, int *cx)
+{
+    if (*cy < 0)
+        *cy = 0;
+    if (*cy >= ctx->numrows)
+    {
+        *cy = ctx->numrows;
+        *cx = 0;
+        return;
+    }
+    if (*cx < 0)
+        *cx = 0;
+    if (*cx > ctx->row[*cy].size)
+        *cx = ctx->row[*cy].size;
+}
+
+// frees the middle rows editorInsertText allocated, up to the first gap
+static void rangeFreeLines(char **lines, int count)
+{
+    if (lines == NULL)
+        return;
+    for (int cnt = 1; cnt < count && lines[cnt]; cnt++)
+        free(lines[cnt]);
+    free(lines);
+}
+
+// inserts `len` bytes of `text` at (cy, cx). newlines in the text split the
+// row. the position just past the inserted text is stored in end_cy/end_cx
+// when they are not NULL. returns 0, or -1 with errno set.
+int editorInsertText(editorContext *ctx, int cy, int cx, const char *text, size_t len, int *end_cy, int *end_cx)
+{
+    rangeClamp(ctx, &cy, &cx);
+    if (cy == ctx->numrows)
+        editorInsertRow(ctx, ctx->numrows, "", 0);
+
+    int lines = 0;
+    for (const char *p = text; (p = memchr(p, '\n', text + len - p)); p++)
+        lines++;
+
+    erow *row = &ctx->row[cy];
+    const char *last = text;
+    if (lines)
+        last = (const char *)memrchr(text, '\n', len) + 1;
+    size_t lastlen = text + len - last;
+    size_t taillen = row->size - cx;
+
+    if (lines == 0)
+    {
+        char *chars = realloc(row->chars, row->size + len + 1);
+        if (chars == NULL)
+            return -1;
+        memmove(&chars[cx + len], &chars[cx], taillen + 1);
+        memcpy(&chars[cx], text, len);
+        row->chars = chars;
+        row->size += len;
+        ctx->stats.row_bytes += len;
+        editorLineIndexUpdate(ctx, row);
+        rangeRefresh(ctx, cy, cy);
+        ctx->dirty++;
+
+        if (end_cy)
+            *end_cy = cy;
+        if (end_cx)
+            *end_cx = cx + len;
+        return 0;
+    }
+
+    // the last new row gets the inserted tail plus what followed the cursor.
+    // every new row is allocated before the buffer changes, so running out
+    // of memory leaves it as it was
+    char *tail = malloc(lastlen + taillen + 1);
+    char **middle = calloc(lines, sizeof(char *));
+    erow *rows = realloc(ctx->row, sizeof(erow) * (ctx->numrows + lines));
+    if (rows)
+        ctx->row = rows;
+    const char *newline = memchr(text, '\n', len);
+    int failed = (tail == NULL || middle == NULL || rows == NULL);
+    const char *ptr = newline + 1;
+    for (int cnt = 1; cnt < lines && !failed; cnt++)
+    {
+        const char *next = memchr(ptr, '\n', text + len - ptr);
+        size_t linelen = next - ptr;
+        middle[cnt] = malloc(linelen + 1);
+        if (middle[cnt] == NULL)
+        {
+            failed = 1;
+            break;
+        }
+        memcpy(middle[cnt], ptr, linelen);
+        middle[cnt][linelen] = '\0';
+        ptr = next + 1;
+    }
+    if (failed)
+    {
+        rangeFreeLines(middle, lines);
+        free(tail);
+        errno = ENOMEM;
+        return -1;
+    }
+    row = &ctx->row[cy];
+    int open_comment = row->highlight_open_comment;
+
+    memcpy(tail, last, lastlen);
+    memcpy(&tail[lastlen], &row->chars[cx], taillen);
+    tail[lastlen + taillen] = '\0';
+
+    size_t headlen = newline - text;
+    char *chars = realloc(row->chars, cx + headlen + 1);
+    if (chars == NULL)
+    {
+        rangeFreeLines(middle, lines);
+        free(tail);
+        errno = ENOMEM;
+        return -1;
+    }
+    memcpy(&chars[cx], text, headlen);
+    chars[cx + headlen] = '\0';
+    row->chars = chars;
+    ctx->stats.row_bytes += headlen;
+    ctx->stats.row_bytes -= taillen;
+    row->size = cx + headlen;
+
+    memmove(&ctx->row[cy + 1 + lines], &ctx->row[cy + 1], sizeof(erow) * (ctx->numrows - cy - 1));
+    for (int cnt = cy + 1 + lines; cnt < ctx->numrows + lines; cnt++)
+        ctx->row[cnt].index = cnt;
+
+    ptr = newline + 1;
+    for (int cnt = 1; cnt < lines; cnt++)
+    {
+        const char *next = memchr(ptr, '\n', text + len - ptr);
+        size_t linelen = next - ptr;
+        rangeInitRow(&ctx->row[cy + cnt], cy + cnt, middle[cnt], linelen);
+        ctx->stats.row_bytes += linelen + 1;
+        ptr = next + 1;
+    }
+    free(middle);
+    rangeInitRow(&ctx->row[cy + lines], cy + lines, tail, lastlen + taillen);
+
+    // the row after the insert was highlighted following the old row's
+    // comment state; starting the tail from it makes the syntax pass carry
+    // on past the span exactly when that state changes
+    ctx->row[cy + lines].highlight_open_comment = open_comment;
+    ctx->stats.row_bytes += lastlen + taillen + 1;
+
+    ctx->numrows += lines;
+    editorLineIndexUpdate(ctx, row);
+    editorLineIndexSplice(ctx, cy + 1, 0, lines);
+    editorBracketSplice(ctx, cy + 1, 0, lines);
+    editorFoldRowsReplaced(ctx, cy + 1, 0, lines);
+    rangeRefresh(ctx, cy, cy + lines);
+    ctx->dirty++;
+
+    if (end_cy)
+        *end_cy = cy + lines;
+    if (end_cx)
+        *end_cx = lastlen;
+    return 0;
+}
+
+// orders two positions so (*cy0, *cx0) comes first
+static void rangeOrder(int *cy0, int *cx0, int *cy1, int *cx1)
+{
+    if (*cy1 < *cy0 || (*cy1 == *cy0 && *cx1 < *cx0))
+    {
+        int ty = *cy0, tx = *cx0;
+        *cy0 = *cy1;
+        *cx0 = *cx1;
+        *cy1 = ty;
+        *cx1 = tx;
+    }
+}
+
+// removes the text between two positions, joining the first and last row
+void editorDeleteRange(editorContext *ctx, int cy0, int cx0, int cy1, int cx1)
+{
+    rangeOrder(&cy0, &cx0, &cy1, &cx1);
+    rangeClamp(ctx, &cy0, &cx0);
+    rangeClamp(ctx, &cy1, &cx1);
+
+    // the line past the end is empty: delete up to the end of the last row
+    if (cy1 == ctx->numrows && cy1 > cy0)
+    {
+        cy1 = ctx->numrows - 1;
+        cx1 = ctx->row[cy1].size;
+    }
+    if (cy0 == ctx->numrows || (cy0 == cy1 && cx0 == cx1))
+        return;
+
+    erow *first = &ctx->row[cy0];
+    if (cy0 == cy1)
+    {
+        memmove(&first->chars[cx0], &first->chars[cx1], first->size - cx1 + 1);
+        first->size -= cx1 - cx0;
+        ctx->stats.row_bytes -= cx1 - cx0;
+        editorLineIndexUpdate(ctx, first);
+        rangeRefresh(ctx, cy0, cy0);
+        ctx->dirty++;
+        return;
+    }
+
+    erow *last = &ctx->row[cy1];
+    size_t taillen = last->size - cx1;
+    char *chars = realloc(first->chars, cx0 + taillen + 1);
+    if (chars == NULL)
+        return;
+    memcpy(&chars[cx0], &last->chars[cx1], taillen + 1);
+    first->chars = chars;
+    ctx->stats.row_bytes -= first->size - cx0;
+    ctx->stats.row_bytes += taillen;
+    first->size = cx0 + taillen;
+    first->highlight_open_comment = last->highlight_open_comment;
+
+    for (int cnt = cy0 + 1; cnt <= cy1; cnt++)
+    {
+        erow *row = &ctx->row[cnt];
+        ctx->stats.row_bytes -= row->size + 1 + editorRowDerivedBytes(row);
+        ctx->stats.derived_bytes -= editorRowDerivedBytes(row);
+        editorFreeRow(row);
+    }
+
+    int removed = cy1 - cy0;
+    memmove(&ctx->row[cy0 + 1], &ctx->row[cy1 + 1], sizeof(erow) * (ctx->numrows - cy1 - 1));
+    ctx->numrows -= removed;
+    for (int cnt = cy0 + 1; cnt < ctx->numrows; cnt++)
+        ctx->row[cnt].index = cnt;
+
+    editorLineIndexUpdate(ctx, first);
+    editorLineIndexSplice(ctx, cy0 + 1, removed, 0);
+    editorBracketSplice(ctx, cy0 + 1, removed, 0);
+    editorFoldRowsReplaced(ctx, cy0 + 1, removed, 0);
+    rangeRefresh(ctx, cy0, cy0);
+    ctx->dirty++;
+}
+
+// returns the text between two positions with rows joined by newlines, in
+// a malloc'd buffer whose length is stored in `len`
+char *editorCopyRange(editorContext *ctx, int cy0, int cx0, int cy1, int cx1, size_t *len)
+{
+    rangeOrder(&cy0, &cx0, &cy1, &cx1);
+    rangeClamp(ctx, &cy0, &cx0);
+    rangeClamp(ctx, &cy1, &cx1);
+
+    size_t total = 0;
+    for (int cnt = cy0; cnt <= cy1 && cnt < ctx->numrows; cnt++)
+    {
+        int from = (cnt == cy0) ? cx0 : 0;
+        int to = (cnt == cy1) ? cx1 : ctx->row[cnt].size;
+        total += to - from + (cnt < cy1);
+    }
+
+    char *buf = malloc(total + 1);
+    if (buf == NULL)
+        return NULL;
+
+    char *ptr = buf;
+    for (int cnt = cy0; cnt <= cy1 && cnt < ctx->numrows; cnt++)
+    {
+        int from = (cnt == cy0) ? cx0 : 0;
+        int to = (cnt == cy1) ? cx1 : ctx->row[cnt].size;
+        memcpy(ptr, &ctx->row[cnt].chars[from], to - from);
+        ptr += to - from;
+        if (cnt < cy1)
+            *ptr++ = '\n';
+    }
+    *ptr = '\0';
+    *len = ptr - buf;
+    return buf;
+}
+
+// indents rows first..last by one tab, or removes one level of indentation
+// (a tab or up to a tab stop of spaces) when `direction` is negative
+void editorIndentRows(editorContext *ctx, int first, int last, int direction)
+{
+    if (first < 0)
+        first = 0;
+    if (last >= ctx->numrows)
+        last = ctx->numrows - 1;
+    if (first > last)
+        return;
+
+    for (int cnt = first; cnt <= last; cnt++)
+    {
+        erow *row = &ctx->row[cnt];
+
+        if (direction > 0)
+        {
+            if (row->size == 0)
+                continue;
+            char *chars = realloc(row->chars, row->size + 2);
+            if (chars == NULL)
+                continue;
+            memmove(&chars[1], chars, row->size + 1);
+            chars[0] = '\t';
+            row->chars = chars;
+            row->size++;
+            ctx->stats.row_bytes++;
+        }
+        else
+        {
+            int strip = 0;
+            if (row->size > 0 && row->chars[0] == '\t')
+                strip = 1;
+            else
+                while (strip < row->size && strip < ASCEND_TAB_STOP && row->chars[strip] == ' ')
+                    strip++;
+            if (strip == 0)
+                continue;
+            memmove(row->chars, &row->chars[strip], row->size - strip + 1);
+            row->size -= strip;
+            ctx->stats.row_bytes -= strip;
+        }
+        editorLineIndexUpdate(ctx, row);
+    }
+
+    rangeRefresh(ctx, first, last);
+    ctx->dirty++;
+}
@@ -0,0 +1,676 @@
+/*** includes ***/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ascend.h"
+
+/***  context  ***/
+
+editorContext *editorContextNew(void)
+{
+    editorContext *ctx = malloc(sizeof(editorContext));
+    if (ctx == NULL)
+        return NULL;
+
+    ctx->cx = 0;
+    ctx->cy = 0;
+    ctx->numrows = 0;
+    ctx->row = NULL;
+    ctx->dirty = 0;
+    ctx->filename = NULL;
+    ctx->syntax = NULL;
+    ctx->stats.enabled = 0;
+    ctx->stats.syntax_ns = 0;
+    ctx->stats.row_bytes = 0;
+    ctx->stats.derived_bytes = 0;
+    ctx->last_viewed = 0;
+    ctx->file_bytes = 0;
+    ctx->compressed = 0;
+    ctx->follow = NULL;
+    ctx->progress = NULL;
+    ctx->lines.block = NULL;
+    ctx->lines.sums = NULL;
+    ctx->lines.counts = NULL;
+    ctx->lines.nblocks = 0;
+    ctx->lines.size = 0;
+    ctx->lines.cap = 0;
+    ctx->lines.valid = 0;
+    ctx->lines.width = 0;
+    ctx->wrap.block = NULL;
+    ctx->wrap.sums = NULL;
+    ctx->wrap.counts = NULL;
+    ctx->wrap.nblocks = 0;
+    ctx->wrap.size = 0;
+    ctx->wrap.cap = 0;
+    ctx->wrap.valid = 0;
+    ctx->wrap.width = 0;
+    ctx->matches = NULL;
+    ctx->hex = NULL;
+    ctx->save = NULL;
+    ctx->text_only = 0;
+    ctx->folds.fold = NULL;
+    ctx->folds.count = 0;
+    ctx->folds.cap = 0;
+    ctx->brackets.node = NULL;
+    ctx->brackets.nblocks = 0;
+    ctx->brackets.size = 0;
+    ctx->brackets.cap = 0;
+    ctx->brackets.valid = 0;
+    return ctx;
+}
+
+void editorContextFree(editorContext *ctx)
+{
+    if (ctx == NULL)
+        return;
+
+    long long written;
+    editorFollowStop(ctx);
+    editorSavePoll(ctx, 1, &written);
+    for (int cnt = 0; cnt < ctx->numrows; cnt++)
+        editorFreeRow(&ctx->row[cnt]);
+    free(ctx->row);
+    editorLineIndexFree(ctx);
+    editorFoldFree(ctx);
+    editorBracketFree(ctx);
+    editorSetSearch(ctx, NULL);
+    editorHexClose(ctx);
+    free(ctx->filename);
+    free(ctx);
+}
+
+/***  row operations  ***/
+
+// heap held by a row's render, highlight and codepoint map
+size_t editorRowDerivedBytes(erow *row)
+{
+    if (row->render == NULL)
+        return 0;
+
+    size_t bytes = 2 * row->rowsize + 1;
+    if (row->cp)
+        bytes += sizeof(struct editorCodepoint) * (row->ncp + 1);
+    return bytes;
+}
+
+// index of the codepoint containing byte `cx` of chars
+static int editorRowByteToIndex(erow *row, int cx)
+{
+    int low = 0;
+    int high = row->ncp;
+
+    while (low < high)
+    {
+        int mid = (low + high + 1) / 2;
+        if (row->cp[mid].byte <= cx)
+            low = mid;
+        else
+            high = mid - 1;
+    }
+    return low;
+}
+
+// index of the last codepoint starting at or before column `col`
+int editorRowColumnToIndex(erow *row, int col)
+{
+    int low = 0;
+    int high = row->ncp;
+
+    while (low < high)
+    {
+        int mid = (low + high + 1) / 2;
+        if (row->cp[mid].col <= col)
+            low = mid;
+        else
+            high = mid - 1;
+    }
+    return low;
+}
+
+int editorRowCxToRx(erow *row, int cx)
+{
+    if (row->cp)
+        return row->cp[editorRowByteToIndex(row, cx)].col;
+
+    int rx = 0;
+    int cnt;
+
+    for (cnt = 0; cnt < cx; cnt++)
+    {
+        if (row->chars[cnt] == '\t')
+            rx += (ASCEND_TAB_STOP - 1) - (rx % ASCEND_TAB_STOP);
+        rx++;
+    }
+    return rx;
+}
+
+int editorRowRxToCx(erow *row, int rx)
+{
+    if (row->cp)
+        return row->cp[editorRowColumnToIndex(row, rx)].byte;
+
+    int curr_rx = 0;
+    int cx;
+
+    for (cx = 0; cx < row->size; cx++)
+    {
+        if (row->chars[cx] == '\t')
+            curr_rx += (ASCEND_TAB_STOP - 1) - (curr_rx % ASCEND_TAB_STOP);
+
+        curr_rx++;
+
+        if (curr_rx > rx)
+            return cx;
+    }
+    return cx;
+}
+
+// maps a byte offset in render, such as a search hit, back to chars
+int editorRowRenderToCx(erow *row, int offset)
+{
+    if (row->cp == NULL)
+        return editorRowRxToCx(row, offset);
+
+    int low = 0;
+    int high = row->ncp;
+
+    while (low < high)
+    {
+        int mid = (low + high + 1) / 2;
+        if (row->cp[mid].render <= offset)
+            low = mid;
+        else
+            high = mid - 1;
+    }
+    return row->cp[low].byte;
+}
+
+// byte offset in render of byte `cx` of chars, where highlight for it is
+int editorRowCxToRender(erow *row, int cx)
+{
+    return row->cp
+               ? row->cp[editorRowByteToIndex(row, cx)].render
+               : editorRowCxToRx(row, cx);
+}
+
+// cursor steps over whole codepoints, and over combining marks together
+// with the character they belong to
+int editorRowNextCx(erow *row, int cx)
+{
+    if (cx >= row->size)
+        return row->size;
+    if (row->cp == NULL)
+        return cx + 1;
+
+    int index = editorRowByteToIndex(row, cx) + 1;
+    while (index < row->ncp && row->cp[index].col == row->cp[index + 1].col)
+        index++;
+    return row->cp[index].byte;
+}
+
+int editorRowPrevCx(erow *row, int cx)
+{
+    if (cx <= 0)
+        return 0;
+    if (row->cp == NULL)
+        return cx - 1;
+
+    int index = editorRowByteToIndex(row, cx - 1);
+    while (index > 0 && row->cp[index].col == row->cp[index + 1].col)
+        index--;
+    return row->cp[index].byte;
+}
+
+// display columns of a row, worked out from chars the same way
+// editorRenderRowText lays them out, so rows can be measured without
+// being rendered
+int editorRowWidth(erow *row)
+{
+    const char *ptr = row->chars;
+    const char *end = row->chars + row->size;
+    int col = 0;
+
+    if (editorIsAscii(row->chars, row->size))
+    {
+        const char *tab;
+        while ((tab = memchr(ptr, '\t', end - ptr)))
+        {
+            col += tab - ptr;
+            col += ASCEND_TAB_STOP - col % ASCEND_TAB_STOP;
+            ptr = tab + 1;
+        }
+        return col + (end - ptr);
+    }
+
+    while (ptr < end)
+    {
+        if (*ptr == '\t')
+        {
+            col += ASCEND_TAB_STOP - col % ASCEND_TAB_STOP;
+            ptr++;
+            continue;
+        }
+
+        int codepoint;
+        ptr += editorUtf8Decode(ptr, end - ptr, &codepoint);
+        col += editorCodepointWidth(codepoint);
+    }
+    return col;
+}
+
+// rebuilds render (tab expansion) from chars without touching highlight.
+// rows with multibyte text also get their codepoint map and width cached
+// here, so nothing has to rescan them until they change again. leaves the
+// context alone and returns the derived bytes now held, so loader threads
+// can call it and account for rows afterwards.
+size_t editorRenderRowText(erow *row)
+{
+    int tabs = 0;
+    int cnt;
+
+    for (cnt = 0; cnt < row->size; cnt++)
+        if (row->chars[cnt] == '\t')
+            tabs++;
+
+    free(row->render);
+    free(row->cp);
+    row->cp = NULL;
+    row->ncp = 0;
+    row->match_stamp = 0;
+    row->render = malloc(row->size + tabs * (ASCEND_TAB_STOP - 1) + 1);
+
+    int index = 0;
+    if (editorIsAscii(row->chars, row->size))
+    {
+        for (cnt = 0; cnt < row->size; cnt++)
+        {
+            if (row->chars[cnt] == '\t')
+            {
+                row->render[index++] = ' ';
+                while (index % ASCEND_TAB_STOP != 0)
+                    row->render[index++] = ' ';
+            }
+            else
+                row->render[index++] = row->chars[cnt];
+        }
+        row->width = index;
+    }
+    else
+    {
+        struct editorCodepoint *cp = malloc(sizeof(struct editorCodepoint) * (row->size + 1));
+        int col = 0;
+        int ncp = 0;
+
+        cnt = 0;
+        while (cnt < row->size)
+        {
+            cp[ncp].byte = cnt;
+            cp[ncp].col = col;
+            cp[ncp].render = index;
+            ncp++;
+
+            if (row->chars[cnt] == '\t')
+            {
+                row->render[index++] = ' ';
+                col++;
+                while (col % ASCEND_TAB_STOP != 0)
+                {
+                    row->render[index++] = ' ';
+                    col++;
+                }
+                cnt++;
+                continue;
+            }
+
+            int codepoint;
+            int len = editorUtf8Decode(&row->chars[cnt], row->size - cnt, &codepoint);
+            memcpy(&row->render[index], &row->chars[cnt], len);
+            index += len;
+            cnt += len;
+            col += editorCodepointWidth(codepoint);
+        }
+
+        cp[ncp].byte = row->size;
+        cp[ncp].col = col;
+        cp[ncp].render = index;
+
+        row->cp = realloc(cp, sizeof(struct editorCodepoint) * (ncp + 1));
+        row->ncp = ncp;
+        row->width = col;
+    }
+
+    row->render[index] = '\0';
+    row->rowsize = index;
+    return editorRowDerivedBytes(row);
+}
+
+// frees a row's render and highlight, keeping chars and the open-comment
+// state needed to rebuild them later
+void editorRowDropDerived(editorContext *ctx, erow *row)
+{
+    ctx->stats.row_bytes -= editorRowDerivedBytes(row);
+    ctx->stats.derived_bytes -= editorRowDerivedBytes(row);
+    free(row->render);
+    free(row->highlight);
+    free(row->cp);
+    row->render = NULL;
+    row->highlight = NULL;
+    row->cp = NULL;
+    row->ncp = 0;
+    row->rowsize = 0;
+}
+
+void editorRenderRow(editorContext *ctx, erow *row)
+{
+    // stale derived data goes, nothing new is built
+    if (ctx->text_only)
+    {
+        if (row->render)
+            editorRowDropDerived(ctx, row);
+        row->bracket_min = 1;
+        return;
+    }
+
+    ctx->stats.row_bytes -= editorRowDerivedBytes(row);
+    ctx->stats.derived_bytes -= editorRowDerivedBytes(row);
+
+    size_t bytes = editorRenderRowText(row);
+    ctx->stats.row_bytes += bytes;
+    ctx->stats.derived_bytes += bytes;
+}
+
+void editorUpdateRow(editorContext *ctx, erow *row)
+{
+    long long start = editorTraceEnabled
+                          ? editorClockNs()
+                          : 0;
+
+    editorLineIndexUpdate(ctx, row);
+    editorRenderRow(ctx, row);
+    editorUpdateSyntax(ctx, row);
+
+    if (editorTraceEnabled)
+        editorTraceEvent("update_row", start, editorClockNs());
+}
+
+// regenerates render and highlight for a row whose derived data was
+// evicted. highlight_open_comment survives eviction, so the row can be
+// highlighted on its own without restarting the comment cascade.
+void editorRowEnsureDerived(editorContext *ctx, erow *row)
+{
+    if (row->render != NULL)
+        return;
+
+    // text-only rows get render for searching, never highlight
+    if (ctx->text_only)
+    {
+        size_t bytes = editorRenderRowText(row);
+        ctx->stats.row_bytes += bytes;
+        ctx->stats.derived_bytes += bytes;
+        return;
+    }
+    editorUpdateRow(ctx, row);
+}
+
+// drops render and highlight for every row, keeping chars and the
+// open-comment state needed to rebuild them later
+void editorEvictDerived(editorContext *ctx)
+{
+    for (int cnt = 0; cnt < ctx->numrows; cnt++)
+        if (ctx->row[cnt].render != NULL)
+            editorRowDropDerived(ctx, &ctx->row[cnt]);
+}
+
+void editorFreeRow(erow *row)
+{
+    free(row->cp);
+    free(row->render);
+    free(row->chars);
+    free(row->highlight);
+}
+
+void editorDeleteRow(editorContext *ctx, int pos)
+{
+    if (pos < 0 || pos >= ctx->numrows)
+        return;
+
+    ctx->stats.row_bytes -= ctx->row[pos].size + 1;
+    ctx->stats.row_bytes -= editorRowDerivedBytes(&ctx->row[pos]);
+    ctx->stats.derived_bytes -= editorRowDerivedBytes(&ctx->row[pos]);
+    editorFreeRow(&ctx->row[pos]);
+    memmove(&ctx->row[pos], &ctx->row[pos + 1], sizeof(erow) * (ctx->numrows - pos - 1));
+    for (int cnt = pos; cnt < ctx->numrows - 1; cnt++)
+        ctx->row[cnt].index--;
+
+    ctx->numrows--;
+    editorLineIndexDelete(ctx, pos);
+    editorBracketDelete(ctx, pos);
+    editorFoldRowsReplaced(ctx, pos, 1, 0);
+    ctx->dirty++;
+}
+
+void editorInsertRow(editorContext *ctx, int pos, char *s, size_t len)
+{
+    if (pos < 0 || pos > ctx->numrows)
+        return;
+
+    ctx->row = realloc(ctx->row, sizeof(erow) * (ctx->numrows + 1));
+    memmove(&ctx->row[pos + 1], &ctx->row[pos], sizeof(erow) * (ctx->numrows - pos));
+    for (int cnt = pos + 1; cnt <= ctx->numrows; cnt++)
+        ctx->row[cnt].index++;
+
+    ctx->row[pos].index = pos;
+
+    ctx->row[pos].size = len;
+    ctx->row[pos].chars = malloc(len + 1);
+    memcpy(ctx->row[pos].chars, s, len);
+    ctx->row[pos].chars[len] = '\0';
+    ctx->stats.row_bytes += len + 1;
+
+    ctx->row[pos].rowsize = 0;
+    ctx->row[pos].render = NULL;
+    ctx->row[pos].highlight = NULL;
+    ctx->row[pos].highlight_open_comment = 0;
+    ctx->row[pos].width = 0;
+    ctx->row[pos].ncp = 0;
+    ctx->row[pos].match_stamp = 0;
+    ctx->row[pos].cp = NULL;
+    ctx->row[pos].bracket_net = 0;
+    ctx->row[pos].bracket_min = 1;
+    ctx->numrows++;
+    editorLineIndexInsert(ctx, pos);
+    editorBracketInsert(ctx, pos);
+    editorFoldRowsReplaced(ctx, pos, 0, 1);
+    editorUpdateRow(ctx, &ctx->row[pos]);
+
+    ctx->dirty++;
+}
+
+// bulk path for text arriving at the end of the buffer (followed files,
+// streamed loads). the row array grows once for the whole chunk and no
+// rows have to be shifted or renumbered. when `partial` is set the last
+// row didn't end in a newline yet and the chunk continues it. the buffer
+// is not marked dirty. returns whether the chunk itself ends mid-line.
+int editorAppendLines(editorContext *ctx, const char *data, size_t len, int partial)
+{
+    const char *ptr = data;
+    const char *end = data + len;
+
+    if (len == 0)
+        return partial;
+
+    if (partial && ctx->numrows > 0)
+    {
+        erow *row = &ctx->row[ctx->numrows - 1];
+        const char *newline = memchr(ptr, '\n', end - ptr);
+        size_t seglen = (newline ? newline : end) - ptr;
+        if (newline && seglen > 0 && ptr[seglen - 1] == '\r')
+            seglen--;
+
+        row->chars = realloc(row->chars, row->size + seglen + 1);
+        memcpy(&row->chars[row->size], ptr, seglen);
+        row->size += seglen;
+        row->chars[row->size] = '\0';
+        ctx->stats.row_bytes += seglen;
+        editorUpdateRow(ctx, row);
+
+        if (newline == NULL)
+            return 1;
+        ptr = newline + 1;
+    }
+
+    size_t lines = 0;
+    for (const char *scan = ptr; scan < end && (scan = memchr(scan, '\n', end - scan)); scan++)
+        lines++;
+    int tail = ptr < end && end[-1] != '\n';
+    lines += tail;
+
+    if (lines == 0)
+        return 0;
+
+    erow *rows = realloc(ctx->row, sizeof(erow) * (ctx->numrows + lines));
+    if (rows == NULL)
+        return tail;
+    ctx->row = rows;
+
+    int first = ctx->numrows;
+    while (ptr < end)
+    {
+        const char *newline = memchr(ptr, '\n', end - ptr);
+        size_t linelen = (newline ? newline : end) - ptr;
+        if (newline && linelen > 0 && ptr[linelen - 1] == '\r')
+            linelen--;
+
+        erow *row = &ctx->row[ctx->numrows];
+        row->index = ctx->numrows;
+        row->size = linelen;
+        row->chars = malloc(linelen + 1);
+        memcpy(row->chars, ptr, linelen);
+        row->chars[linelen] = '\0';
+        row->rowsize = 0;
+        row->render = NULL;
+        row->highlight = NULL;
+        row->highlight_open_comment = 0;
+        row->width = 0;
+        row->ncp = 0;
+        row->match_stamp = 0;
+        row->cp = NULL;
+        row->bracket_net = 0;
+        row->bracket_min = 1;
+        ctx->stats.row_bytes += linelen + 1;
+        ctx->numrows++;
+        editorLineIndexInsert(ctx, row->index);
+        editorBracketInsert(ctx, row->index);
+
+        ptr = newline ? newline + 1 : end;
+    }
+
+    for (int cnt = first; cnt < ctx->numrows; cnt++)
+        editorUpdateRow(ctx, &ctx->row[cnt]);
+
+    return tail;
+}
+
+void editorRowDeleteChar(editorContext *ctx, erow *row, int pos)
+{
+    if (pos < 0 || pos > row->size)
+        return;
+    memmove(&row->chars[pos], &row->chars[pos + 1], row->size - pos);
+    row->size--;
+    ctx->stats.row_bytes--;
+    editorUpdateRow(ctx, row);
+    ctx->dirty++;
+}
+
+void editorRowDeleteBytes(editorContext *ctx, erow *row, int pos, int len)
+{
+    if (pos < 0 || len <= 0 || pos + len > row->size)
+        return;
+    memmove(&row->chars[pos], &row->chars[pos + len], row->size - pos - len + 1);
+    row->size -= len;
+    ctx->stats.row_bytes -= len;
+    editorUpdateRow(ctx, row);
+    ctx->dirty++;
+}
+
+void editorRowInsertChar(editorContext *ctx, erow *row, int at, int c)
+{
+    if (at < 0 || at > row->size)
+        at = row->size;
+
+    row->chars = realloc(row->chars, row->size + 2);
+    memmove(&row->chars[at + 1], &row->chars[at], row->size - at + 1);
+    row->size++;
+    ctx->stats.row_bytes++;
+    row->chars[at] = c;
+    editorUpdateRow(ctx, row);
+    ctx->dirty++;
+}
+
+void editorRowAppendString(editorContext *ctx, erow *row, char *str, size_t len)
+{
+    row->chars = realloc(row->chars, row->size + len + 1);
+    memcpy(&row->chars[row->size], str, len);
+    row->size += len;
+    ctx->stats.row_bytes += len;
+    row->chars[row->size] = '\0';
+    editorUpdateRow(ctx, row);
+    ctx->dirty++;
+}
+
+/***  editor operations  ***/
+
+void editorInsertChar(editorContext *ctx, int c)
+{
+    if (ctx->cy == ctx->numrows)
+        editorInsertRow(ctx, ctx->numrows, "", 0);
+
+    editorRowInsertChar(ctx, &ctx->row[ctx->cy], ctx->cx, c);
+    ctx->cx++;
+}
+
+void editorinsertNewLine(editorContext *ctx)
+{
+    if (ctx->cx == 0)
+        editorInsertRow(ctx, ctx->cy, "", 0);
+    else
+    {
+        erow *row = &ctx->row[ctx->cy];
+        editorInsertRow(ctx, ctx->cy + 1, &row->chars[ctx->cx], row->size - ctx->cx);
+        row = &ctx->row[ctx->cy];
+        ctx->stats.row_bytes -= row->size - ctx->cx;
+        row->size = ctx->cx;
+        row->chars[row->size] = '\0';
+        editorUpdateRow(ctx, row);
+    }
+    ctx->cy++;
+    ctx->cx = 0;
+}
+
+void editorDeleteChar(editorContext *ctx)
+{
+    if (ctx->cy == ctx->numrows)
+        return;
+    if (ctx->cx == 0 && ctx->cy == 0)
+        return;
+
+    erow *row = &ctx->row[ctx->cy];
+    if (ctx->cx > 0)
+    {
+        int prev = editorRowPrevCx(row, ctx->cx);
+        editorRowDeleteBytes(ctx, row, prev, ctx->cx - prev);
+        ctx->cx = prev;
+    }
+    else
+    {
+        ctx->cx = ctx->row[ctx->cy - 1].size;
+        editorRowAppendString(ctx, &ctx->row[ctx->cy - 1], row->chars, row->size);
+        editorDeleteRow(ctx, ctx->cy);
+        ctx->cy--;
+    }
+}
@@ -0,0 +1,335 @@
+/*** includes ***/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/xattr.h>
+#include <unistd.h>
+
+#include "ascend.h"
+
+/*** defines ***/
+#define SAVE_BUFFER_BYTES (1 << 20)
+
+/***  background save  ***/
+
+// a forked child gets a copy-on-write image of the whole process, so its
+// rows stay exactly as they were at the fork however the buffer is edited
+// afterwards, and nothing has to be copied up front. the child writes
+// them to a temporary file next to the target and renames it over the
+// target, so the file is never seen half written. the temporary file is
+// given the old one's owner, group, mode and extended attributes (ACLs and
+// security labels included) first. a rename still can't keep other hard
+// links to the old inode, so when the file has them, when any of that
+// can't be copied, or when the directory can't take a new file, the child
+// writes over the old file in place instead.
+
+// writes the rows to `fd`, keeping the shared byte count current
+static long long saveWriteRows(editorContext *ctx, int fd, struct editorSaveShared *shared)
+{
+    FILE *fp = fdopen(fd, "w");
+    if (fp == NULL)
+        return -1;
+    setvbuf(fp, NULL, _IOFBF, SAVE_BUFFER_BYTES);
+
+    long long done = 0;
+    for (int cnt = 0; cnt < ctx->numrows; cnt++)
+    {
+        erow *row = &ctx->row[cnt];
+        if (fwrite(row->chars, 1, row->size, fp) != (size_t)row->size || fputc('\n', fp) == EOF)
+        {
+            fclose(fp);
+            return -1;
+        }
+        done += row->size + 1;
+        __atomic_store_n(&shared->done, done, __ATOMIC_RELAXED);
+    }
+    return fclose(fp) == 0
+               ? done
+               : -1;
+}
+
+// writes over `target` itself, as editorWriteFile does: returns the byte
+// count or -1 with errno set
+static long long saveWriteInPlace(editorContext *ctx, const char *target, int compressed,
+                                  struct editorSaveShared *shared)
+{
+    int fd = open(target, O_RDWR | O_CREAT, 0644);
+    if (fd == -1)
+        return -1;
+
+    if (compressed)
+    {
+        long long written = editorWriteGzip(ctx, fd);
+        if (written != -1 && ftruncate(fd, written) == -1)
+            written = -1;
+        int saved = errno;
+        if (close(fd) == -1 && written != -1)
+            return -1;
+        errno = saved;
+        return written;
+    }
+
+    if (ftruncate(fd, editorRowOffset(ctx, ctx->numrows)) == -1)
+    {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return saveWriteRows(ctx, fd, shared);
+}
+
+// copies the extended attributes of `target`, ACLs and security labels
+// among them, onto the temporary file `fd`. returns 0, or -1 when one of
+// them can't be read or set.
+static int saveCopyXattrs(const char *target, int fd)
+{
+    int src = open(target, O_RDONLY);
+    if (src == -1)
+        return -1;
+
+    ssize_t size = flistxattr(src, NULL, 0);
+    if (size <= 0)
+    {
+        int unsupported = (size == -1 && (errno == ENOTSUP || errno == ENOSYS));
+        close(src);
+        return (size == 0 || unsupported)
+                   ? 0
+                   : -1;
+    }
+
+    char *names = malloc(size);
+    char *value = NULL;
+    int result = (names && flistxattr(src, names, size) == size)
+                     ? 0
+                     : -1;
+    for (char *name = names; result == 0 && name < names + size; name += strlen(name) + 1)
+    {
+        ssize_t len = fgetxattr(src, name, NULL, 0);
+        char *grown = (len > 0)
+                          ? realloc(value, len)
+                          : value;
+        if (len == -1 || (len > 0 && grown == NULL))
+        {
+            result = -1;
+            break;
+        }
+        value = grown;
+        if ((len > 0 && fgetxattr(src, name, value, len) != len) ||
+            fsetxattr(fd, name, value, len, 0) == -1)
+            result = -1;
+    }
+
+    free(value);
+    free(names);
+    close(src);
+    return result;
+}
+
+// runs in the child: returns 0, or -1 with errno set
+static int saveWrite(editorContext *ctx, int compressed, struct editorSaveShared *shared)
+{
+    char target[PATH_MAX];
+    char tmp[PATH_MAX + 32];
+    struct stat st;
+    struct stat tmpst;
+    long long written;
+
+    // write through a symlink to the file it points at
+    if (realpath(ctx->filename, target) == NULL)
+        snprintf(target, sizeof(target), "%s", ctx->filename);
+    snprintf(tmp, sizeof(tmp), "%s.%d.save", target, (int)getpid());
+
+    int exists = (stat(target, &st) == 0);
+    int fd = (exists && st.st_nlink > 1)
+                 ? -1
+                 : open(tmp, O_WRONLY | O_CREAT | O_EXCL, 0644);
+
+    // the new file must come out with the old one's owner, group, mode and
+    // extended attributes. the owner and group take root or a matching
+    // owner, and the attributes go last since a change of owner clears some
+    if (fd != -1 && exists)
+    {
+        if (fstat(fd, &tmpst) == -1 ||
+            ((tmpst.st_uid != st.st_uid || tmpst.st_gid != st.st_gid) &&
+             fchown(fd, st.st_uid, st.st_gid) == -1) ||
+            fchmod(fd, st.st_mode & 07777) == -1 ||
+            saveCopyXattrs(target, fd) == -1)
+        {
+            close(fd);
+            unlink(tmp);
+            fd = -1;
+        }
+    }
+
+    if (fd == -1)
+    {
+        written = saveWriteInPlace(ctx, target, compressed, shared);
+        if (written == -1)
+            return -1;
+        shared->written = written;
+        return 0;
+    }
+
+    if (compressed)
+    {
+        written = editorWriteGzip(ctx, fd);
+        if (close(fd) == -1)
+            written = -1;
+    }
+    else
+        written = saveWriteRows(ctx, fd, shared);
+
+    if (written == -1 || rename(tmp, target) == -1)
+    {
+        int saved = errno;
+        unlink(tmp);
+        errno = saved;
+        return -1;
+    }
+    shared->written = written;
+    return 0;
+}
+
+// starts writing the buffer to ctx->filename in a child process and
+// returns at once; editorSavePoll picks up the result. hex views patch
+// the file in place, they are saved with editorWriteFile. returns 0, or
+// -1 with errno set.
+int editorSaveStart(editorContext *ctx)
+{
+    if (ctx->filename == NULL || ctx->hex)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if (ctx->save)
+    {
+        errno = EBUSY;
+        return -1;
+    }
+
+    struct editorSave *save = calloc(1, sizeof(*save));
+    if (save == NULL)
+        return -1;
+
+    save->shared = mmap(NULL, sizeof(struct editorSaveShared), PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (save->shared == MAP_FAILED)
+    {
+        free(save);
+        return -1;
+    }
+
+    // the child keeps the write end open until it exits, so the read end
+    // turns readable (end of file) the moment the save is over
+    int pipefd[2];
+    if (pipe2(pipefd, O_CLOEXEC) == -1)
+    {
+        int saved = errno;
+        munmap(save->shared, sizeof(struct editorSaveShared));
+        free(save);
+        errno = saved;
+        return -1;
+    }
+
+    save->total = editorRowOffset(ctx, ctx->numrows);
+    save->dirty = ctx->dirty;
+
+    // names ending in .gz are written compressed, as editorWriteFile does
+    size_t namelen = strlen(ctx->filename);
+    save->compressed = (namelen > 3 && !strcmp(ctx->filename + namelen - 3, ".gz"));
+
+    save->pid = fork();
+    if (save->pid == 0)
+    {
+        close(pipefd[0]);
+        if (saveWrite(ctx, save->compressed, save->shared) == -1)
+        {
+            save->shared->error = errno;
+            _exit(1);
+        }
+        _exit(0);
+    }
+
+    int saved = errno;
+    close(pipefd[1]);
+    if (save->pid == -1)
+    {
+        close(pipefd[0]);
+        munmap(save->shared, sizeof(struct editorSaveShared));
+        free(save);
+        errno = saved;
+        return -1;
+    }
+
+    save->fd = pipefd[0];
+    ctx->save = save;
+    return 0;
+}
+
+// how far the save in flight has got, 0 to 100, or -1 when that can't be
+// told because the output is compressed
+int editorSavePercent(editorContext *ctx)
+{
+    struct editorSave *save = ctx->save;
+    if (save == NULL || save->compressed)
+        return -1;
+    if (save->total <= 0)
+        return 100;
+    return __atomic_load_n(&save->shared->done, __ATOMIC_RELAXED) * 100 / save->total;
+}
+
+// collects the save in flight, blocking until it is over when `wait` is
+// set. returns 1 while it is still running, 0 once the file is written
+// (with its size in `written`), or -1 with errno set when it failed. edits
+// made while the save ran are not in the file, so only the changes the
+// snapshot held are taken off ctx->dirty.
+int editorSavePoll(editorContext *ctx, int wait, long long *written)
+{
+    struct editorSave *save = ctx->save;
+    int status;
+    pid_t pid;
+
+    if (save == NULL)
+        return 0;
+
+    while ((pid = waitpid(save->pid, &status, wait ? 0 : WNOHANG)) == -1 && errno == EINTR)
+        ;
+    if (pid == 0)
+        return 1;
+
+    int result = 0;
+    if (pid == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        result = -1;
+        errno = (pid != -1 && save->shared->error)
+                    ? save->shared->error
+                    : EIO;
+    }
+    else
+    {
+        *written = save->shared->written;
+        ctx->dirty = (ctx->dirty > save->dirty)
+                         ? ctx->dirty - save->dirty
+                         : 0;
+    }
+
+    int saved = errno;
+    close(save->fd);
+    munmap(save->shared, sizeof(struct editorSaveShared));
+    free(save);
+    ctx->save = NULL;
+    errno = saved;
+    return result;
+}
@@ -0,0 +1,324 @@
+/*** includes ***/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ascend.h"
+
+/***  scripts  ***/
+
+// a script is one command per line, applied to the buffer from the top with
+// the cursor starting at the beginning of the file:
+//
+//   find TEXT          move to the next occurrence of TEXT
+//   goto N             line N; @N for byte offset N, $ for the end
+//   insert TEXT        insert TEXT at the cursor and move past it
+//   delete N           delete N bytes from the cursor, newlines count one
+//   replace /OLD/NEW/  replace every OLD in the buffer, any delimiter works
+//   save [PATH]        write the buffer back, to PATH, or to stdout for -
+//
+// the argument is everything after the first space. \n, \t and \\ are
+// unescaped in text. blank lines and lines starting with # are skipped.
+
+static void scriptError(FILE *errors, const char *name, int lineno, const char *fmt, ...)
+{
+    va_list ap;
+
+    if (errors == NULL)
+        return;
+    fprintf(errors, "%s:%d: ", name, lineno);
+    va_start(ap, fmt);
+    vfprintf(errors, fmt, ap);
+    va_end(ap);
+    fputc('\n', errors);
+}
+
+// unescapes `s` in place, returns its new length
+static size_t scriptUnescape(char *s)
+{
+    char *out = s;
+    for (char *p = s; *p; p++)
+    {
+        if (*p != '\\' || p[1] == '\0')
+        {
+            *out++ = *p;
+            continue;
+        }
+
+        switch (*++p)
+        {
+        case 'n':
+            *out++ = '\n';
+            break;
+        case 't':
+            *out++ = '\t';
+            break;
+        case '\\':
+            *out++ = '\\';
+            break;
+        default:
+            *out++ = '\\';
+            *out++ = *p;
+            break;
+        }
+    }
+    *out = '\0';
+    return out - s;
+}
+
+static long long scriptNumber(const char *s, int *ok)
+{
+    char *end;
+    long long value = strtoll(s, &end, (s[0] == '0' && (s[1] == 'x' || s[1] == 'X')) ? 16 : 10);
+    *ok = (end != s && *end == '\0' && value >= 0);
+    return value;
+}
+
+// moves the cursor to line `value`, or to byte `value` when `is_offset`.
+// returns 0, or -1 with errno set when the line index can't be built.
+static int scriptGoto(editorContext *ctx, long long value, int is_offset)
+{
+    if (ctx->numrows == 0)
+    {
+        ctx->cy = 0;
+        ctx->cx = 0;
+    }
+    else if (is_offset)
+    {
+        int row = editorOffsetToRow(ctx, value);
+        if (row == -1)
+            return -1;
+        long long cx = value - editorRowOffset(ctx, row);
+
+        ctx->cy = row;
+        ctx->cx = (cx > ctx->row[row].size)
+                      ? ctx->row[row].size
+                      : cx;
+    }
+    else
+    {
+        ctx->cy = (value < 1)
+                      ? 0
+                      : (value > ctx->numrows)
+                            ? ctx->numrows - 1
+                            : value - 1;
+        ctx->cx = 0;
+    }
+    return 0;
+}
+
+// the position `count` bytes on from the cursor, stopping at the end
+static void scriptAdvance(editorContext *ctx, long long count, int *cy, int *cx)
+{
+    *cy = ctx->cy;
+    *cx = ctx->cx;
+    while (count > 0 && *cy < ctx->numrows)
+    {
+        long long room = ctx->row[*cy].size - *cx;
+        if (count <= room)
+        {
+            *cx += count;
+            return;
+        }
+        count -= room + 1;
+        (*cy)++;
+        *cx = 0;
+    }
+}
+
+// writes the rows to `fp` without building the file in memory first
+static int scriptWriteRows(editorContext *ctx, FILE *fp)
+{
+    for (int cnt = 0; cnt < ctx->numrows; cnt++)
+    {
+        erow *row = &ctx->row[cnt];
+        if (fwrite(row->chars, 1, row->size, fp) != (size_t)row->size || fputc('\n', fp) == EOF)
+            return -1;
+    }
+    return fflush(fp);
+}
+
+// runs the script read from `script` against the buffer. `name` labels
+// error messages, which go to `errors` (may be NULL). stops at the first
+// command that fails and returns -1, or 0 when every command succeeded.
+// nothing is rendered or highlighted beyond the rows the commands touch.
+int editorRunScript(editorContext *ctx, FILE *script, const char *name, FILE *errors)
+{
+    char *line = NULL;
+    size_t linecap = 0;
+    ssize_t linelen;
+    int lineno = 0;
+    int result = 0;
+
+    // a find that lands on a match leaves the cursor there; the next find
+    // starts one byte on so repeating it walks through the matches
+    int at_match = 0;
+
+    while (result == 0 && (linelen = getline(&line, &linecap, script)) != -1)
+    {
+        lineno++;
+        while (linelen > 0 && (line[linelen - 1] == '\n' || line[linelen - 1] == '\r'))
+            line[--linelen] = '\0';
+        if (linelen == 0 || line[0] == '#')
+            continue;
+
+        char *arg = strchr(line, ' ');
+        if (arg)
+            *arg++ = '\0';
+        else
+            arg = line + linelen;
+
+        int found_match = 0;
+        int ok;
+
+        if (!strcmp(line, "find"))
+        {
+            int match_cx;
+            scriptUnescape(arg);
+            if (strchr(arg, '\n'))
+            {
+                scriptError(errors, name, lineno, "find: text can't span lines");
+                result = -1;
+                continue;
+            }
+            int row = (arg[0] != '\0')
+                          ? editorFindForward(ctx, arg, ctx->cy, ctx->cx + at_match, &match_cx)
+                          : -1;
+            if (row == -1)
+            {
+                scriptError(errors, name, lineno, "find: \"%s\" not found", arg);
+                result = -1;
+            }
+            else
+            {
+                ctx->cy = row;
+                ctx->cx = match_cx;
+                found_match = 1;
+            }
+        }
+        else if (!strcmp(line, "goto"))
+        {
+            if (!strcmp(arg, "$"))
+            {
+                ctx->cy = ctx->numrows;
+                ctx->cx = 0;
+            }
+            else
+            {
+                int is_offset = (arg[0] == '@');
+                long long value = scriptNumber(arg + is_offset, &ok);
+                if (!ok)
+                {
+                    scriptError(errors, name, lineno, "goto: bad position \"%s\"", arg);
+                    result = -1;
+                }
+                else if (scriptGoto(ctx, value, is_offset) == -1)
+                {
+                    scriptError(errors, name, lineno, "goto: %s", strerror(errno));
+                    result = -1;
+                }
+            }
+        }
+        else if (!strcmp(line, "insert"))
+        {
+            size_t len = scriptUnescape(arg);
+            if (len > 0 && editorInsertText(ctx, ctx->cy, ctx->cx, arg, len, &ctx->cy, &ctx->cx) == -1)
+            {
+                scriptError(errors, name, lineno, "insert: %s", strerror(errno));
+                result = -1;
+            }
+        }
+        else if (!strcmp(line, "delete"))
+        {
+            int cy, cx;
+            long long count = scriptNumber(arg, &ok);
+            if (!ok)
+            {
+                scriptError(errors, name, lineno, "delete: bad count \"%s\"", arg);
+                result = -1;
+            }
+            else
+            {
+                scriptAdvance(ctx, count, &cy, &cx);
+                editorDeleteRange(ctx, ctx->cy, ctx->cx, cy, cx);
+            }
+        }
+        else if (!strcmp(line, "replace"))
+        {
+            // /old/new/ with the first character as the delimiter
+            char delim = arg[0];
+            char *old = arg + 1;
+            char *sep = delim ? strchr(old, delim) : NULL;
+            char *end = sep ? strchr(sep + 1, delim) : NULL;
+            if (end == NULL || sep == old || end[1] != '\0')
+            {
+                scriptError(errors, name, lineno, "replace: expected /old/new/");
+                result = -1;
+                continue;
+            }
+            *sep = '\0';
+            *end = '\0';
+            scriptUnescape(old);
+            scriptUnescape(sep + 1);
+
+            // editorReplaceAll works inside rows, it can't split or join them
+            if (strchr(old, '\n') || strchr(sep + 1, '\n'))
+            {
+                scriptError(errors, name, lineno, "replace: text can't span lines");
+                result = -1;
+                continue;
+            }
+
+            if (editorReplaceAll(ctx, old, sep + 1) == -1)
+            {
+                scriptError(errors, name, lineno, "replace: %s", strerror(errno));
+                result = -1;
+            }
+            else if (ctx->cy < ctx->numrows && ctx->cx > ctx->row[ctx->cy].size)
+                ctx->cx = ctx->row[ctx->cy].size;
+        }
+        else if (!strcmp(line, "save"))
+        {
+            if (!strcmp(arg, "-"))
+            {
+                if (scriptWriteRows(ctx, stdout) == -1)
+                {
+                    scriptError(errors, name, lineno, "save: %s", strerror(errno));
+                    result = -1;
+                }
+            }
+            else
+            {
+                if (arg[0])
+                {
+                    free(ctx->filename);
+                    ctx->filename = strdup(arg);
+                }
+                if (editorWriteFile(ctx) == -1)
+                {
+                    scriptError(errors, name, lineno, "save: %s: %s",
+                                ctx->filename ? ctx->filename : "no file name",
+                                strerror(errno));
+                    result = -1;
+                }
+            }
+        }
+        else
+        {
+            scriptError(errors, name, lineno, "unknown command \"%s\"", line);
+            result = -1;
+        }
+
+        at_match = found_match;
+    }
+
+    free(line);
+    return result;
+}
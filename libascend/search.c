@@ -0,0 +1,246 @@
+/*** includes ***/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ascend.h"
+
+/***  search  ***/
+
+// walks the rows after `from` in `direction`, wrapping around the buffer,
+// and returns the first row whose render contains `query` (-1 if none).
+// `from` may be -1 to start at the top.
+int editorFindRow(editorContext *ctx, const char *query, int from, int direction, int *match_rx)
+{
+    int current = from;
+    int cnt;
+
+    for (cnt = 0; cnt < ctx->numrows; cnt++)
+    {
+        current += direction;
+
+        if (current == -1)
+            current = ctx->numrows - 1;
+        else if (current == ctx->numrows)
+            current = 0;
+
+        erow *row = &ctx->row[current];
+        editorRowEnsureDerived(ctx, row);
+        char *match = strstr(row->render, query);
+        if (match)
+        {
+            if (match_rx)
+                *match_rx = match - row->render;
+            return current;
+        }
+    }
+    return -1;
+}
+
+// the first occurrence of `query` at or after (cy, cx), going forward only
+// and never wrapping, so a caller stepping one byte past each match walks
+// through them once and then fails. searches chars, so rows it passes over
+// are not rendered. returns the row and stores the column in `match_cx`,
+// or returns -1.
+int editorFindForward(editorContext *ctx, const char *query, int cy, int cx, int *match_cx)
+{
+    if (query[0] == '\0' || cy < 0)
+        return -1;
+
+    for (int cnt = cy; cnt < ctx->numrows; cnt++)
+    {
+        erow *row = &ctx->row[cnt];
+        int from = (cnt == cy) ? cx : 0;
+        if (from > row->size)
+            continue;
+
+        char *match = strstr(&row->chars[from], query);
+        if (match)
+        {
+            if (match_cx)
+                *match_cx = match - row->chars;
+            return cnt;
+        }
+    }
+    return -1;
+}
+
+// replaces every occurrence of `query` in the buffer. each affected row is
+// rebuilt with a single allocation and copy, and highlighting is redone once
+// for the whole span of touched rows afterwards instead of after every byte.
+// returns the number of replacements, or -1 with errno set.
+long long editorReplaceAll(editorContext *ctx, const char *query, const char *replacement)
+{
+    size_t qlen = strlen(query);
+    size_t rlen = strlen(replacement);
+    long long total = 0;
+    int first = -1;
+    int last = -1;
+    int cnt;
+
+    if (qlen == 0)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (cnt = 0; cnt < ctx->numrows; cnt++)
+    {
+        erow *row = &ctx->row[cnt];
+        char *end = row->chars + row->size;
+        char *match = memmem(row->chars, row->size, query, qlen);
+        if (match == NULL)
+            continue;
+
+        long long matches = 0;
+        for (char *p = match; p; p = memmem(p + qlen, end - p - qlen, query, qlen))
+            matches++;
+
+        size_t size = row->size + matches * rlen - matches * qlen;
+        char *chars = malloc(size + 1);
+        if (chars == NULL)
+        {
+            errno = ENOMEM;
+            total = -1;
+            break;
+        }
+
+        char *src = row->chars;
+        char *dst = chars;
+        while (match)
+        {
+            memcpy(dst, src, match - src);
+            dst += match - src;
+            memcpy(dst, replacement, rlen);
+            dst += rlen;
+            src = match + qlen;
+            match = memmem(src, end - src, query, qlen);
+        }
+        memcpy(dst, src, end - src);
+        chars[size] = '\0';
+
+        free(row->chars);
+        row->chars = chars;
+        ctx->stats.row_bytes += size;
+        ctx->stats.row_bytes -= row->size;
+        row->size = size;
+        editorLineIndexUpdate(ctx, row);
+        editorRenderRow(ctx, row);
+
+        if (first == -1)
+            first = cnt;
+        last = cnt;
+        total += matches;
+    }
+
+    if (first != -1)
+    {
+        editorUpdateSyntaxRange(ctx, first, last);
+        ctx->dirty++;
+    }
+    return total;
+}
+
+/***  match cache  ***/
+
+// makes `query` the one whose matches editorRowMatches reports. the cache
+// survives calls with the same query, so stepping between matches doesn't
+// rescan anything. NULL or "" drops the cache. returns 0, or -1 with errno
+// set.
+int editorSetSearch(editorContext *ctx, const char *query)
+{
+    struct editorMatches *m = ctx->matches;
+
+    if (query == NULL || *query == '\0')
+    {
+        if (m == NULL)
+            return 0;
+        for (int cnt = 0; cnt < ASCEND_MATCH_SLOTS; cnt++)
+            free(m->slot[cnt].rx);
+        free(m->query);
+        free(m);
+        ctx->matches = NULL;
+        return 0;
+    }
+
+    if (m && strcmp(m->query, query) == 0)
+        return 0;
+
+    char *copy = strdup(query);
+    if (copy == NULL)
+        return -1;
+
+    if (m == NULL)
+    {
+        m = calloc(1, sizeof(*m));
+        if (m == NULL)
+        {
+            free(copy);
+            return -1;
+        }
+        ctx->matches = m;
+    }
+
+    // stamps keep counting up, so rows still holding one from the old
+    // query can never match a slot filled for the new one
+    free(m->query);
+    m->query = copy;
+    m->len = strlen(copy);
+    for (int cnt = 0; cnt < ASCEND_MATCH_SLOTS; cnt++)
+        m->slot[cnt].stamp = 0;
+    return 0;
+}
+
+// render offsets where the search query starts in row `pos`, each match
+// `ctx->matches->len` bytes long. rows are scanned the first time they're
+// asked for after the query changed or the row was edited. returns NULL
+// with *count = 0 when there is no search.
+const int *editorRowMatches(editorContext *ctx, int pos, int *count)
+{
+    struct editorMatches *m = ctx->matches;
+
+    *count = 0;
+    if (m == NULL || pos < 0 || pos >= ctx->numrows)
+        return NULL;
+
+    erow *row = &ctx->row[pos];
+    editorRowEnsureDerived(ctx, row);
+
+    struct editorMatchSlot *slot = &m->slot[pos % ASCEND_MATCH_SLOTS];
+    if (slot->stamp && slot->row == pos && slot->stamp == row->match_stamp)
+    {
+        *count = slot->count;
+        return slot->rx;
+    }
+
+    slot->row = pos;
+    slot->count = 0;
+    const char *end = row->render + row->rowsize;
+    for (const char *p = row->render; (p = memmem(p, end - p, m->query, m->len)); p += m->len)
+    {
+        if (slot->count == slot->cap)
+        {
+            int cap = slot->cap ? slot->cap * 2 : 8;
+            int *rx = realloc(slot->rx, sizeof(int) * cap);
+            if (rx == NULL)
+                break;
+            slot->rx = rx;
+            slot->cap = cap;
+        }
+        slot->rx[slot->count++] = p - row->render;
+    }
+
+    // 0 marks an empty slot, skip it when the counter wraps
+    if (++m->stamp == 0)
+        m->stamp = 1;
+    slot->stamp = m->stamp;
+    row->match_stamp = m->stamp;
+
+    *count = slot->count;
+    return slot->rx;
+}
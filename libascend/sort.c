@@ -0,0 +1,405 @@
+/*** includes ***/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ascend.h"
+
+/*** defines ***/
+#define SORT_MIN_RUN 32768 // fewer rows aren't worth a thread
+#define SORT_MAX_THREADS 64
+#define SORT_INSERTION 16 // shorter runs are insertion sorted
+#define SORT_PREFETCH 16  // rows fetched ahead while they are moved
+
+/*** data ***/
+
+// what is sorted: a row and its first eight bytes read big-endian, so most
+// comparisons are settled without touching the row or its text
+struct sortKey
+{
+    unsigned long long prefix;
+    erow *row;
+};
+
+// one piece of work for a sorter thread: sorting a run of row pointers in
+// place, or merging two sorted runs into `out`
+struct sortJob
+{
+    pthread_t thread;
+    struct sortKey *a;
+    int na;
+    struct sortKey *b; // NULL for a sort job
+    int nb;
+    struct sortKey *out; // scratch space for a sort job
+    int reverse;
+};
+
+/***  sorting  ***/
+
+// rows are ordered by their bytes, like `LC_ALL=C sort`. only keys pointing
+// at the rows are sorted: each thread merge sorts a slice, then the slices
+// are merged pairwise with every merge split between the threads, and the
+// row structs are moved into their new places once at the end. the text
+// itself is never copied.
+
+static unsigned long long sortPrefix(erow *row)
+{
+    unsigned long long prefix = 0;
+
+    for (int cnt = 0; cnt < 8; cnt++)
+        prefix = (prefix << 8) | (cnt < row->size ? (unsigned char)row->chars[cnt] : 0);
+    return prefix;
+}
+
+static int sortCompareRows(const erow *a, const erow *b, int reverse)
+{
+    int len = (a->size < b->size)
+                  ? a->size
+                  : b->size;
+    int diff = memcmp(a->chars, b->chars, len);
+    if (diff == 0)
+        diff = a->size - b->size;
+    return reverse
+               ? -diff
+               : diff;
+}
+
+// reverse sorts store the prefixes complemented, so they always compare
+// ascending. rows with the same prefix may still differ past it, or in
+// length when one ends in NUL bytes
+static int sortCompare(const struct sortKey *a, const struct sortKey *b, int reverse)
+{
+    if (a->prefix != b->prefix)
+        return (a->prefix < b->prefix)
+                   ? -1
+                   : 1;
+    return sortCompareRows(a->row, b->row, reverse);
+}
+
+// stable: on a tie the row from `a` goes first. which side a key comes
+// from is data, not a branch, so random input costs no mispredictions
+static void sortMerge(struct sortKey *a, int na, struct sortKey *b, int nb, struct sortKey *out, int reverse)
+{
+    int i = 0, j = 0;
+
+    while (i < na && j < nb)
+    {
+        int take_b = sortCompare(&b[j], &a[i], reverse) < 0;
+        *out++ = take_b
+                     ? b[j]
+                     : a[i];
+        j += take_b;
+        i += !take_b;
+    }
+    memcpy(out, &a[i], sizeof(struct sortKey) * (na - i));
+    memcpy(out + na - i, &b[j], sizeof(struct sortKey) * (nb - j));
+}
+
+// how many keys of the sorted run `keys` come before `key`
+static int sortLowerBound(struct sortKey *keys, int n, struct sortKey *key, int reverse)
+{
+    int lo = 0, hi = n;
+
+    while (lo < hi)
+    {
+        int mid = lo + (hi - lo) / 2;
+        if (sortCompare(&keys[mid], key, reverse) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static void sortInPlace(struct sortKey *keys, struct sortKey *scratch, int n, int reverse);
+
+// sorts `keys` into `out`, using `keys` as scratch space
+static void sortInto(struct sortKey *keys, struct sortKey *out, int n, int reverse)
+{
+    if (n <= SORT_INSERTION)
+    {
+        memcpy(out, keys, sizeof(struct sortKey) * n);
+        sortInPlace(out, keys, n, reverse);
+        return;
+    }
+
+    int half = n / 2;
+    sortInPlace(keys, out, half, reverse);
+    sortInPlace(keys + half, out + half, n - half, reverse);
+    sortMerge(keys, half, keys + half, n - half, out, reverse);
+}
+
+// sorts `keys` where they are, using `scratch` as scratch space
+static void sortInPlace(struct sortKey *keys, struct sortKey *scratch, int n, int reverse)
+{
+    if (n <= SORT_INSERTION)
+    {
+        for (int cnt = 1; cnt < n; cnt++)
+        {
+            struct sortKey key = keys[cnt];
+            int pos = cnt;
+            for (; pos > 0 && sortCompare(&keys[pos - 1], &key, reverse) > 0; pos--)
+                keys[pos] = keys[pos - 1];
+            keys[pos] = key;
+        }
+        return;
+    }
+
+    int half = n / 2;
+    sortInto(keys, scratch, half, reverse);
+    sortInto(keys + half, scratch + half, n - half, reverse);
+    sortMerge(scratch, half, scratch + half, n - half, keys, reverse);
+}
+
+static void *sortJobMain(void *arg)
+{
+    struct sortJob *job = arg;
+
+    // each thread reads the prefixes of its own slice
+    if (job->b == NULL)
+    {
+        for (int cnt = 0; cnt < job->na; cnt++)
+            job->a[cnt].prefix = job->reverse
+                                     ? ~sortPrefix(job->a[cnt].row)
+                                     : sortPrefix(job->a[cnt].row);
+        sortInPlace(job->a, job->out, job->na, job->reverse);
+    }
+    else
+        sortMerge(job->a, job->na, job->b, job->nb, job->out, job->reverse);
+    return NULL;
+}
+
+// runs the jobs on threads of their own, the last one on the calling
+// thread. jobs that can't get a thread run there too
+static void sortRunJobs(struct sortJob *jobs, int njobs)
+{
+    int started = 0;
+    while (started < njobs - 1 && pthread_create(&jobs[started].thread, NULL, sortJobMain, &jobs[started]) == 0)
+        started++;
+    for (int cnt = started; cnt < njobs; cnt++)
+        sortJobMain(&jobs[cnt]);
+    for (int cnt = 0; cnt < started; cnt++)
+        pthread_join(jobs[cnt].thread, NULL);
+}
+
+// sorts the n keys in `keys` with `nthreads` threads. returns the array
+// holding the result, which is either `keys` or `scratch`
+static struct sortKey *sortParallel(struct sortKey *keys, struct sortKey *scratch, int n, int nthreads, int reverse)
+{
+    struct sortJob jobs[SORT_MAX_THREADS + 1]; // a round may add a copy job
+    int bound[SORT_MAX_THREADS + 1];
+    int nruns = nthreads;
+
+    for (int cnt = 0; cnt <= nruns; cnt++)
+        bound[cnt] = (long long)n * cnt / nruns;
+    for (int cnt = 0; cnt < nruns; cnt++)
+    {
+        struct sortJob *job = &jobs[cnt];
+        job->a = keys + bound[cnt];
+        job->na = bound[cnt + 1] - bound[cnt];
+        job->b = NULL;
+        job->out = scratch + bound[cnt];
+        job->reverse = reverse;
+    }
+    sortRunJobs(jobs, nruns);
+
+    // each round halves the runs. a merge is cut into as many pieces as
+    // there are threads for it: the pieces split run a evenly and run b
+    // where the rows cutting a would land in it
+    struct sortKey *src = keys;
+    struct sortKey *dst = scratch;
+    while (nruns > 1)
+    {
+        int pairs = nruns / 2;
+        int pieces = (nthreads / pairs > 0)
+                         ? nthreads / pairs
+                         : 1;
+        int njobs = 0;
+        int merged = 0;
+
+        for (int run = 0; run < nruns; run += 2)
+        {
+            struct sortKey *a = src + bound[run];
+            int na = bound[run + 1] - bound[run];
+            struct sortKey *out = dst + bound[run];
+
+            // an odd run out is copied over as a merge with nothing
+            if (run + 1 == nruns)
+            {
+                jobs[njobs++] = (struct sortJob){
+                    .a = a,
+                    .na = na,
+                    .b = a + na,
+                    .nb = 0,
+                    .out = out,
+                    .reverse = reverse};
+                bound[merged++] = bound[run];
+                continue;
+            }
+
+            struct sortKey *b = src + bound[run + 1];
+            int nb = bound[run + 2] - bound[run + 1];
+            int b_from = 0;
+            for (int piece = 0; piece < pieces; piece++)
+            {
+                int a_from = (long long)na * piece / pieces;
+                int a_to = (long long)na * (piece + 1) / pieces;
+                int b_to = (piece == pieces - 1)
+                               ? nb
+                               : sortLowerBound(b, nb, &a[a_to], reverse);
+
+                jobs[njobs++] = (struct sortJob){
+                    .a = a + a_from,
+                    .na = a_to - a_from,
+                    .b = b + b_from,
+                    .nb = b_to - b_from,
+                    .out = out + a_from + b_from,
+                    .reverse = reverse};
+                b_from = b_to;
+            }
+            bound[merged++] = bound[run];
+        }
+        bound[merged] = n;
+        nruns = merged;
+        sortRunJobs(jobs, njobs);
+
+        struct sortKey *swap = src;
+        src = dst;
+        dst = swap;
+    }
+    return src;
+}
+
+// highlights `row` again starting in `in_comment`. rows whose derived data
+// was evicted only need their open-comment state, so theirs is dropped
+// again afterwards
+static void sortRehighlight(editorContext *ctx, erow *row, int in_comment)
+{
+    int had_render = (row->render != NULL);
+
+    if (!had_render)
+        editorRenderRow(ctx, row);
+    editorHighlightRowFrom(ctx, row, in_comment);
+    if (!had_render)
+        editorRowDropDerived(ctx, row);
+}
+
+// sorts rows first..last by their bytes, in reverse with SORT_REVERSE.
+// rows that compare equal keep their order, and with SORT_UNIQUE only the
+// first of them is kept. returns how many rows were removed, or -1 with
+// errno set.
+int editorSortRows(editorContext *ctx, int first, int last, int flags)
+{
+    if (first < 0)
+        first = 0;
+    if (last >= ctx->numrows)
+        last = ctx->numrows - 1;
+    if (ctx->hex || first > last)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    int n = last - first + 1;
+    int reverse = (flags & SORT_REVERSE) != 0;
+    struct sortKey *keys = malloc(sizeof(struct sortKey) * n);
+    struct sortKey *scratch = malloc(sizeof(struct sortKey) * n);
+    erow *sorted = malloc(sizeof(erow) * n);
+    unsigned char *started = malloc(n);
+    unsigned char *moved = malloc(n);
+    if (keys == NULL || scratch == NULL || sorted == NULL || started == NULL || moved == NULL)
+    {
+        free(keys);
+        free(scratch);
+        free(sorted);
+        free(started);
+        free(moved);
+        errno = ENOMEM;
+        return -1;
+    }
+
+    // the comment state each row was highlighted starting in, and the one
+    // the row after the span started in
+    for (int cnt = 0; cnt < n; cnt++)
+    {
+        keys[cnt].row = &ctx->row[first + cnt];
+        started[cnt] = (first + cnt > 0) && ctx->row[first + cnt - 1].highlight_open_comment;
+    }
+    int after = ctx->row[last].highlight_open_comment;
+
+    long nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nthreads > n / SORT_MIN_RUN)
+        nthreads = n / SORT_MIN_RUN;
+    if (nthreads > SORT_MAX_THREADS)
+        nthreads = SORT_MAX_THREADS;
+    if (nthreads < 1)
+        nthreads = 1;
+
+    struct sortKey *order = sortParallel(keys, scratch, n, nthreads, reverse);
+
+    // move the row structs into their new order, freeing repeats
+    int kept = 0;
+    struct sortKey *prev = NULL;
+    for (int cnt = 0; cnt < n; cnt++)
+    {
+        // the rows are read in no particular order, ask for them early
+        if (cnt + SORT_PREFETCH < n)
+            __builtin_prefetch(order[cnt + SORT_PREFETCH].row);
+
+        erow *row = order[cnt].row;
+        if ((flags & SORT_UNIQUE) && prev && sortCompare(prev, &order[cnt], 0) == 0)
+        {
+            ctx->stats.row_bytes -= row->size + 1 + editorRowDerivedBytes(row);
+            ctx->stats.derived_bytes -= editorRowDerivedBytes(row);
+            editorFreeRow(row);
+            continue;
+        }
+        moved[kept] = started[row - &ctx->row[first]];
+        sorted[kept++] = *row;
+        prev = &order[cnt];
+    }
+
+    int removed = n - kept;
+    memcpy(&ctx->row[first], sorted, sizeof(erow) * kept);
+    if (removed)
+        memmove(&ctx->row[first + kept], &ctx->row[last + 1], sizeof(erow) * (ctx->numrows - last - 1));
+    ctx->numrows -= removed;
+
+    // a single pass sets the new indexes and highlights again only the rows
+    // that now start in a different comment state than they were
+    // highlighted in. rows after the span just move up past the repeats
+    int end = first + kept;
+    for (int cnt = first; cnt < end; cnt++)
+    {
+        erow *row = &ctx->row[cnt];
+        row->index = cnt;
+
+        int in_comment = (cnt > 0) && ctx->row[cnt - 1].highlight_open_comment;
+        if (!ctx->text_only && in_comment != moved[cnt - first])
+            sortRehighlight(ctx, row, in_comment);
+    }
+    for (int cnt = end; removed && cnt < ctx->numrows; cnt++)
+        ctx->row[cnt].index = cnt;
+    if (end < ctx->numrows && ctx->row[end - 1].highlight_open_comment != after)
+        editorUpdateSyntax(ctx, &ctx->row[end]);
+
+    free(keys);
+    free(scratch);
+    free(sorted);
+    free(started);
+    free(moved);
+
+    // folds over the span open
+    editorLineIndexSplice(ctx, first, n, kept);
+    editorBracketSplice(ctx, first, n, kept);
+    editorFoldRowsReplaced(ctx, first, n, kept);
+    ctx->dirty++;
+    return removed;
+}
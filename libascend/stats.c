@@ -0,0 +1,69 @@
+/*** includes ***/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include <string.h>
+#include <time.h>
+
+#include "ascend.h"
+
+/***  stats  ***/
+
+long long editorClockNs(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// approximate heap held by the rows: chars, render and highlight buffers
+// plus the row array itself
+size_t editorRowHeapBytes(editorContext *ctx)
+{
+    return ctx->stats.row_bytes + (size_t)ctx->numrows * sizeof(erow);
+}
+
+static size_t statsLineIndex(struct editorLineIndex *index)
+{
+    return (size_t)index->cap * (sizeof(struct editorLineBlock) + sizeof(long long) + sizeof(int)) +
+           (size_t)index->nblocks * LINE_BLOCK_ROWS * sizeof(int);
+}
+
+// splits a buffer's heap by what it holds. the counters only know the
+// text and everything derived from it, so this walks the rows; it is
+// meant for an occasional report, not for every frame.
+void editorMemoryUsage(editorContext *ctx, struct editorMemory *mem)
+{
+    memset(mem, 0, sizeof(*mem));
+    mem->chars = ctx->stats.row_bytes - ctx->stats.derived_bytes;
+    mem->rows = (size_t)ctx->numrows * sizeof(erow);
+    mem->line_index = statsLineIndex(&ctx->lines) + statsLineIndex(&ctx->wrap) +
+                      (size_t)ctx->brackets.cap * 2 * sizeof(struct editorBracketNode);
+    if (ctx->hex)
+        mem->hex = ctx->hex->dirty_pages * ctx->hex->pagesize +
+                   (ctx->hex->size / ctx->hex->pagesize + 8) / 8;
+    if (ctx->matches)
+    {
+        mem->matches = sizeof(*ctx->matches) + ctx->matches->len + 1;
+        for (int cnt = 0; cnt < ASCEND_MATCH_SLOTS; cnt++)
+            mem->matches += (size_t)ctx->matches->slot[cnt].cap * sizeof(int);
+    }
+
+    for (int cnt = 0; cnt < ctx->numrows; cnt++)
+    {
+        erow *row = &ctx->row[cnt];
+        if (row->render == NULL)
+            continue;
+        mem->render += row->rowsize + 1;
+        mem->highlight += row->rowsize;
+        if (row->cp)
+            mem->codepoints += (size_t)(row->ncp + 1) * sizeof(struct editorCodepoint);
+    }
+}
+
+size_t editorMemoryTotal(struct editorMemory *mem)
+{
+    return mem->chars + mem->render + mem->highlight + mem->codepoints + mem->rows + mem->line_index + mem->matches + mem->hex;
+}
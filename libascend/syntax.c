@@ -0,0 +1,331 @@
+/*** includes ***/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ascend.h"
+
+/***  filetypes  ***/
+
+char *C_Highlight_Extensions[] = {".c", ".h", ".cpp", NULL};
+char *C_Highlight_Keywords[] = {
+    "switch", "if", "while", "for", "break", "continue", "return", "else",
+    "struct", "union", "typedef", "static", "enum", "class", "case",
+
+    "int|", "long|", "double|", "float|", "char|", "unsigned|", "signed|",
+    "void|", NULL};
+
+struct editorSyntax HLDB[] = {
+    {
+        "c",
+        C_Highlight_Extensions,
+        C_Highlight_Keywords,
+        "//",
+        "/*",
+        "*/",
+        HL_HIGHLIGHT_NUMBERS | HL_HIGHLIGHT_STRINGS,
+        NULL,
+        NULL,
+        NULL,
+    },
+};
+
+#define HLDB_ENTRIES (sizeof(HLDB) / sizeof(HLDB[0]))
+
+// definitions loaded at run time, looked up before the built-in HLDB
+static struct editorSyntax **syntax_registry = NULL;
+static int syntax_registry_len = 0;
+
+/***  syntax highlighting  ***/
+
+// highlights a single row with the compiled lexer of the current syntax,
+// starting inside a comment if `in_comment` is set, and reports whether
+// its open-comment state changed, which means the following row has to be
+// highlighted again
+int editorHighlightRowFrom(editorContext *ctx, erow *row, int in_comment)
+{
+    row->highlight = realloc(row->highlight, row->rowsize);
+    memset(row->highlight, HL_NORMAL, row->rowsize);
+
+    if (ctx->syntax == NULL)
+    {
+        editorBracketSummarize(row);
+        return 0;
+    }
+
+    struct editorLexer *lex = ctx->syntax->lexer;
+    int flags = ctx->syntax->flags;
+    char *render = row->render;
+    unsigned char *highlight = row->highlight;
+
+    int prev_separator = 1;
+    int in_string = 0;
+
+    int cnt = 0;
+    while (cnt < row->rowsize)
+    {
+        unsigned char c = render[cnt];
+        int remaining = row->rowsize - cnt;
+        int kind;
+        int len;
+
+        if (in_comment)
+        {
+            highlight[cnt] = HL_MLCOMMENT;
+            len = editorLexMatch(lex, LEX_ROOT_COMMENT, &render[cnt], remaining, 1, &kind);
+            if (len)
+            {
+                memset(&highlight[cnt], HL_MLCOMMENT, len);
+                cnt += len;
+                in_comment = 0;
+                prev_separator = 1;
+            }
+            else
+                cnt++;
+            continue;
+        }
+
+        if (in_string)
+        {
+            highlight[cnt] = HL_STRING;
+
+            if (c == '\\' && cnt + 1 < row->rowsize)
+            {
+                highlight[cnt + 1] = HL_STRING;
+                cnt += 2;
+                continue;
+            }
+
+            if (c == in_string)
+                in_string = 0;
+            cnt++;
+            prev_separator = 1;
+            continue;
+        }
+
+        len = editorLexMatch(lex, LEX_ROOT, &render[cnt], remaining, prev_separator, &kind);
+
+        if (kind == LEX_COMMENT)
+        {
+            memset(&highlight[cnt], HL_COMMENT, remaining);
+            break;
+        }
+
+        if (kind == LEX_MLCOMMENT_START)
+        {
+            memset(&highlight[cnt], HL_MLCOMMENT, len);
+            cnt += len;
+            in_comment = 1;
+            continue;
+        }
+
+        if ((flags & HL_HIGHLIGHT_STRINGS) && (lex->cls[c] & LEX_QUOTE))
+        {
+            in_string = c;
+            highlight[cnt] = HL_STRING;
+            cnt++;
+            continue;
+        }
+
+        if (flags & HL_HIGHLIGHT_NUMBERS)
+        {
+            unsigned char prev_highlight = (cnt > 0)
+                                               ? highlight[cnt - 1]
+                                               : HL_NORMAL;
+
+            if (((lex->cls[c] & LEX_DIGIT) && (prev_separator || prev_highlight == HL_NUMBER)) ||
+                (c == '.' && prev_highlight == HL_NUMBER))
+            {
+                highlight[cnt] = HL_NUMBER;
+                cnt++;
+                prev_separator = 0;
+                continue;
+            }
+        }
+
+        if (kind == LEX_KEYWORD1 || kind == LEX_KEYWORD2)
+        {
+            memset(&highlight[cnt],
+
+                   kind == LEX_KEYWORD2
+                       ? HL_KEYWORD2
+                       : HL_KEYWORD1,
+
+                   len);
+
+            cnt += len;
+            prev_separator = 0;
+            continue;
+        }
+
+        prev_separator = lex->cls[c] & LEX_SEPARATOR;
+        cnt++;
+    }
+
+    int changed = (row->highlight_open_comment != in_comment);
+    row->highlight_open_comment = in_comment;
+    editorBracketSummarize(row);
+
+    return changed;
+}
+
+static int editorHighlightRow(editorContext *ctx, erow *row)
+{
+    int changed = editorHighlightRowFrom(ctx, row, row->index > 0 && ctx->row[row->index - 1].highlight_open_comment);
+    editorBracketUpdate(ctx, row);
+    return changed;
+}
+
+// highlights `count` consecutive rows that need not be in ctx->row yet,
+// assuming the first starts outside a comment. only reads ctx->syntax, so
+// loader threads can run it on disjoint spans; the caller fixes up spans
+// that really start inside a comment with editorUpdateSyntax.
+void editorHighlightRows(editorContext *ctx, erow *rows, int count)
+{
+    int in_comment = 0;
+
+    for (int cnt = 0; cnt < count; cnt++)
+    {
+        editorHighlightRowFrom(ctx, &rows[cnt], in_comment);
+        in_comment = rows[cnt].highlight_open_comment;
+    }
+}
+
+void editorUpdateSyntax(editorContext *ctx, erow *row)
+{
+    if (ctx->text_only)
+        return;
+
+    int timed = ctx->stats.enabled || editorTraceEnabled;
+    long long start = timed
+                          ? editorClockNs()
+                          : 0;
+
+    if (row->render == NULL)
+        editorRenderRow(ctx, row);
+
+    while (editorHighlightRow(ctx, row) && row->index + 1 < ctx->numrows)
+    {
+        row = &ctx->row[row->index + 1];
+        if (row->render == NULL)
+            editorRenderRow(ctx, row);
+    }
+
+    if (timed)
+    {
+        long long end = editorClockNs();
+        if (ctx->stats.enabled)
+            ctx->stats.syntax_ns += end - start;
+        editorTraceEvent("syntax", start, end);
+    }
+}
+
+// rehighlights rows first..last in one ordered pass, for bulk edits that
+// touched many rows. rows after `last` are only visited while the open
+// comment state keeps changing.
+void editorUpdateSyntaxRange(editorContext *ctx, int first, int last)
+{
+    if (ctx->text_only || first < 0 || first > last || first >= ctx->numrows)
+        return;
+    if (last >= ctx->numrows)
+        last = ctx->numrows - 1;
+
+    int timed = ctx->stats.enabled || editorTraceEnabled;
+    long long start = timed
+                          ? editorClockNs()
+                          : 0;
+
+    int cnt;
+    int changed = 0;
+    for (cnt = first; cnt <= last || (changed && cnt < ctx->numrows); cnt++)
+    {
+        erow *row = &ctx->row[cnt];
+        if (row->render == NULL)
+            editorRenderRow(ctx, row);
+        changed = editorHighlightRow(ctx, row);
+    }
+
+    if (timed)
+    {
+        long long end = editorClockNs();
+        if (ctx->stats.enabled)
+            ctx->stats.syntax_ns += end - start;
+        editorTraceEvent("syntax", start, end);
+    }
+}
+
+void editorRegisterSyntax(struct editorSyntax *syntax)
+{
+    struct editorSyntax **registry = realloc(syntax_registry, sizeof(struct editorSyntax *) * (syntax_registry_len + 1));
+    if (registry == NULL)
+        return;
+
+    syntax_registry = registry;
+    syntax_registry[syntax_registry_len++] = syntax;
+}
+
+static int editorSyntaxMatches(struct editorSyntax *syntax, const char *filename, const char *extension)
+{
+    for (unsigned int i = 0; syntax->filematch[i]; i++)
+    {
+        int is_extension = (syntax->filematch[i][0] == '.');
+        if (
+            (is_extension &&
+             extension &&
+             !strcmp(
+                 extension,
+                 syntax->filematch[i])) ||
+            (!is_extension &&
+             strstr(
+                 filename,
+                 syntax->filematch[i])))
+            return 1;
+    }
+    return 0;
+}
+
+void editorSelectSyntaxHighlight(editorContext *ctx)
+{
+    ctx->syntax = NULL;
+
+    if (ctx->filename == NULL)
+        return;
+
+    // app.log.gz highlights like app.log
+    char *filename = strdup(ctx->filename);
+    char *extension = strrchr(filename, '.');
+    if (extension && !strcmp(extension, ".gz"))
+    {
+        *extension = '\0';
+        extension = strrchr(filename, '.');
+    }
+
+    struct editorSyntax *syntax = NULL;
+
+    for (int j = 0; j < syntax_registry_len && !syntax; j++)
+        if (editorSyntaxMatches(syntax_registry[j], filename, extension))
+            syntax = syntax_registry[j];
+
+    for (unsigned int j = 0; j < HLDB_ENTRIES && !syntax; j++)
+        if (editorSyntaxMatches(&HLDB[j], filename, extension))
+            syntax = &HLDB[j];
+
+    free(filename);
+
+    if (syntax == NULL)
+        return;
+
+    // built-in entries are compiled the first time a file needs them
+    if (syntax->lexer == NULL && (syntax->lexer = editorCompileSyntax(syntax)) == NULL)
+        return;
+
+    ctx->syntax = syntax;
+
+    int filerow;
+    for (filerow = 0; filerow < ctx->numrows; filerow++)
+        editorUpdateSyntax(ctx, &ctx->row[filerow]);
+}
@@ -0,0 +1,175 @@
+/*** includes ***/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ascend.h"
+
+/*** defines ***/
+#define TRACE_RING_SIZE (1 << 16) // must be a power of two
+#define TRACE_RING_MASK (TRACE_RING_SIZE - 1)
+#define TRACE_DRAIN_INTERVAL_NS 5000000
+
+/*** data ***/
+
+struct traceEvent
+{
+    const char *name;
+    long long start_ns;
+    long long end_ns;
+    int seq;
+    int key;
+};
+
+// single producer (the editor thread) / single consumer (the writer
+// thread) ring. head is only written by the producer and tail only by the
+// consumer, so publishing an event is one release store and the editor
+// never waits on file I/O. when the writer falls behind, events are
+// dropped and counted rather than blocking the keystroke being measured.
+static struct traceEvent trace_ring[TRACE_RING_SIZE];
+static unsigned int trace_head;
+static unsigned int trace_tail;
+static unsigned long trace_dropped;
+
+static FILE *trace_fp;
+static pthread_t trace_writer;
+static int trace_stop;
+static int trace_seq;
+static int trace_key;
+static long long trace_epoch_ns;
+static int trace_first_event = 1;
+
+int editorTraceEnabled = 0;
+
+/***  trace writer  ***/
+
+static void traceWriteEvent(struct traceEvent *ev)
+{
+    double ts = (ev->start_ns - trace_epoch_ns) / 1e3;
+
+    fprintf(trace_fp, "%s\n", trace_first_event ? "" : ",");
+    trace_first_event = 0;
+
+    if (ev->end_ns == ev->start_ns)
+        fprintf(trace_fp,
+                "{\"name\":\"%s\",\"ph\":\"i\",\"s\":\"t\",\"ts\":%.3f,"
+                "\"pid\":%d,\"tid\":1,\"args\":{\"seq\":%d,\"key\":%d}}",
+                ev->name, ts, (int)getpid(), ev->seq, ev->key);
+    else
+        fprintf(trace_fp,
+                "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                "\"pid\":%d,\"tid\":1,\"args\":{\"seq\":%d,\"key\":%d}}",
+                ev->name, ts, (ev->end_ns - ev->start_ns) / 1e3,
+                (int)getpid(), ev->seq, ev->key);
+}
+
+static int traceDrain(void)
+{
+    unsigned int tail = trace_tail;
+    unsigned int head = __atomic_load_n(&trace_head, __ATOMIC_ACQUIRE);
+    int drained = head - tail;
+
+    while (tail != head)
+    {
+        traceWriteEvent(&trace_ring[tail & TRACE_RING_MASK]);
+        tail++;
+    }
+    __atomic_store_n(&trace_tail, tail, __ATOMIC_RELEASE);
+    return drained;
+}
+
+static void *traceWriterMain(void *arg)
+{
+    (void)arg;
+    struct timespec interval = {0, TRACE_DRAIN_INTERVAL_NS};
+
+    while (!__atomic_load_n(&trace_stop, __ATOMIC_ACQUIRE))
+    {
+        if (traceDrain() == 0)
+            nanosleep(&interval, NULL);
+    }
+    traceDrain();
+    return NULL;
+}
+
+/***  trace api  ***/
+
+// starts streaming Chrome trace events (chrome://tracing, Perfetto) to
+// `path`. returns -1 with errno set if the file or writer can't be created
+int editorTraceOpen(const char *path)
+{
+    if (editorTraceEnabled)
+        return 0;
+
+    trace_fp = fopen(path, "w");
+    if (trace_fp == NULL)
+        return -1;
+
+    fprintf(trace_fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+    trace_epoch_ns = editorClockNs();
+
+    if (pthread_create(&trace_writer, NULL, traceWriterMain, NULL) != 0)
+    {
+        fclose(trace_fp);
+        trace_fp = NULL;
+        return -1;
+    }
+
+    editorTraceEnabled = 1;
+    atexit(editorTraceClose);
+    return 0;
+}
+
+void editorTraceClose(void)
+{
+    if (!editorTraceEnabled)
+        return;
+
+    editorTraceEnabled = 0;
+    __atomic_store_n(&trace_stop, 1, __ATOMIC_RELEASE);
+    pthread_join(trace_writer, NULL);
+
+    fprintf(trace_fp, "\n],\"otherData\":{\"dropped_events\":%lu}}\n", trace_dropped);
+    fclose(trace_fp);
+    trace_fp = NULL;
+}
+
+// marks the start of a new keystroke; every event recorded until the next
+// call carries its sequence number so stages can be grouped per key
+void editorTraceKey(int key, long long ns)
+{
+    trace_seq++;
+    trace_key = key;
+    editorTraceEvent("readkey", ns, ns);
+}
+
+// records one stage. start == end records an instant event
+void editorTraceEvent(const char *name, long long start_ns, long long end_ns)
+{
+    if (!editorTraceEnabled)
+        return;
+
+    unsigned int head = trace_head;
+    unsigned int tail = __atomic_load_n(&trace_tail, __ATOMIC_ACQUIRE);
+
+    if (head - tail == TRACE_RING_SIZE)
+    {
+        trace_dropped++;
+        return;
+    }
+
+    struct traceEvent *ev = &trace_ring[head & TRACE_RING_MASK];
+    ev->name = name;
+    ev->start_ns = start_ns;
+    ev->end_ns = end_ns;
+    ev->seq = trace_seq;
+    ev->key = trace_key;
+    __atomic_store_n(&trace_head, head + 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,181 @@
+/*** includes ***/
+
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "ascend.h"
+
+/*** data ***/
+
+struct utf8Range
+{
+    int first;
+    int last;
+};
+
+// double width east asian ranges and emoji
+static const struct utf8Range utf8_wide[] = {
+    {0x1100, 0x115F},
+    {0x2E80, 0x303E},
+    {0x3041, 0x33FF},
+    {0x3400, 0x4DBF},
+    {0x4E00, 0x9FFF},
+    {0xA000, 0xA4CF},
+    {0xAC00, 0xD7A3},
+    {0xF900, 0xFAFF},
+    {0xFE30, 0xFE4F},
+    {0xFF00, 0xFF60},
+    {0xFFE0, 0xFFE6},
+    {0x1F300, 0x1F64F},
+    {0x1F900, 0x1F9FF},
+    {0x20000, 0x2FFFD},
+    {0x30000, 0x3FFFD},
+};
+
+// combining marks and other characters that take no column of their own
+static const struct utf8Range utf8_zero[] = {
+    {0x0300, 0x036F},
+    {0x0483, 0x0489},
+    {0x0591, 0x05BD},
+    {0x0610, 0x061A},
+    {0x064B, 0x065F},
+    {0x1AB0, 0x1AFF},
+    {0x1DC0, 0x1DFF},
+    {0x200B, 0x200F},
+    {0x20D0, 0x20FF},
+    {0xFE00, 0xFE0F},
+    {0xFE20, 0xFE2F},
+};
+
+/***  utf-8  ***/
+
+// true when no byte has its high bit set. rows are scanned 16 bytes at a
+// time with SSE2 where available, otherwise a machine word at a time.
+int editorIsAscii(const char *s, int len)
+{
+    int cnt = 0;
+
+#ifdef __SSE2__
+    for (; cnt + 16 <= len; cnt += 16)
+    {
+        __m128i block = _mm_loadu_si128((const __m128i *)(s + cnt));
+        if (_mm_movemask_epi8(block))
+            return 0;
+    }
+#else
+    for (; cnt + 8 <= len; cnt += 8)
+    {
+        uint64_t word;
+        memcpy(&word, s + cnt, 8);
+        if (word & 0x8080808080808080ULL)
+            return 0;
+    }
+#endif
+
+    for (; cnt < len; cnt++)
+        if (s[cnt] & 0x80)
+            return 0;
+    return 1;
+}
+
+// decodes one codepoint, returning how many bytes it used. malformed,
+// overlong or truncated sequences consume a single byte and yield -1.
+int editorUtf8Decode(const char *str, int len, int *codepoint)
+{
+    const unsigned char *s = (const unsigned char *)str;
+    int need;
+    int cp;
+    int min;
+
+    if (s[0] < 0x80)
+    {
+        *codepoint = s[0];
+        return 1;
+    }
+    else if ((s[0] & 0xE0) == 0xC0)
+    {
+        need = 1;
+        cp = s[0] & 0x1F;
+        min = 0x80;
+    }
+    else if ((s[0] & 0xF0) == 0xE0)
+    {
+        need = 2;
+        cp = s[0] & 0x0F;
+        min = 0x800;
+    }
+    else if ((s[0] & 0xF8) == 0xF0)
+    {
+        need = 3;
+        cp = s[0] & 0x07;
+        min = 0x10000;
+    }
+    else
+    {
+        *codepoint = -1;
+        return 1;
+    }
+
+    if (need >= len)
+    {
+        *codepoint = -1;
+        return 1;
+    }
+
+    for (int cnt = 1; cnt <= need; cnt++)
+    {
+        if ((s[cnt] & 0xC0) != 0x80)
+        {
+            *codepoint = -1;
+            return 1;
+        }
+        cp = (cp << 6) | (s[cnt] & 0x3F);
+    }
+
+    if (cp < min || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF))
+    {
+        *codepoint = -1;
+        return 1;
+    }
+
+    *codepoint = cp;
+    return need + 1;
+}
+
+static int utf8InRanges(const struct utf8Range *ranges, int count, int cp)
+{
+    int low = 0;
+    int high = count - 1;
+
+    while (low <= high)
+    {
+        int mid = (low + high) / 2;
+        if (cp < ranges[mid].first)
+            high = mid - 1;
+        else if (cp > ranges[mid].last)
+            low = mid + 1;
+        else
+            return 1;
+    }
+    return 0;
+}
+
+// terminal columns taken by a codepoint. invalid bytes and control
+// characters are drawn as a single inverse-video symbol.
+int editorCodepointWidth(int cp)
+{
+    if (cp < 0x20 || (cp >= 0x7F && cp < 0xA0))
+        return 1;
+    if (utf8InRanges(utf8_zero, sizeof(utf8_zero) / sizeof(utf8_zero[0]), cp))
+        return 0;
+    if (utf8InRanges(utf8_wide, sizeof(utf8_wide) / sizeof(utf8_wide[0]), cp))
+        return 2;
+    return 1;
+}